@@ -0,0 +1,10 @@
+#pragma once
+
+#include "AST/ASTNode.hpp"
+#include "utils/Arena.hpp"
+
+namespace lang
+{
+    // Owns every ASTNode of one parse; reset() at the start of the next file frees them all at once.
+    using ASTArena = Arena<ASTNode>;
+} // namespace lang
@@ -1,6 +1,5 @@
 #pragma once
 
-#include <memory>
 #include <string>
 #include <vector>
 
@@ -8,6 +7,9 @@
 
 namespace lang
 {
+    struct SymbolTableNode;
+    struct TypeInfo;
+
     struct ASTNode {
         enum class Kind {
             Prog,
@@ -46,9 +48,15 @@ namespace lang
         Kind kind;
         std::string lexeme;
         Token token; // source token for error location reporting
-        std::vector<std::shared_ptr<ASTNode>> children;
+        std::vector<ASTNode *> children;
         ASTNode *parent = nullptr;
+
+        // Filled in by semantic analysis on expression nodes and read back by the code generator. `symbol` is the variable,
+        // member or function the node names; `type` is null when the expression did not type check.
+        mutable const TypeInfo *type = nullptr;
+        mutable const SymbolTableNode *symbol = nullptr;
+        mutable bool typed = false;
     };
 
-    using ASTNodePtr = std::shared_ptr<ASTNode>;
+    using ASTNodePtr = ASTNode *;
 } // namespace lang
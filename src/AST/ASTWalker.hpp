@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "AST/ASTNode.hpp"
+
+namespace lang
+{
+    // The statement blocks nested in an if (then, else) or a while (body), in source order.
+    inline std::span<ASTNode *const> NestedStatBlocks(const ASTNode *stat)
+    {
+        const std::span<ASTNode *const> children(stat->children);
+        if (stat->kind == ASTNode::Kind::IfStat && children.size() >= 3)
+            return children.subspan(1, 2);
+        if (stat->kind == ASTNode::Kind::WhileStat && children.size() >= 2)
+            return children.subspan(1, 1);
+        return {};
+    }
+
+    // Depth-first walk over an AST that keeps its own stack, so native stack use does not grow with nesting depth.
+    //
+    // The visitor provides:
+    //   bool enter(Node *node)   called before a node's children; return false to skip them
+    //   void leave(Node *node)   called once the children are done (also for nodes whose children were skipped)
+    // and optionally:
+    //   std::span<ASTNode *const> children(Node *node)   which nodes to descend into, defaults to node->children
+    //
+    // Child pointers may be null; the visitor decides what a null child means. The hooks are called directly, so a pass
+    // pays no indirect call per node.
+    template <typename Node, typename Visitor>
+    void WalkAST(Node *root, Visitor &&visitor)
+    {
+        static_assert(std::is_same_v<std::remove_const_t<Node>, ASTNode>, "WalkAST walks ASTNode trees");
+
+        auto childrenOf = [&](Node *node) -> std::span<ASTNode *const> {
+            if constexpr (requires { visitor.children(node); })
+                return visitor.children(node);
+            else
+                return node ? std::span<ASTNode *const>(node->children) : std::span<ASTNode *const>();
+        };
+
+        struct Frame {
+            Node *node;
+            std::span<ASTNode *const> children;
+            std::size_t next;
+        };
+
+        if (!visitor.enter(root)) {
+            visitor.leave(root);
+            return;
+        }
+
+        std::vector<Frame> stack;
+        stack.push_back({ root, childrenOf(root), 0 });
+        while (!stack.empty()) {
+            Frame &top = stack.back();
+            if (top.next == top.children.size()) {
+                Node *node = top.node;
+                stack.pop_back();
+                visitor.leave(node);
+                continue;
+            }
+
+            Node *child = top.children[top.next++];
+            if (visitor.enter(child))
+                stack.push_back({ child, childrenOf(child), 0 });
+            else
+                visitor.leave(child);
+        }
+    }
+} // namespace lang
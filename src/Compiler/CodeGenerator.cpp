@@ -1,49 +1,125 @@
 #include "CodeGenerator.hpp"
+#include "AST/ASTWalker.hpp"
+#include "Compiler/ControlFlowGraph.hpp"
+#include "Compiler/RegisterAllocator.hpp"
 
 #include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <format>
-#include <set>
-#include <sstream>
-#include <stdexcept>
+#include <span>
 
 namespace lang
 {
-    static std::string lpad(const std::string &lbl, int width = 12)
+    using ChildSpan = std::span<ASTNode *const>;
+
+    CodeGenerator::CodeGenerator(const ASTNode *ast, const SymbolTableNode *globalTable) : m_ast(ast), m_globalTable(globalTable)
     {
-        if ((int)lbl.size() < width)
-            return lbl + std::string(width - lbl.size(), ' ');
-        return lbl + ' ';
+        if (!m_globalTable)
+            return;
+        for (auto *entry : m_globalTable->table) {
+            if (entry->kind == SymbolTableNode::Kind::Class) {
+                m_classesByName.try_emplace(entry->name, entry);
+                m_classesByLowerName.try_emplace(SymbolInterner::Fold(entry->name), entry);
+            } else if (entry->kind == SymbolTableNode::Kind::Function) {
+                m_freeFunctionsByName[entry->name].push_back(entry);
+                m_freeFunctionsByLowerName.try_emplace(SymbolInterner::Fold(entry->name), entry);
+            }
+        }
     }
 
-    CodeGenerator::CodeGenerator(std::shared_ptr<const ASTNode> ast, const SymbolTableNode *globalTable) : m_ast(ast), m_globalTable(globalTable)
+    Reg CodeGenerator::newReg()
     {
-        for (int i = 12; i >= 1; --i) m_freeRegs.push_back(i);
+        return m_func.newReg();
     }
 
-    int CodeGenerator::allocReg()
+    Reg CodeGenerator::zeroReg(std::string comment)
     {
-        if (m_freeRegs.empty())
-            throw std::runtime_error("code generator: register exhausted");
-        int r = m_freeRegs.back();
-        m_freeRegs.pop_back();
+        Reg r = newReg();
+        emit({ .op = MoonOp::Add, .rd = r, .rs = 0, .rt = 0, .comment = std::move(comment) });
         return r;
     }
 
-    void CodeGenerator::freeReg(int r)
+    Reg CodeGenerator::promoteToFloat(Reg r, std::string comment)
+    {
+        Reg res = newReg();
+        emit({ .op = MoonOp::Muli, .rd = res, .rs = r, .imm = 100, .comment = std::move(comment) });
+        return res;
+    }
+
+    void CodeGenerator::beginFunction(int frameSize)
+    {
+        m_func = {};
+        m_func.frameSize = frameSize;
+        m_varRegs.clear();
+    }
+
+    // Int and float variables whose address is never needed start the function in a register, loaded from the slot
+    // where the caller passed them (parameters) or where they would otherwise live; the load is dropped by the
+    // allocator when the variable is assigned before it is read.
+    void CodeGenerator::promoteVariables(const SymbolTableNode *funcNode)
+    {
+        if (!funcNode)
+            return;
+        for (auto *entry : funcNode->table) {
+            if (entry->kind != SymbolTableNode::Kind::Parameter && entry->kind != SymbolTableNode::Kind::Local)
+                continue;
+            TypeId type = entry->signature.typeId;
+            if (!type || type->isArray() || (type->base != TypeInfo::Base::Int && type->base != TypeInfo::Base::Float))
+                continue;
+
+            Reg r = newReg();
+            if (auto fit = m_currentFrame.offsets.find(entry->name); fit != m_currentFrame.offsets.end()) {
+                emit({ .op = MoonOp::Lw, .rd = r, .rs = 14, .imm = fit->second, .comment = std::format("'{}'", entry->name) });
+            } else if (auto git = m_globalLabels.find(entry->name); git != m_globalLabels.end() && !m_globalsUsedElsewhere.contains(entry->name)) {
+                emit({ .op = MoonOp::Lw, .rd = r, .rs = 0, .sym = git->second, .comment = std::format("'{}'", entry->name) });
+            } else {
+                continue;
+            }
+            m_varRegs.try_emplace(entry->name, r);
+        }
+    }
+
+    void CodeGenerator::finishFunction()
     {
-        m_freeRegs.push_back(r);
+        m_passes.run(m_func);
+        if (m_dumpIR) {
+            PrintIR(m_func, m_ir);
+            m_ir.append("\n");
+        }
+        RegisterAllocator(m_func).run();
+        m_peephole.run(m_func);
+        for (const auto &instr : m_func.code) PrintMoon(instr, m_code);
+        m_func = {};
+        m_varRegs.clear();
     }
 
-    void CodeGenerator::emit(const std::string &line)
+    void CodeGenerator::emit(MoonInstr instr)
     {
-        m_code << line << "\n";
+        m_func.code.push_back(std::move(instr));
     }
 
-    void CodeGenerator::emitData(const std::string &line)
+    void CodeGenerator::emitText(std::string text)
     {
-        m_data << line << "\n";
+        emit({ .op = MoonOp::Text, .sym = std::move(text) });
+    }
+
+    void CodeGenerator::emitLabel(std::string label, std::string comment)
+    {
+        emit({ .op = MoonOp::Add, .rd = 0, .rs = 0, .rt = 0, .label = std::move(label), .comment = std::move(comment) });
+    }
+
+    void CodeGenerator::emitCall(CallSite call, Reg result)
+    {
+        const int index = static_cast<int>(m_func.calls.size());
+        m_func.calls.push_back(std::move(call));
+        emit({ .op = MoonOp::Call, .rd = result, .imm = index });
+    }
+
+    void CodeGenerator::emitData(std::string_view line)
+    {
+        m_data.append(line);
+        m_data.append("\n");
     }
 
     std::string CodeGenerator::newLabel(const std::string &hint)
@@ -52,127 +128,100 @@ namespace lang
     }
 
 
-    int CodeGenerator::sizeOf(const std::string &type) const
+    int CodeGenerator::sizeOf(TypeId type) const
     {
-        size_t bracket = type.find('[');
-        std::string base = (bracket != std::string::npos) ? type.substr(0, bracket) : type;
-
-        if (base.empty())
+        if (!type)
             return 4;
-
-        int baseSize;
-        if (base == "int" || base == "float" || base == "void") {
-            baseSize = 4;
-        } else {
-            const SymbolTableNode *cls = findClass(base);
-            baseSize = cls ? sizeOfClass(cls) : 4;
+        if (auto it = m_typeSizes.find(type); it != m_typeSizes.end())
+            return it->second;
+
+        int size = 4;
+        bool cacheable = true;
+        if (type->base == TypeInfo::Base::Class) {
+            if (const SymbolTableNode *cls = findClass(type->scalar->spelling)) {
+                const ClassLayout &layout = layoutOf(cls);
+                size = layout.size;
+                cacheable = layout.complete;
+            }
         }
 
-        if (bracket == std::string::npos)
-            return baseSize;
-
-        int product = 1;
-        size_t pos = bracket;
-        while (pos != std::string::npos) {
-            size_t close = type.find(']', pos);
-            std::string dimStr = type.substr(pos + 1, close - pos - 1);
-            if (dimStr.empty()) {
-                return 4;
+        for (int dim : type->dims) {
+            if (dim == TypeInfo::UNSIZED) {
+                size = 4;
+                break;
             }
-            product *= std::stoi(dimStr);
-            pos = type.find('[', close);
+            size *= dim;
         }
-        return baseSize * product;
+
+        if (cacheable)
+            m_typeSizes.emplace(type, size);
+        return size;
     }
 
     int CodeGenerator::sizeOfClass(const SymbolTableNode *cls) const
     {
-        if (!cls)
-            return 0;
+        return cls ? layoutOf(cls).size : 0;
+    }
 
-        int total = 0;
+    const ClassLayout &CodeGenerator::layoutOf(const SymbolTableNode *cls) const
+    {
+        auto [it, inserted] = m_classLayouts.try_emplace(cls);
+        ClassLayout &layout = it->second;
+        // a layout that is still being built means the inheritance graph has a cycle; the partial layout stops the recursion
+        if (!inserted)
+            return layout;
 
         for (auto *entry : cls->table) {
-            if (entry->kind == SymbolTableNode::Kind::Inherit && entry->name != "none") {
-                std::string inherited = entry->name;
-                size_t pos = 0;
-                while (pos < inherited.size()) {
-                    size_t comma = inherited.find(',', pos);
-                    std::string baseName = (comma == std::string::npos) ? inherited.substr(pos) : inherited.substr(pos, comma - pos);
-                    while (!baseName.empty() && baseName.front() == ' ') baseName.erase(0, 1);
-                    while (!baseName.empty() && baseName.back() == ' ') baseName.pop_back();
-                    const SymbolTableNode *base = findClass(baseName);
-
-                    if (base)
-                        total += sizeOfClass(base);
-
-                    pos = (comma == std::string::npos) ? inherited.size() : comma + 1;
+            if (entry->kind != SymbolTableNode::Kind::Inherit || entry->name == "none")
+                continue;
+            const std::string &inherited = entry->name;
+            size_t pos = 0;
+            while (pos < inherited.size()) {
+                size_t comma = inherited.find(',', pos);
+                std::string baseName = (comma == std::string::npos) ? inherited.substr(pos) : inherited.substr(pos, comma - pos);
+                while (!baseName.empty() && baseName.front() == ' ') baseName.erase(0, 1);
+                while (!baseName.empty() && baseName.back() == ' ') baseName.pop_back();
+
+                if (const SymbolTableNode *base = findClass(baseName)) {
+                    const ClassLayout &baseLayout = layoutOf(base);
+                    for (const auto &[member, offset] : baseLayout.offsets) layout.offsets.try_emplace(member, layout.size + offset);
+                    layout.size += baseLayout.size;
                 }
+
+                pos = (comma == std::string::npos) ? inherited.size() : comma + 1;
             }
         }
 
         for (auto *entry : cls->table) {
-            if (entry->kind == SymbolTableNode::Kind::Data)
-                total += sizeOf(entry->signature.type);
+            if (entry->kind != SymbolTableNode::Kind::Data)
+                continue;
+            layout.offsets.try_emplace(entry->name, layout.size);
+            layout.size += sizeOf(entry->signature.typeId);
         }
 
-        return total;
+        layout.complete = true;
+        return layout;
     }
 
-    bool CodeGenerator::isPointerType(const std::string &type) const
+    bool CodeGenerator::isPointerType(TypeId type) const
     {
-        size_t bracket = type.find('[');
-
-        if (bracket == std::string::npos)
-            return false;
-
-        size_t close = type.find(']', bracket);
-
-        return (close == bracket + 1);
+        return type && type->isPointer();
     }
 
     const SymbolTableNode *CodeGenerator::findClass(const std::string &name) const
     {
-        for (auto *entry : m_globalTable->table) {
-            if (entry->kind == SymbolTableNode::Kind::Class && entry->name == name)
-                return entry;
-        }
-
-        std::string lower = name;
-        for (char &c : lower) c = (char)std::tolower((unsigned char)c);
-
-        for (auto *entry : m_globalTable->table) {
-            if (entry->kind == SymbolTableNode::Kind::Class) {
-                std::string eName = entry->name;
-                for (char &c : eName) c = (char)std::tolower((unsigned char)c);
-                if (eName == lower)
-                    return entry;
-            }
-        }
-
-        return nullptr;
+        if (auto it = m_classesByName.find(name); it != m_classesByName.end())
+            return it->second;
+        auto it = m_classesByLowerName.find(SymbolInterner::Fold(name));
+        return it == m_classesByLowerName.end() ? nullptr : it->second;
     }
 
     const SymbolTableNode *CodeGenerator::findFreeFunction(const std::string &name) const
     {
-        for (auto *entry : m_globalTable->table) {
-            if (entry->kind == SymbolTableNode::Kind::Function && entry->name == name)
-                return entry;
-        }
-
-        std::string lower = name;
-        for (char &c : lower) c = (char)std::tolower((unsigned char)c);
-
-        for (auto *entry : m_globalTable->table) {
-            if (entry->kind == SymbolTableNode::Kind::Function) {
-                std::string eName = entry->name;
-                for (char &c : eName) c = (char)std::tolower((unsigned char)c);
-                if (eName == lower)
-                    return entry;
-            }
-        }
-
-        return nullptr;
+        if (auto it = m_freeFunctionsByName.find(name); it != m_freeFunctionsByName.end())
+            return it->second.front();
+        auto it = m_freeFunctionsByLowerName.find(SymbolInterner::Fold(name));
+        return it == m_freeFunctionsByLowerName.end() ? nullptr : it->second;
     }
 
     const SymbolTableNode *CodeGenerator::findMethod(const SymbolTableNode *cls, const std::string &name) const
@@ -180,122 +229,169 @@ namespace lang
         if (!cls)
             return nullptr;
 
-        for (auto *entry : cls->table) {
-            if (entry->kind == SymbolTableNode::Kind::Function && entry->name == name)
-                return entry;
+        auto [it, inserted] = m_methodsByClass.try_emplace(cls);
+        if (inserted) {
+            for (auto *entry : cls->table) {
+                if (entry->kind == SymbolTableNode::Kind::Function)
+                    it->second.try_emplace(entry->name, entry);
+            }
         }
 
-        return nullptr;
+        auto method = it->second.find(name);
+        return method == it->second.end() ? nullptr : method->second;
     }
 
-    int CodeGenerator::memberOffset(const SymbolTableNode *cls, const std::string &name) const
+    const SymbolTableNode *CodeGenerator::resolveFreeCall(const std::string &name, const std::vector<ASTNode *> &args) const
     {
-        if (!cls)
-            return -1;
-
-        int offset = 0;
-
-        for (auto *entry : cls->table) {
-            if (entry->kind != SymbolTableNode::Kind::Inherit || entry->name == "none")
-                continue;
-            std::string inherited = entry->name;
-            size_t pos = 0;
-            while (pos < inherited.size()) {
-                size_t comma = inherited.find(',', pos);
-                std::string baseName = (comma == std::string::npos) ? inherited.substr(pos) : inherited.substr(pos, comma - pos);
-                while (!baseName.empty() && baseName.front() == ' ') baseName.erase(0, 1);
-                while (!baseName.empty() && baseName.back() == ' ') baseName.pop_back();
-                const SymbolTableNode *base = findClass(baseName);
-                if (base) {
-                    int baseOff = memberOffset(base, name);
-                    if (baseOff >= 0)
-                        return offset + baseOff;
-                    offset += sizeOfClass(base);
+        std::string key = name;
+        key += '(';
+        for (auto &arg : args) key += isFloatExpr(arg) ? 'f' : 'i';
+
+        auto [it, inserted] = m_freeCallTargets.try_emplace(std::move(key), nullptr);
+        if (!inserted)
+            return it->second;
+
+        const SymbolTableNode *target = nullptr;
+        if (auto overloads = m_freeFunctionsByName.find(name); overloads != m_freeFunctionsByName.end()) {
+            for (auto *entry : overloads->second) {
+                if (entry->signature.paramTypeIds.size() != args.size())
+                    continue;
+                bool match = true;
+                for (size_t k = 0; k < args.size(); k++) {
+                    TypeId ptype = entry->signature.paramTypeIds[k];
+                    std::string_view pbase = TypeTable::Spelling(ptype ? ptype->scalar : nullptr);
+                    std::string_view abase = it->first[name.size() + 1 + k] == 'f' ? "float" : "int";
+                    if (pbase != abase && !(pbase == "float" && abase == "int")) {
+                        match = false;
+                        break;
+                    }
+                }
+                if (match) {
+                    target = entry;
+                    break;
                 }
-                pos = (comma == std::string::npos) ? inherited.size() : comma + 1;
             }
         }
+        if (!target)
+            target = findFreeFunction(name);
 
-        for (auto *entry : cls->table) {
-            if (entry->kind != SymbolTableNode::Kind::Data)
-                continue;
-            if (entry->name == name)
-                return offset;
-            offset += sizeOf(entry->signature.type);
-        }
+        it->second = target;
+        return target;
+    }
+
+    int CodeGenerator::memberOffset(const SymbolTableNode *cls, const std::string &name) const
+    {
+        if (!cls)
+            return -1;
 
-        return -1;
+        const ClassLayout &layout = layoutOf(cls);
+        auto it = layout.offsets.find(name);
+        return it == layout.offsets.end() ? -1 : it->second;
     }
 
-    std::string CodeGenerator::getVarType(const std::string &name) const
+    TypeId CodeGenerator::getVarType(const std::string &name) const
     {
         if (m_currentFuncNode) {
             for (auto *entry : m_currentFuncNode->table) {
                 if ((entry->kind == SymbolTableNode::Kind::Parameter || entry->kind == SymbolTableNode::Kind::Local) && entry->name == name)
-                    return entry->signature.type;
+                    return entry->signature.typeId;
             }
         }
 
         if (m_currentClassNode) {
             for (auto *entry : m_currentClassNode->table) {
                 if (entry->kind == SymbolTableNode::Kind::Data && entry->name == name)
-                    return entry->signature.type;
+                    return entry->signature.typeId;
             }
         }
 
         auto it = m_globalLabels.find(name);
-        if (it != m_globalLabels.end()) {
-            for (auto *fentry : m_globalTable->table) {
-                if (fentry->kind == SymbolTableNode::Kind::Function && fentry->name == "main") {
-                    for (auto *entry : fentry->table) {
-                        if (entry->name == name)
-                            return entry->signature.type;
-                    }
+        auto mains = m_freeFunctionsByName.find("main");
+        if (it != m_globalLabels.end() && mains != m_freeFunctionsByName.end()) {
+            for (auto *fentry : mains->second) {
+                for (auto *entry : fentry->table) {
+                    if (entry->name == name)
+                        return entry->signature.typeId;
                 }
             }
         }
 
-        return "";
+        return nullptr;
+    }
+
+    // Semantic analysis already resolved most names; the lookups by spelling remain for nodes it could not type,
+    // such as main's variables referenced from other functions.
+    TypeId CodeGenerator::getIdType(const ASTNode *node) const
+    {
+        if (const SymbolTableNode *sym = node->symbol; sym && node->kind == ASTNode::Kind::Id && sym->kind != SymbolTableNode::Kind::Function)
+            return sym->signature.typeId;
+        return getVarType(node->lexeme);
     }
 
-    std::string CodeGenerator::getExprType(std::shared_ptr<const ASTNode> node) const
+    const SymbolTableNode *CodeGenerator::calledFreeFunction(const ASTNode *call) const
+    {
+        if (const SymbolTableNode *sym = call->symbol; sym && sym->parent == m_globalTable)
+            return sym;
+        static const std::vector<ASTNode *> noArgs;
+        return resolveFreeCall(call->children[0]->lexeme, call->children.size() >= 2 ? call->children[1]->children : noArgs);
+    }
+
+    const SymbolTableNode *CodeGenerator::calledMethod(const ASTNode *call, const SymbolTableNode *cls) const
+    {
+        if (!cls)
+            return nullptr;
+        if (const SymbolTableNode *sym = call->symbol; sym && sym->parent == cls)
+            return sym;
+        return findMethod(cls, call->children[0]->children[1]->lexeme);
+    }
+
+    // The function a call node invokes, free or a method of `classSym`; null when it cannot be resolved
+    const SymbolTableNode *CodeGenerator::calledFunction(const ASTNode *call, const SymbolTableNode *&classSym) const
+    {
+        classSym = nullptr;
+        if (call->children.size() < 2 || !call->children[0] || !call->children[1])
+            return nullptr;
+        const ASTNode *callee = call->children[0];
+        if (callee->kind == ASTNode::Kind::Id)
+            return calledFreeFunction(call);
+        if (callee->kind != ASTNode::Kind::MemberAccess || callee->children.size() < 2)
+            return nullptr;
+        classSym = findClass(std::string(TypeTable::Spelling(getIdType(callee->children[0]))));
+        return calledMethod(call, classSym);
+    }
+
+    TypeId CodeGenerator::getExprType(const ASTNode *node) const
     {
         if (!node)
-            return "";
+            return nullptr;
         switch (node->kind) {
             case ASTNode::Kind::Id:
-                return getVarType(node->lexeme);
+                return getIdType(node);
             case ASTNode::Kind::IndexedVar:
                 {
                     if (node->children.empty())
-                        return "";
-                    std::string base = getExprType(node->children[0]);
-                    size_t pos = base.find('[');
-                    if (pos == std::string::npos)
-                        return base;
-                    size_t end = base.find(']', pos);
-                    if (end == std::string::npos)
-                        return base;
-                    return base.substr(0, pos) + base.substr(end + 1);
+                        return nullptr;
+                    TypeId base = getExprType(node->children[0]);
+                    return base ? base->element : nullptr;
                 }
             case ASTNode::Kind::MemberAccess:
                 {
                     if (node->children.size() < 2)
-                        return "";
-                    std::string objType = getExprType(node->children[0]);
-                    size_t br = objType.find('[');
-                    std::string baseName = (br != std::string::npos) ? objType.substr(0, br) : objType;
-                    const SymbolTableNode *cls = findClass(baseName);
+                        return nullptr;
+                    if (const SymbolTableNode *sym = node->symbol; sym && sym->kind == SymbolTableNode::Kind::Data)
+                        return sym->signature.typeId;
+                    TypeId objType = getExprType(node->children[0]);
+                    const SymbolTableNode *cls = objType ? findClass(objType->scalar->spelling) : nullptr;
                     if (!cls)
-                        return "";
+                        return nullptr;
                     for (auto *entry : cls->table) {
                         if (entry->kind == SymbolTableNode::Kind::Data && entry->name == node->children[1]->lexeme)
-                            return entry->signature.type;
+                            return entry->signature.typeId;
                     }
-                    return "";
+                    return nullptr;
                 }
             default:
-                return "";
+                return nullptr;
         }
     }
 
@@ -316,7 +412,7 @@ namespace lang
         for (auto *entry : funcNode->table) {
             if (entry->kind != SymbolTableNode::Kind::Parameter)
                 continue;
-            int sz = sizeOf(entry->signature.type);
+            int sz = sizeOf(entry->signature.typeId);
             if (sz <= 0)
                 sz = 4;
             cursor += sz;
@@ -326,7 +422,7 @@ namespace lang
         for (auto *entry : funcNode->table) {
             if (entry->kind != SymbolTableNode::Kind::Local)
                 continue;
-            int sz = sizeOf(entry->signature.type);
+            int sz = sizeOf(entry->signature.typeId);
             if (sz <= 0)
                 sz = 4;
             cursor += sz;
@@ -337,6 +433,15 @@ namespace lang
         return fi;
     }
 
+    const FrameInfo &CodeGenerator::frameInfo(const SymbolTableNode *funcNode, bool isMember) const
+    {
+        auto &frames = m_frames[isMember ? 1 : 0];
+        auto it = frames.find(funcNode);
+        if (it == frames.end())
+            it = frames.emplace(funcNode, computeFrameInfo(funcNode, isMember)).first;
+        return it->second;
+    }
+
     std::unordered_map<std::string, std::string> CodeGenerator::allocateGlobals(const SymbolTableNode *mainNode)
     {
         std::unordered_map<std::string, std::string> labels;
@@ -348,10 +453,10 @@ namespace lang
             if (entry->kind != SymbolTableNode::Kind::Local)
                 continue;
             std::string label = std::format("t{}_{}", 0, entry->name);
-            int sz = sizeOf(entry->signature.type);
+            int sz = sizeOf(entry->signature.typeId);
             if (sz <= 0)
                 sz = 4;
-            emitData(lpad(label) + std::format("res    {}   % {} {}", sz, entry->signature.type, entry->name));
+            emitData("{:<11} res    {}   % {} {}", label, sz, entry->signature.type, entry->name);
             labels[entry->name] = label;
         }
 
@@ -376,19 +481,84 @@ namespace lang
         return "func_" + funcNode->name + paramStr;
     }
 
-    int CodeGenerator::loadVar(const std::string &name)
+    const SymbolTableNode *CodeGenerator::definedFunction(const ASTNode *funcDef, const SymbolTableNode *&classSym) const
     {
-        int r = allocReg();
+        classSym = nullptr;
+        auto &nameNode = funcDef->children[1];
+
+        if (nameNode->kind == ASTNode::Kind::MemberAccess) {
+            std::string className = nameNode->children[0]->lexeme;
+            std::string funcName = nameNode->children[1]->lexeme;
+            classSym = findClass(className);
+            return classSym ? findMethod(classSym, funcName) : nullptr;
+        }
+
+        auto &paramListNode = funcDef->children[2];
+        std::vector<std::string> defParams;
+        for (auto &param : paramListNode->children) {
+            if (param->kind == ASTNode::Kind::VarDecl && param->children.size() >= 3) {
+                std::string raw = param->children[0]->lexeme;
+                std::string t = SymbolInterner::Fold(raw) == "integer" ? "int" : raw;
+                for (auto &dim : param->children[2]->children) t += "[" + dim->lexeme + "]";
+                defParams.push_back(t);
+            }
+        }
+        if (auto overloads = m_freeFunctionsByName.find(nameNode->lexeme); overloads != m_freeFunctionsByName.end()) {
+            for (auto *entry : overloads->second) {
+                if (entry->signature.params == defParams)
+                    return entry;
+            }
+        }
+        return findFreeFunction(nameNode->lexeme);
+    }
+
+    // A name a function does not declare falls back to main's variable of that name, so those variables cannot be kept
+    // in registers while main runs.
+    void CodeGenerator::findGlobalsUsedElsewhere(const ASTNode *funcDefs)
+    {
+        m_globalsUsedElsewhere.clear();
+        for (auto &funcDef : funcDefs->children) {
+            if (!funcDef || funcDef->children.size() < 4)
+                continue;
+            const SymbolTableNode *classSym = nullptr;
+            const SymbolTableNode *funcSym = definedFunction(funcDef, classSym);
+            if (!funcSym)
+                continue;
+
+            struct {
+                CodeGenerator &gen;
+                const FrameInfo &frame;
+
+                bool enter(const ASTNode *n)
+                {
+                    if (!n)
+                        return false;
+                    if (n->kind == ASTNode::Kind::Id && !frame.offsets.contains(n->lexeme) && gen.m_globalLabels.contains(n->lexeme))
+                        gen.m_globalsUsedElsewhere.insert(n->lexeme);
+                    return true;
+                }
+                void leave(const ASTNode *) {}
+            } visitor{ *this, frameInfo(funcSym, classSym != nullptr) };
+            WalkAST(funcDef->children[3], visitor);
+        }
+    }
+
+    Reg CodeGenerator::loadVar(const std::string &name)
+    {
+        if (auto vit = m_varRegs.find(name); vit != m_varRegs.end())
+            return vit->second;
+
+        Reg r = newReg();
 
         auto fit = m_currentFrame.offsets.find(name);
         if (fit != m_currentFrame.offsets.end()) {
-            emit(std::format("         lw     r{},{}(r14)", r, fit->second));
+            emit({ .op = MoonOp::Lw, .rd = r, .rs = 14, .imm = fit->second });
             return r;
         }
 
         auto git = m_globalLabels.find(name);
         if (git != m_globalLabels.end()) {
-            emit(std::format("         lw     r{},{}(r0)", r, git->second));
+            emit({ .op = MoonOp::Lw, .rd = r, .rs = 0, .sym = git->second });
             return r;
         }
 
@@ -396,30 +566,34 @@ namespace lang
             for (auto *entry : m_currentClassNode->table) {
                 if (entry->kind == SymbolTableNode::Kind::Data && entry->name == name) {
                     int selfOff = m_currentFrame.offsets.at("__self");
-                    int selfReg = allocReg();
-                    emit(std::format("         lw     r{},{}(r14)   % load self", selfReg, selfOff));
-                    emit(std::format("         lw     r{},{}(r{})", r, memberOffset(m_currentClassNode, name), selfReg));
-                    freeReg(selfReg);
+                    Reg selfReg = newReg();
+                    emit({ .op = MoonOp::Lw, .rd = selfReg, .rs = 14, .imm = selfOff, .comment = "load self" });
+                    emit({ .op = MoonOp::Lw, .rd = r, .rs = selfReg, .imm = memberOffset(m_currentClassNode, name) });
                     return r;
                 }
             }
         }
 
-        emit(std::format("         add    r{},r0,r0   % var '{}' not found", r, name));
+        emit({ .op = MoonOp::Add, .rd = r, .rs = 0, .rt = 0, .comment = std::format("var '{}' not found", name) });
         return r;
     }
 
-    void CodeGenerator::storeVar(const std::string &name, int valueReg)
+    void CodeGenerator::storeVar(const std::string &name, Reg valueReg)
     {
+        if (auto vit = m_varRegs.find(name); vit != m_varRegs.end()) {
+            emit({ .op = MoonOp::Add, .rd = vit->second, .rs = valueReg, .rt = 0 });
+            return;
+        }
+
         auto fit = m_currentFrame.offsets.find(name);
         if (fit != m_currentFrame.offsets.end()) {
-            emit(std::format("         sw     {}(r14),r{}", fit->second, valueReg));
+            emit({ .op = MoonOp::Sw, .rs = 14, .rt = valueReg, .imm = fit->second });
             return;
         }
 
         auto git = m_globalLabels.find(name);
         if (git != m_globalLabels.end()) {
-            emit(std::format("         sw     {}(r0),r{}", git->second, valueReg));
+            emit({ .op = MoonOp::Sw, .rs = 0, .rt = valueReg, .sym = git->second });
             return;
         }
 
@@ -427,29 +601,33 @@ namespace lang
             for (auto *entry : m_currentClassNode->table) {
                 if (entry->kind == SymbolTableNode::Kind::Data && entry->name == name) {
                     int selfOff = m_currentFrame.offsets.at("__self");
-                    int selfReg = allocReg();
-                    emit(std::format("         lw     r{},{}(r14)   % load self", selfReg, selfOff));
-                    emit(std::format("         sw     {}(r{}),r{}", memberOffset(m_currentClassNode, name), selfReg, valueReg));
-                    freeReg(selfReg);
+                    Reg selfReg = newReg();
+                    emit({ .op = MoonOp::Lw, .rd = selfReg, .rs = 14, .imm = selfOff, .comment = "load self" });
+                    emit({ .op = MoonOp::Sw, .rs = selfReg, .rt = valueReg, .imm = memberOffset(m_currentClassNode, name) });
                     return;
                 }
             }
         }
     }
 
-    int CodeGenerator::addrOfVar(const std::string &name)
+    Reg CodeGenerator::addrOfVar(const std::string &name)
     {
-        int r = allocReg();
+        Reg r = newReg();
 
         auto fit = m_currentFrame.offsets.find(name);
         if (fit != m_currentFrame.offsets.end()) {
-            emit(std::format("         addi   r{},r14,{}", r, fit->second));
+            // A variable kept in a register gets its slot refreshed before anything reads it through the address
+            if (auto vit = m_varRegs.find(name); vit != m_varRegs.end())
+                emit({ .op = MoonOp::Sw, .rs = 14, .rt = vit->second, .imm = fit->second });
+            emit({ .op = MoonOp::Addi, .rd = r, .rs = 14, .imm = fit->second });
             return r;
         }
 
         auto git = m_globalLabels.find(name);
         if (git != m_globalLabels.end()) {
-            emit(std::format("         addi   r{},r0,{}", r, git->second));
+            if (auto vit = m_varRegs.find(name); vit != m_varRegs.end())
+                emit({ .op = MoonOp::Sw, .rs = 0, .rt = vit->second, .sym = git->second });
+            emit({ .op = MoonOp::Addi, .rd = r, .rs = 0, .sym = git->second });
             return r;
         }
 
@@ -457,124 +635,98 @@ namespace lang
             for (auto *entry : m_currentClassNode->table) {
                 if (entry->kind == SymbolTableNode::Kind::Data && entry->name == name) {
                     int selfOff = m_currentFrame.offsets.at("__self");
-                    emit(std::format("         lw     r{},{}(r14)   % load self", r, selfOff));
+                    emit({ .op = MoonOp::Lw, .rd = r, .rs = 14, .imm = selfOff, .comment = "load self" });
                     int off = memberOffset(m_currentClassNode, name);
-                    if (off != 0)
-                        emit(std::format("         addi   r{},r{},{}", r, r, off));
-                    return r;
+                    if (off == 0)
+                        return r;
+                    Reg addr = newReg();
+                    emit({ .op = MoonOp::Addi, .rd = addr, .rs = r, .imm = off });
+                    return addr;
                 }
             }
         }
 
-        emit(std::format("         add    r{},r0,r0   % addr of '{}' not found", r, name));
+        emit({ .op = MoonOp::Add, .rd = r, .rs = 0, .rt = 0, .comment = std::format("addr of '{}' not found", name) });
         return r;
     }
 
-    std::string CodeGenerator::generate()
+    OutputBuffer CodeGenerator::generate()
     {
-        m_freeRegs.clear();
-        for (int i = 12; i >= 1; --i) m_freeRegs.push_back(i);
-        m_code.str("");
-        m_data.str("");
+        m_code.clear();
+        m_data.clear();
+        m_ir.clear();
         m_labelCounter = 0;
 
         generateProg(m_ast);
+        if (m_dumpIR) {
+            m_passes.printStats(m_ir);
+            m_peephole.printStats(m_ir);
+        }
 
-        std::ostringstream out;
-        out << m_code.str() << "\n";
+        OutputBuffer out;
+        out.splice(std::move(m_code));
+        out.append("\n");
 
-        out << "         align\n";
-        out << m_data.str();
-        out << "         align\n\n";
+        out.append("         align\n");
+        out.splice(std::move(m_data));
+        out.append("         align\n\n");
 
         appendIOHelpers(out);
 
-        return out.str();
+        return out;
     }
 
-    void CodeGenerator::generateProg(std::shared_ptr<const ASTNode> prog)
+    void CodeGenerator::generateProg(const ASTNode *prog)
     {
         if (!prog || prog->children.size() < 3)
             return;
 
-        const SymbolTableNode *mainNode = nullptr;
-        for (auto *entry : m_globalTable->table) {
-            if (entry->kind == SymbolTableNode::Kind::Function && entry->name == "main") {
-                mainNode = entry;
-                break;
-            }
-        }
+        auto mains = m_freeFunctionsByName.find("main");
+        const SymbolTableNode *mainNode = mains != m_freeFunctionsByName.end() ? mains->second.front() : nullptr;
 
         if (mainNode)
             m_globalLabels = allocateGlobals(mainNode);
-
-        emit("         align");
-        emit("         entry");
-        emit("         addi   r14,r0,topaddr   % initialize stack pointer");
-        emit("");
+        findGlobalsUsedElsewhere(prog->children[1]);
 
         m_currentFuncNode = mainNode;
         m_currentClassNode = nullptr;
         m_currentFrame = {};
+
+        // -4(r14) stays the link slot even in main, so spills and saved registers start below it as in any other frame
+        beginFunction(4);
+        emitText("         align");
+        emitText("         entry");
+        emit({ .op = MoonOp::Addi, .rd = 14, .rs = 0, .sym = "topaddr", .comment = "initialize stack pointer" });
+        emitText("");
+        promoteVariables(mainNode);
+
         generateStatBlock(prog->children[2]);
 
-        emit("         hlt");
-        emit("");
+        emit({ .op = MoonOp::Hlt });
+        emitText("");
+        finishFunction();
 
         for (auto &funcDef : prog->children[1]->children) {
             generateFuncDef(funcDef);
         }
     }
 
-    void CodeGenerator::generateFuncDef(std::shared_ptr<const ASTNode> funcDef)
+    void CodeGenerator::generateFuncDef(const ASTNode *funcDef)
     {
         if (!funcDef || funcDef->children.size() < 4)
             return;
 
-        auto &nameNode = funcDef->children[1];
         auto &statBlock = funcDef->children[3];
 
-        const SymbolTableNode *funcSym = nullptr;
         const SymbolTableNode *classSym = nullptr;
-        bool isMember = (nameNode->kind == ASTNode::Kind::MemberAccess);
-
-        if (isMember) {
-            std::string className = nameNode->children[0]->lexeme;
-            std::string funcName = nameNode->children[1]->lexeme;
-            classSym = findClass(className);
-            if (classSym)
-                funcSym = findMethod(classSym, funcName);
-        } else {
-            auto &paramListNode = funcDef->children[2];
-            std::vector<std::string> defParams;
-            for (auto &param : paramListNode->children) {
-                if (param->kind == ASTNode::Kind::VarDecl && param->children.size() >= 3) {
-                    std::string raw = param->children[0]->lexeme;
-                    std::string lower = raw;
-                    for (char &c : lower) c = (char)std::tolower((unsigned char)c);
-                    std::string t = (lower == "integer") ? "int" : raw;
-                    for (auto &dim : param->children[2]->children) t += "[" + dim->lexeme + "]";
-                    defParams.push_back(t);
-                }
-            }
-            for (auto *entry : m_globalTable->table) {
-                if (entry->kind == SymbolTableNode::Kind::Function && entry->name == nameNode->lexeme && entry->signature.params == defParams) {
-                    funcSym = entry;
-                    break;
-                }
-            }
-            if (!funcSym)
-                funcSym = findFreeFunction(nameNode->lexeme);
-        }
+        const SymbolTableNode *funcSym = definedFunction(funcDef, classSym);
+        bool isMember = (funcDef->children[1]->kind == ASTNode::Kind::MemberAccess);
 
         if (!funcSym)
             return;
 
         std::string label = functionLabel(funcSym, classSym);
-        FrameInfo frame = computeFrameInfo(funcSym, isMember);
-
-        emit(std::format("% ---- function: {} ----", label));
-        emit(lpad(label) + "sw     -4(r14),r15   % save link register");
+        const FrameInfo &frame = frameInfo(funcSym, isMember);
 
         FrameInfo savedFrame = m_currentFrame;
         const SymbolTableNode *savedFunc = m_currentFuncNode;
@@ -584,31 +736,91 @@ namespace lang
         m_currentFuncNode = funcSym;
         m_currentClassNode = classSym;
 
+        beginFunction(frame.frame_size);
+        emitText(std::format("% ---- function: {} ----", label));
+        emit({ .op = MoonOp::Sw, .rs = 14, .rt = 15, .imm = -4, .label = label, .comment = "save link register" });
+        promoteVariables(funcSym);
+
         generateStatBlock(statBlock);
 
-        emit(std::format("         lw     r15,-4(r14)   % restore link register"));
-        emit(std::format("         jr     r15"));
-        emit("");
+        emit({ .op = MoonOp::Lw, .rd = 15, .rs = 14, .imm = -4, .comment = "restore link register" });
+        emit({ .op = MoonOp::Jr, .rs = 15 });
+        emitText("");
+        finishFunction();
 
         m_currentFrame = savedFrame;
         m_currentFuncNode = savedFunc;
         m_currentClassNode = savedClass;
     }
 
-    void CodeGenerator::generateStatBlock(std::shared_ptr<const ASTNode> node)
+    // Statements are generated with an explicit stack. Blocks and statements alternate down the walk; an if or while emits
+    // its head on entry, its else label once the then-block is done, and its closing jump and label when it is left.
+    void CodeGenerator::generateStatBlock(const ASTNode *node)
     {
-        if (!node)
-            return;
-        for (auto &child : node->children) {
-            if (!child)
-                continue;
-            if (child->kind == ASTNode::Kind::VarDecl)
-                continue;
-            generateStatement(child);
-        }
+        struct OpenBranch {
+            const ASTNode *stat;
+            BranchLabels labels;
+            std::size_t blocksDone = 0;
+        };
+
+        struct {
+            CodeGenerator &gen;
+            std::size_t depth = 0;
+            std::vector<OpenBranch> open;
+
+            bool enter(const ASTNode *n)
+            {
+                const bool isBlock = depth++ % 2 == 0;
+                if (!n)
+                    return false;
+                if (isBlock)
+                    return true;
+
+                switch (n->kind) {
+                    case ASTNode::Kind::IfStat:
+                        if (n->children.size() < 3)
+                            return false;
+                        open.push_back({ n, gen.beginIfStat(n) });
+                        return true;
+                    case ASTNode::Kind::WhileStat:
+                        if (n->children.size() < 2)
+                            return false;
+                        open.push_back({ n, gen.beginWhileStat(n) });
+                        return true;
+                    case ASTNode::Kind::VarDecl:
+                        return false;
+                    default:
+                        gen.generateStatement(n);
+                        return false;
+                }
+            }
+
+            ChildSpan children(const ASTNode *n) const { return (depth - 1) % 2 == 0 ? ChildSpan(n->children) : NestedStatBlocks(n); }
+
+            void leave(const ASTNode *n)
+            {
+                const bool isBlock = --depth % 2 == 0;
+                if (open.empty())
+                    return;
+                OpenBranch &branch = open.back();
+                if (isBlock) {
+                    if (++branch.blocksDone == 1 && branch.stat->kind == ASTNode::Kind::IfStat)
+                        gen.beginElse(branch.labels);
+                    return;
+                }
+                if (branch.stat != n)
+                    return;
+                if (n->kind == ASTNode::Kind::IfStat)
+                    gen.endIfStat(branch.labels);
+                else
+                    gen.endWhileStat(n, branch.labels);
+                open.pop_back();
+            }
+        } visitor{ *this };
+        WalkAST(node, visitor);
     }
 
-    void CodeGenerator::generateStatement(std::shared_ptr<const ASTNode> node)
+    void CodeGenerator::generateStatement(const ASTNode *node)
     {
         if (!node)
             return;
@@ -616,12 +828,6 @@ namespace lang
             case ASTNode::Kind::AssignStat:
                 generateAssignStat(node);
                 break;
-            case ASTNode::Kind::IfStat:
-                generateIfStat(node);
-                break;
-            case ASTNode::Kind::WhileStat:
-                generateWhileStat(node);
-                break;
             case ASTNode::Kind::PutStat:
                 generatePutStat(node);
                 break;
@@ -632,17 +838,14 @@ namespace lang
                 generateReturnStat(node);
                 break;
             case ASTNode::Kind::FuncCall:
-                {
-                    int r = generateFuncCallExpr(node);
-                    freeReg(r);
-                }
+                generateExpr(node);
                 break;
             default:
                 break;
         }
     }
 
-    void CodeGenerator::generateAssignStat(std::shared_ptr<const ASTNode> node)
+    void CodeGenerator::generateAssignStat(const ASTNode *node)
     {
         if (!node || node->children.size() < 2)
             return;
@@ -650,424 +853,557 @@ namespace lang
         auto &lhs = node->children[0];
         auto &rhs = node->children[1];
 
-        int rhsReg = generateExpr(rhs);
+        Reg rhsReg = generateExpr(rhs);
 
         if (isFloatExpr(lhs) && !isFloatExpr(rhs)) {
-            emit(std::format("         muli   r{},r{},100   % promote int rhs to float x100", rhsReg, rhsReg));
+            rhsReg = promoteToFloat(rhsReg, "promote int rhs to float x100");
         }
 
         if (lhs->kind == ASTNode::Kind::Id) {
             storeVar(lhs->lexeme, rhsReg);
         } else {
-            int addrReg = generateLValue(lhs);
-            emit(std::format("         sw     0(r{}),r{}", addrReg, rhsReg));
-            freeReg(addrReg);
+            Reg addrReg = generateLValue(lhs);
+            emit({ .op = MoonOp::Sw, .rs = addrReg, .rt = rhsReg, .imm = 0 });
         }
-        freeReg(rhsReg);
     }
 
-    void CodeGenerator::generateIfStat(std::shared_ptr<const ASTNode> node)
+    CodeGenerator::BranchLabels CodeGenerator::beginIfStat(const ASTNode *node)
     {
-        if (!node || node->children.size() < 3)
-            return;
+        BranchLabels labels{ newLabel("else"), newLabel("endif") };
 
-        std::string elseLabel = newLabel("else");
-        std::string endLabel = newLabel("endif");
+        generateCondition(node->children[0], false, labels.head);
+        return labels;
+    }
 
-        int condReg = generateExpr(node->children[0]);
-        emit(std::format("         bz     r{},{}   % if false → else", condReg, elseLabel));
-        freeReg(condReg);
+    void CodeGenerator::beginElse(const BranchLabels &labels)
+    {
+        emit({ .op = MoonOp::J, .sym = labels.end });
+
+        emitLabel(labels.head, "else");
+    }
 
-        generateStatBlock(node->children[1]);
-        emit(std::format("         j      {}", endLabel));
+    void CodeGenerator::endIfStat(const BranchLabels &labels)
+    {
+        emitLabel(labels.end, "endif");
+    }
 
-        emit(lpad(elseLabel) + "add    r0,r0,r0   % else");
-        generateStatBlock(node->children[2]);
+    // The condition is tested after the body, so an iteration ends in a single branch back instead of a jump to a test
+    // that branches out.
+    CodeGenerator::BranchLabels CodeGenerator::beginWhileStat(const ASTNode * /*node*/)
+    {
+        BranchLabels labels{ newLabel("while"), newLabel("whilecond") };
 
-        emit(lpad(endLabel) + "add    r0,r0,r0   % endif");
+        emit({ .op = MoonOp::J, .sym = labels.end, .comment = "while → condition" });
+        emitLabel(labels.head, "while loop body");
+        return labels;
     }
 
-    void CodeGenerator::generateWhileStat(std::shared_ptr<const ASTNode> node)
+    void CodeGenerator::endWhileStat(const ASTNode *node, const BranchLabels &labels)
     {
-        if (!node || node->children.size() < 2)
-            return;
+        emitLabel(labels.end, "while condition");
+        generateCondition(node->children[0], true, labels.head);
+    }
 
-        std::string loopLabel = newLabel("while");
-        std::string endLabel = newLabel("endwhile");
+    static bool IsLogicalOp(const ASTNode *node)
+    {
+        return node->children.size() >= 2 && ((node->kind == ASTNode::Kind::MultOp && node->lexeme == "and") ||
+                                               (node->kind == ASTNode::Kind::AddOp && node->lexeme == "or"));
+    }
 
-        emit(lpad(loopLabel) + "add    r0,r0,r0   % while loop start");
+    // Branches to `target` when the condition is `whenTrue` and falls through otherwise. A comparison branches on its own
+    // result, `not` flips the sense, and the right operand of `and`/`or` only runs when the left one leaves the outcome
+    // open. Work is kept on an explicit stack, in the order the code is emitted.
+    void CodeGenerator::generateCondition(const ASTNode *node, bool whenTrue, const std::string &target)
+    {
+        struct Pending {
+            const ASTNode *node; // null for a label to place
+            bool whenTrue;
+            std::string label;
+        };
+
+        std::vector<Pending> pending{ { node, whenTrue, target } };
+        while (!pending.empty()) {
+            Pending item = std::move(pending.back());
+            pending.pop_back();
+
+            const ASTNode *n = item.node;
+            if (!n) {
+                emitLabel(std::move(item.label), "condition decided");
+                continue;
+            }
 
-        int condReg = generateExpr(node->children[0]);
-        emit(std::format("         bz     r{},{}   % while false → end", condReg, endLabel));
-        freeReg(condReg);
+            if (n->kind == ASTNode::Kind::NotExpr && !n->children.empty()) {
+                pending.push_back({ n->children[0], !item.whenTrue, std::move(item.label) });
+                continue;
+            }
 
-        generateStatBlock(node->children[1]);
-        emit(std::format("         j      {}", loopLabel));
+            if (IsLogicalOp(n)) {
+                const bool isOr = n->lexeme == "or";
+                // `a and b` is false, and `a or b` true, as soon as `a` is: both operands then branch to the target.
+                // Otherwise `a` deciding the other way skips `b`.
+                if (isOr == item.whenTrue) {
+                    pending.push_back({ n->children[1], item.whenTrue, item.label });
+                    pending.push_back({ n->children[0], item.whenTrue, std::move(item.label) });
+                } else {
+                    std::string skip = newLabel(n->lexeme);
+                    pending.push_back({ nullptr, false, skip });
+                    pending.push_back({ n->children[1], item.whenTrue, std::move(item.label) });
+                    pending.push_back({ n->children[0], !item.whenTrue, std::move(skip) });
+                }
+                continue;
+            }
 
-        emit(lpad(endLabel) + "add    r0,r0,r0   % end while");
+            Reg condReg = generateExpr(n);
+            emit({ .op = item.whenTrue ? MoonOp::Bnz : MoonOp::Bz, .rs = condReg, .sym = std::move(item.label) });
+        }
     }
 
-    void CodeGenerator::generatePutStat(std::shared_ptr<const ASTNode> node)
+    // `and`/`or` used as a value branch like a condition and leave 1 or 0, so the right operand is skipped there too.
+    Reg CodeGenerator::generateLogicalValue(const ASTNode *node)
+    {
+        Reg res = newReg();
+        std::string falseLabel = newLabel(node->lexeme + "false");
+        std::string endLabel = newLabel(node->lexeme + "end");
+
+        generateCondition(node, false, falseLabel);
+        emit({ .op = MoonOp::Addi, .rd = res, .rs = 0, .imm = 1, .comment = std::format("{}: true", node->lexeme) });
+        emit({ .op = MoonOp::J, .sym = endLabel });
+        emitLabel(std::move(falseLabel), std::format("{} is false", node->lexeme));
+        emit({ .op = MoonOp::Addi, .rd = res, .rs = 0, .imm = 0, .comment = std::format("{}: false", node->lexeme) });
+        emitLabel(std::move(endLabel), std::format("{} decided", node->lexeme));
+        return res;
+    }
+
+    void CodeGenerator::generatePutStat(const ASTNode *node)
     {
         if (!node || node->children.empty())
             return;
 
         bool isFloat = isFloatExpr(node->children[0]);
-        int valReg = generateExpr(node->children[0]);
-        if (valReg != 1) {
-            emit(std::format("         add    r1,r{},r0   % move to r1 for put", valReg));
-            freeReg(valReg);
-        }
+        Reg valReg = generateExpr(node->children[0]);
 
-        if (isFloat) {
-            emit("         jl     r15,putfloat   % write float");
-        } else {
-            emit("         jl     r15,putint   % write integer");
-        }
-        if (valReg == 1)
-            freeReg(1);
+        CallSite call{ .target = isFloat ? "putfloat" : "putint", .comment = isFloat ? "write float" : "write integer", .helper = true };
+        call.args.push_back({ valReg, 0, "move to r1 for put" });
+        emitCall(std::move(call), NO_REG);
 
-        emit("         addi   r1,r0,10");
-        emit("         putc   r1           % newline");
+        Reg newline = newReg();
+        emit({ .op = MoonOp::Addi, .rd = newline, .rs = 0, .imm = 10 });
+        emit({ .op = MoonOp::Putc, .rs = newline, .comment = "newline" });
     }
 
-    void CodeGenerator::generateReadStat(std::shared_ptr<const ASTNode> node)
+    void CodeGenerator::generateReadStat(const ASTNode *node)
     {
         if (!node || node->children.empty())
             return;
 
         auto &var = node->children[0];
         bool targetIsFloat = isFloatExpr(var);
-        if (targetIsFloat) {
-            emit("         jl     r15,getfloat   % read float → r1 (already ×100)");
-        } else {
-            emit("         jl     r15,getint   % read integer → r1");
-        }
+        CallSite call{
+            .target = targetIsFloat ? "getfloat" : "getint",
+            .comment = targetIsFloat ? "read float → r1 (already ×100)" : "read integer → r1",
+            .helper = true,
+        };
 
         if (var->kind == ASTNode::Kind::Id) {
+            if (auto vit = m_varRegs.find(var->lexeme); vit != m_varRegs.end()) {
+                emitCall(std::move(call), vit->second);
+                return;
+            }
+
             auto fit = m_currentFrame.offsets.find(var->lexeme);
-            if (fit != m_currentFrame.offsets.end()) {
-                emit(std::format("         sw     {}(r14),r1   % store read result", fit->second));
-            } else {
-                auto git = m_globalLabels.find(var->lexeme);
-                if (git != m_globalLabels.end()) {
-                    emit(std::format("         sw     {}(r0),r1   % store read result", git->second));
-                }
+            auto git = m_globalLabels.find(var->lexeme);
+            if (fit == m_currentFrame.offsets.end() && git == m_globalLabels.end()) {
+                emitCall(std::move(call), NO_REG);
+                return;
             }
+
+            Reg valReg = newReg();
+            emitCall(std::move(call), valReg);
+            if (fit != m_currentFrame.offsets.end())
+                emit({ .op = MoonOp::Sw, .rs = 14, .rt = valReg, .imm = fit->second, .comment = "store read result" });
+            else
+                emit({ .op = MoonOp::Sw, .rs = 0, .rt = valReg, .sym = git->second, .comment = "store read result" });
         } else {
-            int addrReg = allocReg();
-            emit(std::format("         add    r{},r1,r0   % save getint result", addrReg));
-            int addr2 = generateLValue(var);
-            emit(std::format("         sw     0(r{}),r{}", addr2, addrReg));
-            freeReg(addr2);
-            freeReg(addrReg);
+            Reg valReg = newReg();
+            emitCall(std::move(call), valReg);
+            Reg addrReg = generateLValue(var);
+            emit({ .op = MoonOp::Sw, .rs = addrReg, .rt = valReg, .imm = 0 });
         }
     }
 
-    void CodeGenerator::generateReturnStat(std::shared_ptr<const ASTNode> node)
+    void CodeGenerator::generateReturnStat(const ASTNode *node)
     {
         if (!node || node->children.empty()) {
-            emit("         add    r13,r0,r0   % return void");
+            emit({ .op = MoonOp::Add, .rd = 13, .rs = 0, .rt = 0, .comment = "return void" });
         } else {
-            int valReg = generateExpr(node->children[0]);
+            Reg valReg = generateExpr(node->children[0]);
             bool funcReturnsFloat = m_currentFuncNode && m_currentFuncNode->signature.type == "float";
             bool exprIsFloat = isFloatExpr(node->children[0]);
             if (funcReturnsFloat && !exprIsFloat) {
-                emit(std::format("         muli   r{},r{},100   % promote int return to float x100", valReg, valReg));
+                valReg = promoteToFloat(valReg, "promote int return to float x100");
             }
-            emit(std::format("         add    r13,r{},r0   % set return value", valReg));
-            freeReg(valReg);
+            emit({ .op = MoonOp::Add, .rd = 13, .rs = valReg, .rt = 0, .comment = "set return value" });
         }
-        emit("         lw     r15,-4(r14)   % restore link");
-        emit("         jr     r15           % return");
+        emit({ .op = MoonOp::Lw, .rd = 15, .rs = 14, .imm = -4, .comment = "restore link" });
+        emit({ .op = MoonOp::Jr, .rs = 15, .comment = "return" });
     }
 
-    int CodeGenerator::generateExpr(std::shared_ptr<const ASTNode> node)
+    // Which role the walk gives a node below the root, from where it sits in its parent
+    CodeGenerator::ExprRole CodeGenerator::operandRole(const ASTNode *node) const
     {
-        if (!node) {
-            int r = allocReg();
-            emit(std::format("         add    r{},r0,r0   % null expr", r));
-            return r;
+        const ASTNode *parent = node ? node->parent : nullptr;
+        if (!parent)
+            return ExprRole::Value;
+        switch (parent->kind) {
+            case ASTNode::Kind::IndexedVar:
+            case ASTNode::Kind::MemberAccess:
+                return node == parent->children.front() ? ExprRole::Address : ExprRole::Value;
+            case ASTNode::Kind::FuncCall:
+                return ExprRole::Operands;
+            case ASTNode::Kind::ParamList:
+                {
+                    const SymbolTableNode *classSym = nullptr;
+                    const SymbolTableNode *funcSym = parent->parent ? calledFunction(parent->parent, classSym) : nullptr;
+                    if (!funcSym)
+                        return ExprRole::Value;
+                    auto position = std::ranges::find(parent->children, node) - parent->children.begin();
+                    for (auto *entry : funcSym->table) {
+                        if (entry->kind != SymbolTableNode::Kind::Parameter || position-- > 0)
+                            continue;
+                        return entry->signature.typeId && entry->signature.typeId->isArray() ? ExprRole::Address : ExprRole::Value;
+                    }
+                    return ExprRole::Value;
+                }
+            default:
+                return ExprRole::Value;
+        }
+    }
+
+    // Operands a node evaluates, in emission order, before it is generated itself: an operator's operands, a call's
+    // receiver address and arguments, an array's base address and index, and a member access's object address.
+    ChildSpan CodeGenerator::exprOperands(const ASTNode *node, ExprRole role) const
+    {
+        const ChildSpan children(node->children);
+        if (role == ExprRole::Operands)
+            return node->kind == ASTNode::Kind::MemberAccess ? children.first(std::min<std::size_t>(children.size(), 1)) : children;
+
+        switch (node->kind) {
+            case ASTNode::Kind::IndexedVar:
+                if (children.size() < 2 || !children[0])
+                    return {};
+                return children[0]->kind == ASTNode::Kind::Id ? children.subspan(1, 1) : children.first(2);
+            case ASTNode::Kind::MemberAccess:
+                return children.size() >= 2 ? children.first(1) : ChildSpan();
+            default:
+                break;
+        }
+        if (role == ExprRole::Address)
+            return {};
+
+        switch (node->kind) {
+            case ASTNode::Kind::AddOp:
+            case ASTNode::Kind::MultOp:
+                if (IsLogicalOp(node))
+                    return {};
+                return children.size() >= 2 ? children.first(2) : ChildSpan();
+            case ASTNode::Kind::RelOp:
+                return children.size() >= 2 ? children.first(2) : ChildSpan();
+            case ASTNode::Kind::NotExpr:
+            case ASTNode::Kind::SignExpr:
+                return children.first(children.empty() ? 0 : 1);
+            case ASTNode::Kind::FuncCall:
+                {
+                    const SymbolTableNode *classSym = nullptr;
+                    if (!calledFunction(node, classSym))
+                        return {};
+                    return children[0]->kind == ASTNode::Kind::MemberAccess ? children.first(2) : children.subspan(1, 1);
+                }
+            default:
+                return {};
         }
+    }
+
+    Reg CodeGenerator::generateExpr(const ASTNode *node)
+    {
+        if (!node)
+            return zeroReg("null expr");
+        return evaluateExpr(node, ExprRole::Value).reg;
+    }
+
+    Reg CodeGenerator::generateLValue(const ASTNode *node)
+    {
+        return evaluateExpr(node, ExprRole::Address).reg;
+    }
+
+    // Expressions are evaluated bottom-up on an explicit stack: every finished subexpression leaves its register on
+    // `values`, and a node takes the values its operands left when the walk leaves it. Nodes that only group operands
+    // leave those values for their parent.
+    CodeGenerator::ExprValue CodeGenerator::evaluateExpr(const ASTNode *node, ExprRole role)
+    {
+        struct Frame {
+            std::size_t firstValue;
+            ExprRole role;
+        };
+
+        struct {
+            CodeGenerator &gen;
+            const ASTNode *root;
+            ExprRole rootRole;
+            std::vector<ExprValue> values;
+            std::vector<Frame> frames;
+
+            bool enter(const ASTNode *n)
+            {
+                const ExprRole r = n == root ? rootRole : gen.operandRole(n);
+                frames.push_back({ values.size(), r });
+                return n && !gen.exprOperands(n, r).empty();
+            }
+
+            ChildSpan children(const ASTNode *n) const { return gen.exprOperands(n, frames.back().role); }
+
+            void leave(const ASTNode *n)
+            {
+                const Frame frame = frames.back();
+                frames.pop_back();
+                if (frame.role == ExprRole::Operands)
+                    return;
+                const std::span<const ExprValue> operands = std::span<const ExprValue>(values).subspan(frame.firstValue);
+                const ExprValue result = frame.role == ExprRole::Address ? ExprValue{ gen.generateAddress(n, operands), false }
+                                                                         : gen.generateExprNode(n, operands);
+                values.resize(frame.firstValue);
+                values.push_back(result);
+            }
+        } visitor{ *this, node, role, {}, {} };
+        WalkAST(node, visitor);
+        return visitor.values.back();
+    }
+
+    CodeGenerator::ExprValue CodeGenerator::generateExprNode(const ASTNode *node, std::span<const ExprValue> operands)
+    {
+        if (!node)
+            return { generateExpr(nullptr), false };
         switch (node->kind) {
             case ASTNode::Kind::AddOp:
-                return generateBinaryOp(node, "");
             case ASTNode::Kind::MultOp:
-                return generateBinaryOp(node, "");
+                if (IsLogicalOp(node))
+                    return { generateLogicalValue(node), isFloatExpr(node) };
+                if (operands.size() < 2)
+                    return { zeroReg(), false };
+                return { generateBinaryOp(node, operands[0], operands[1]), operands[0].isFloat || operands[1].isFloat };
             case ASTNode::Kind::RelOp:
-                return generateRelOp(node);
+                if (operands.size() < 2)
+                    return { zeroReg(), false };
+                return { generateRelOp(node, operands[0], operands[1]), false };
             case ASTNode::Kind::NotExpr:
-                return generateNotExpr(node);
+                return { generateNotExpr(node, operands.empty() ? ExprValue{ generateExpr(nullptr), false } : operands[0]), false };
             case ASTNode::Kind::SignExpr:
-                return generateSignExpr(node);
+                {
+                    const ExprValue operand = operands.empty() ? ExprValue{ generateExpr(nullptr), false } : operands[0];
+                    return { generateSignExpr(node, operand), operand.isFloat };
+                }
             case ASTNode::Kind::Num:
-                return generateNum(node);
+                return { generateNum(node), isFloatExpr(node) };
             case ASTNode::Kind::Id:
-                return generateIdExpr(node);
+                return { generateIdExpr(node), isFloatExpr(node) };
             case ASTNode::Kind::FuncCall:
-                return generateFuncCallExpr(node);
+                return { generateFuncCallExpr(node, operands), isFloatExpr(node) };
             case ASTNode::Kind::IndexedVar:
-                return generateIndexedVarExpr(node);
+                return { generateIndexedVarExpr(node, operands), isFloatExpr(node) };
             case ASTNode::Kind::MemberAccess:
-                return generateMemberAccessExpr(node);
+                return { generateMemberAccessExpr(node, operands), isFloatExpr(node) };
             default:
-                {
-                    int r = allocReg();
-                    emit(std::format("         add    r{},r0,r0   % unknown expr", r));
-                    return r;
-                }
+                return { zeroReg("unknown expr"), false };
         }
     }
 
-    int CodeGenerator::generateBinaryOp(std::shared_ptr<const ASTNode> node, const std::string & /*unused*/)
+    // Operand registers may hold a variable kept in a register, so they are only read; conversions go to new registers.
+    Reg CodeGenerator::generateBinaryOp(const ASTNode *node, ExprValue lhs, ExprValue rhs)
     {
-        if (!node || node->children.size() < 2) {
-            int r = allocReg();
-            emit(std::format("         add    r{},r0,r0", r));
-            return r;
-        }
-
-        bool leftIsFloat = isFloatExpr(node->children[0]);
-        bool rightIsFloat = isFloatExpr(node->children[1]);
+        bool leftIsFloat = lhs.isFloat;
+        bool rightIsFloat = rhs.isFloat;
         bool floatCtx = leftIsFloat || rightIsFloat;
 
-        int lReg = generateExpr(node->children[0]);
-        int rReg = generateExpr(node->children[1]);
+        Reg lReg = lhs.reg;
+        Reg rReg = rhs.reg;
 
         if (floatCtx && !leftIsFloat) {
-            emit(std::format("         muli   r{},r{},100   % promote int lhs to float x100", lReg, lReg));
+            lReg = promoteToFloat(lReg, "promote int lhs to float x100");
         }
         if (floatCtx && !rightIsFloat) {
-            emit(std::format("         muli   r{},r{},100   % promote int rhs to float x100", rReg, rReg));
+            rReg = promoteToFloat(rReg, "promote int rhs to float x100");
         }
 
-        int res = allocReg();
+        Reg res = newReg();
 
         const std::string &op = node->lexeme;
         if (op == "+") {
-            emit(std::format("         add    r{},r{},r{}", res, lReg, rReg));
+            emit({ .op = MoonOp::Add, .rd = res, .rs = lReg, .rt = rReg });
         } else if (op == "-") {
-            emit(std::format("         sub    r{},r{},r{}", res, lReg, rReg));
-        } else if (op == "or") {
-            emit(std::format("         cnei   r{},r{},0   % normalize lhs to bool", lReg, lReg));
-            emit(std::format("         cnei   r{},r{},0   % normalize rhs to bool", rReg, rReg));
-            emit(std::format("         add    r{},r{},r{}", res, lReg, rReg));
-            emit(std::format("         cnei   r{},r{},0   % or: 1 if either non-zero", res, res));
+            emit({ .op = MoonOp::Sub, .rd = res, .rs = lReg, .rt = rReg });
         } else if (op == "*") {
-            emit(std::format("         mul    r{},r{},r{}", res, lReg, rReg));
             if (floatCtx) {
-                emit(std::format("         divi   r{},r{},100   % post-scale for float mul", res, res));
+                Reg product = newReg();
+                emit({ .op = MoonOp::Mul, .rd = product, .rs = lReg, .rt = rReg });
+                emit({ .op = MoonOp::Divi, .rd = res, .rs = product, .imm = 100, .comment = "post-scale for float mul" });
+            } else {
+                emit({ .op = MoonOp::Mul, .rd = res, .rs = lReg, .rt = rReg });
             }
         } else if (op == "/") {
             if (floatCtx) {
-                emit(std::format("         muli   r{},r{},100   % pre-scale for float div", lReg, lReg));
+                lReg = promoteToFloat(lReg, "pre-scale for float div");
             }
-            emit(std::format("         div    r{},r{},r{}", res, lReg, rReg));
-        } else if (op == "and") {
-            emit(std::format("         cnei   r{},r{},0   % normalize lhs to bool", lReg, lReg));
-            emit(std::format("         cnei   r{},r{},0   % normalize rhs to bool", rReg, rReg));
-            emit(std::format("         mul    r{},r{},r{}", res, lReg, rReg));
+            emit({ .op = MoonOp::Div, .rd = res, .rs = lReg, .rt = rReg });
         } else {
-            emit(std::format("         add    r{},r{},r{}", res, lReg, rReg));
+            emit({ .op = MoonOp::Add, .rd = res, .rs = lReg, .rt = rReg });
         }
 
-        freeReg(lReg);
-        freeReg(rReg);
         return res;
     }
 
-    int CodeGenerator::generateRelOp(std::shared_ptr<const ASTNode> node)
+    Reg CodeGenerator::generateRelOp(const ASTNode *node, ExprValue lhs, ExprValue rhs)
     {
-        if (!node || node->children.size() < 2) {
-            int r = allocReg();
-            emit(std::format("         add    r{},r0,r0", r));
-            return r;
-        }
-
-        bool leftIsFloat = isFloatExpr(node->children[0]);
-        bool rightIsFloat = isFloatExpr(node->children[1]);
+        bool leftIsFloat = lhs.isFloat;
+        bool rightIsFloat = rhs.isFloat;
         bool floatCtx = leftIsFloat || rightIsFloat;
 
-        int lReg = generateExpr(node->children[0]);
-        int rReg = generateExpr(node->children[1]);
+        Reg lReg = lhs.reg;
+        Reg rReg = rhs.reg;
 
         if (floatCtx && !leftIsFloat) {
-            emit(std::format("         muli   r{},r{},100   % promote int lhs for float relop", lReg, lReg));
+            lReg = promoteToFloat(lReg, "promote int lhs for float relop");
         }
         if (floatCtx && !rightIsFloat) {
-            emit(std::format("         muli   r{},r{},100   % promote int rhs for float relop", rReg, rReg));
+            rReg = promoteToFloat(rReg, "promote int rhs for float relop");
         }
 
-        int res = allocReg();
+        Reg res = newReg();
 
         const std::string &op = node->lexeme;
-        if (op == "==") {
-            emit(std::format("         ceq    r{},r{},r{}", res, lReg, rReg));
-        } else if (op == "!=") {
-            emit(std::format("         cne    r{},r{},r{}", res, lReg, rReg));
+        MoonOp compare = MoonOp::Ceq;
+        if (op == "!=") {
+            compare = MoonOp::Cne;
         } else if (op == "<") {
-            emit(std::format("         clt    r{},r{},r{}", res, lReg, rReg));
+            compare = MoonOp::Clt;
         } else if (op == ">") {
-            emit(std::format("         cgt    r{},r{},r{}", res, lReg, rReg));
+            compare = MoonOp::Cgt;
         } else if (op == "<=") {
-            emit(std::format("         cle    r{},r{},r{}", res, lReg, rReg));
+            compare = MoonOp::Cle;
         } else if (op == ">=") {
-            emit(std::format("         cge    r{},r{},r{}", res, lReg, rReg));
-        } else {
-            emit(std::format("         ceq    r{},r{},r{}", res, lReg, rReg));
+            compare = MoonOp::Cge;
         }
+        emit({ .op = compare, .rd = res, .rs = lReg, .rt = rReg });
 
-        freeReg(lReg);
-        freeReg(rReg);
         return res;
     }
 
-    int CodeGenerator::generateNotExpr(std::shared_ptr<const ASTNode> node)
+    Reg CodeGenerator::generateNotExpr(const ASTNode * /*node*/, ExprValue value)
     {
-        int operand = generateExpr(node->children[0]);
-        int res = allocReg();
-        emit(std::format("         ceqi   r{},r{},0   % logical not", res, operand));
-        freeReg(operand);
+        Reg res = newReg();
+        emit({ .op = MoonOp::Ceqi, .rd = res, .rs = value.reg, .imm = 0, .comment = "logical not" });
         return res;
     }
 
-    int CodeGenerator::generateSignExpr(std::shared_ptr<const ASTNode> node)
+    Reg CodeGenerator::generateSignExpr(const ASTNode *node, ExprValue value)
     {
-        int operand = generateExpr(node->children[0]);
         if (node->lexeme == "-") {
-            int res = allocReg();
-            emit(std::format("         sub    r{},r0,r{}   % negate", res, operand));
-            freeReg(operand);
+            Reg res = newReg();
+            emit({ .op = MoonOp::Sub, .rd = res, .rs = 0, .rt = value.reg, .comment = "negate" });
             return res;
         }
-        return operand;
+        return value.reg;
     }
 
-    int CodeGenerator::generateNum(std::shared_ptr<const ASTNode> node)
+    Reg CodeGenerator::generateNum(const ASTNode *node)
     {
-        int r = allocReg();
+        Reg r = newReg();
         const std::string &lex = node->lexeme;
         if (lex.find('.') != std::string::npos) {
             long scaled = std::lround(std::stod(lex) * 100.0);
-            emit(std::format("         addi   r{},r0,{}   % float literal {} scaled x100", r, scaled, lex));
+            emit({ .op = MoonOp::Addi, .rd = r, .rs = 0, .imm = static_cast<int>(scaled), .comment = std::format("float literal {} scaled x100", lex) });
         } else {
-            emit(std::format("         addi   r{},r0,{}   % integer literal", r, lex));
+            emit({ .op = MoonOp::Addi, .rd = r, .rs = 0, .sym = lex, .comment = "integer literal" });
         }
         return r;
     }
 
-    int CodeGenerator::generateIdExpr(std::shared_ptr<const ASTNode> node)
+    Reg CodeGenerator::generateIdExpr(const ASTNode *node)
     {
         return loadVar(node->lexeme);
     }
 
-    int CodeGenerator::generateFuncCallExpr(std::shared_ptr<const ASTNode> node)
+    // Operands are the receiver's address for a method, then the arguments
+    Reg CodeGenerator::generateFuncCallExpr(const ASTNode *node, std::span<const ExprValue> operands)
     {
-        if (!node || node->children.size() < 2) {
-            int r = allocReg();
-            emit(std::format("         add    r{},r0,r0   % null func call", r));
-            return r;
-        }
+        if (!node || node->children.size() < 2 || !node->children[1])
+            return zeroReg("null func call");
 
         auto &calleeNode = node->children[0];
         auto &paramListNode = node->children[1];
+        const SymbolTableNode *classSym = nullptr;
+        const SymbolTableNode *funcSym = calledFunction(node, classSym);
 
         if (calleeNode->kind == ASTNode::Kind::Id) {
-            const SymbolTableNode *funcSym = nullptr;
-            const auto &callArgs = paramListNode->children;
-            std::vector<std::string> argTypes;
-            for (auto &arg : callArgs) argTypes.push_back(isFloatExpr(arg) ? "float" : "int");
-
-            for (auto *entry : m_globalTable->table) {
-                if (entry->kind != SymbolTableNode::Kind::Function)
-                    continue;
-                if (entry->name != calleeNode->lexeme)
-                    continue;
-                if (entry->signature.params.size() != argTypes.size())
-                    continue;
-                bool match = true;
-                for (size_t k = 0; k < argTypes.size(); k++) {
-                    std::string pbase = entry->signature.params[k];
-                    size_t br = pbase.find('[');
-                    if (br != std::string::npos)
-                        pbase = pbase.substr(0, br);
-                    if (pbase != argTypes[k] && !(pbase == "float" && argTypes[k] == "int")) {
-                        match = false;
-                        break;
-                    }
-                }
-                if (match) {
-                    funcSym = entry;
-                    break;
-                }
-            }
             if (!funcSym)
-                funcSym = findFreeFunction(calleeNode->lexeme);
-
-            if (!funcSym) {
-                int r = allocReg();
-                emit(std::format("         add    r{},r0,r0   % unknown func {}", r, calleeNode->lexeme));
-                return r;
-            }
-            return callFunction(funcSym, paramListNode->children, nullptr, -1);
+                return zeroReg(std::format("unknown func {}", calleeNode->lexeme));
+            return callFunction(funcSym, paramListNode->children, operands, nullptr, NO_REG);
         } else if (calleeNode->kind == ASTNode::Kind::MemberAccess) {
-            auto &objNode = calleeNode->children[0];
-            auto &methodNode = calleeNode->children[1];
-            std::string objType = getVarType(objNode->lexeme);
-            const SymbolTableNode *classSym = findClass(objType);
-            const SymbolTableNode *methodSym = classSym ? findMethod(classSym, methodNode->lexeme) : nullptr;
-            if (!methodSym) {
-                int r = allocReg();
-                emit(std::format("         add    r{},r0,r0   % unknown method", r));
-                return r;
-            }
-            int selfReg = generateLValue(objNode);
-            int result = callFunction(methodSym, paramListNode->children, classSym, selfReg);
-            freeReg(selfReg);
-            return result;
+            if (!funcSym || operands.empty())
+                return zeroReg("unknown method");
+            return callFunction(funcSym, paramListNode->children, operands.subspan(1), classSym, operands[0].reg);
         }
 
-        int r = allocReg();
-        emit(std::format("         add    r{},r0,r0   % unhandled call node kind", r));
-        return r;
+        return zeroReg("unhandled call node kind");
     }
 
-    int CodeGenerator::generateIndexedVarExpr(std::shared_ptr<const ASTNode> node)
+    Reg CodeGenerator::generateIndexedVarExpr(const ASTNode *node, std::span<const ExprValue> operands)
     {
-        int addrReg = generateIndexedVarAddr(node);
-        int valReg = allocReg();
-        emit(std::format("         lw     r{},0(r{})   % load array element", valReg, addrReg));
-        freeReg(addrReg);
+        Reg addrReg = generateIndexedVarAddr(node, operands);
+        Reg valReg = newReg();
+        emit({ .op = MoonOp::Lw, .rd = valReg, .rs = addrReg, .imm = 0, .comment = "load array element" });
         return valReg;
     }
 
-    int CodeGenerator::generateMemberAccessExpr(std::shared_ptr<const ASTNode> node)
+    Reg CodeGenerator::generateMemberAccessExpr(const ASTNode *node, std::span<const ExprValue> operands)
     {
-        int addrReg = generateMemberAccessAddr(node);
-        int valReg = allocReg();
-        emit(std::format("         lw     r{},0(r{})   % load member", valReg, addrReg));
-        freeReg(addrReg);
+        Reg addrReg = generateMemberAccessAddr(node, operands);
+        Reg valReg = newReg();
+        emit({ .op = MoonOp::Lw, .rd = valReg, .rs = addrReg, .imm = 0, .comment = "load member" });
         return valReg;
     }
 
-    bool CodeGenerator::isFloatExpr(std::shared_ptr<const ASTNode> node) const
+    // Arithmetic and sign nodes are float when any operand they pass through is; the walk stops at the first float term.
+    bool CodeGenerator::isFloatExpr(const ASTNode *node) const
+    {
+        struct {
+            const CodeGenerator &gen;
+            bool found = false;
+
+            bool enter(const ASTNode *n)
+            {
+                if (found || !n)
+                    return false;
+                if (n->kind == ASTNode::Kind::AddOp || n->kind == ASTNode::Kind::MultOp || n->kind == ASTNode::Kind::SignExpr)
+                    return true;
+                found = gen.isFloatTerm(n);
+                return false;
+            }
+            ChildSpan children(const ASTNode *n) const
+            {
+                return IsLogicalOp(n) ? ChildSpan(n->children).first(2) : gen.exprOperands(n, ExprRole::Value);
+            }
+            void leave(const ASTNode *) {}
+        } visitor{ *this };
+        WalkAST(node, visitor);
+        return visitor.found;
+    }
+
+    bool CodeGenerator::isFloatTerm(const ASTNode *node) const
     {
-        if (!node)
-            return false;
         switch (node->kind) {
             case ASTNode::Kind::Num:
                 return node->lexeme.find('.') != std::string::npos;
             case ASTNode::Kind::Id:
-                return getVarType(node->lexeme) == "float";
-            case ASTNode::Kind::AddOp:
-            case ASTNode::Kind::MultOp:
-                if (node->children.size() < 2)
-                    return false;
-                return isFloatExpr(node->children[0]) || isFloatExpr(node->children[1]);
-            case ASTNode::Kind::SignExpr:
-                if (node->children.empty())
-                    return false;
-                return isFloatExpr(node->children[0]);
+                return TypeTable::Spelling(getIdType(node)) == "float";
             case ASTNode::Kind::NotExpr:
             case ASTNode::Kind::RelOp:
                 return false;
@@ -1077,208 +1413,142 @@ namespace lang
                         return false;
                     auto &calleeNode = node->children[0];
                     if (calleeNode->kind == ASTNode::Kind::Id) {
-                        const auto &callArgs = (node->children.size() >= 2) ? node->children[1]->children : std::vector<std::shared_ptr<ASTNode>>{};
-                        std::vector<std::string> argTypes;
-                        for (auto &arg : callArgs) argTypes.push_back(isFloatExpr(arg) ? "float" : "int");
-                        for (auto *entry : m_globalTable->table) {
-                            if (entry->kind != SymbolTableNode::Kind::Function)
-                                continue;
-                            if (entry->name != calleeNode->lexeme)
-                                continue;
-                            if (entry->signature.params.size() != argTypes.size())
-                                continue;
-                            bool match = true;
-                            for (size_t k = 0; k < argTypes.size(); k++) {
-                                std::string pbase = entry->signature.params[k];
-                                size_t bk = pbase.find('[');
-                                if (bk != std::string::npos)
-                                    pbase = pbase.substr(0, bk);
-                                if (pbase != argTypes[k] && !(pbase == "float" && argTypes[k] == "int")) {
-                                    match = false;
-                                    break;
-                                }
-                            }
-                            if (match)
-                                return entry->signature.type == "float";
-                        }
-                        const SymbolTableNode *fn = findFreeFunction(calleeNode->lexeme);
+                        const SymbolTableNode *fn = calledFreeFunction(node);
                         return fn && fn->signature.type == "float";
                     } else if (calleeNode->kind == ASTNode::Kind::MemberAccess && calleeNode->children.size() >= 2) {
-                        std::string objType = getVarType(calleeNode->children[0]->lexeme);
-                        const SymbolTableNode *cls = findClass(objType);
-                        const SymbolTableNode *method = cls ? findMethod(cls, calleeNode->children[1]->lexeme) : nullptr;
+                        TypeId objType = getIdType(calleeNode->children[0]);
+                        const SymbolTableNode *cls = findClass(std::string(TypeTable::Spelling(objType)));
+                        const SymbolTableNode *method = calledMethod(node, cls);
                         return method && method->signature.type == "float";
                     }
                     return false;
                 }
             case ASTNode::Kind::MemberAccess:
                 {
-                    if (node->children.size() < 2)
-                        return false;
-                    std::string objType = getExprType(node->children[0]);
-                    size_t br2 = objType.find('[');
-                    std::string baseObjName = (br2 != std::string::npos) ? objType.substr(0, br2) : objType;
-                    const SymbolTableNode *cls = findClass(baseObjName);
-                    if (!cls)
-                        return false;
-                    const std::string &memberName = node->children[1]->lexeme;
-                    for (auto *entry : cls->table) {
-                        if (entry->kind == SymbolTableNode::Kind::Data && entry->name == memberName) {
-                            std::string t = entry->signature.type;
-                            size_t b = t.find('[');
-                            if (b != std::string::npos)
-                                t = t.substr(0, b);
-                            return t == "float";
-                        }
-                    }
-                    return false;
+                    TypeId memberType = getExprType(node);
+                    return memberType && memberType->scalar->spelling == "float";
                 }
             case ASTNode::Kind::IndexedVar:
                 {
-                    std::string elemType = getExprType(node);
-                    if (elemType.empty())
-                        return false;
-                    size_t b = elemType.find('[');
-                    std::string baseType = (b != std::string::npos) ? elemType.substr(0, b) : elemType;
-                    return baseType == "float";
+                    TypeId elemType = getExprType(node);
+                    return elemType && elemType->scalar->spelling == "float";
                 }
             default:
                 return false;
         }
     }
 
-    int CodeGenerator::generateLValue(std::shared_ptr<const ASTNode> node)
+    Reg CodeGenerator::generateAddress(const ASTNode *node, std::span<const ExprValue> operands)
     {
         if (!node)
-            return allocReg();
+            return zeroReg();
         switch (node->kind) {
             case ASTNode::Kind::Id:
                 return addrOfVar(node->lexeme);
             case ASTNode::Kind::IndexedVar:
-                return generateIndexedVarAddr(node);
+                return generateIndexedVarAddr(node, operands);
             case ASTNode::Kind::MemberAccess:
-                return generateMemberAccessAddr(node);
+                return generateMemberAccessAddr(node, operands);
             default:
-                {
-                    int r = allocReg();
-                    emit(std::format("         add    r{},r0,r0   % lvalue unknown kind", r));
-                    return r;
-                }
+                return zeroReg("lvalue unknown kind");
         }
     }
 
-    int CodeGenerator::generateIndexedVarAddr(std::shared_ptr<const ASTNode> node)
+    // Operands are the base's address unless the base is a named array, then the index
+    Reg CodeGenerator::generateIndexedVarAddr(const ASTNode *node, std::span<const ExprValue> operands)
     {
-        if (!node || node->children.size() < 2)
-            return allocReg();
+        if (!node || node->children.size() < 2 || operands.empty())
+            return zeroReg();
 
         auto &baseNode = node->children[0];
-        auto &indexNode = node->children[1];
 
-        int baseReg;
+        Reg baseReg;
         int elemSize = 4;
 
         if (baseNode->kind == ASTNode::Kind::Id) {
             const std::string &arrName = baseNode->lexeme;
-            std::string varType = getVarType(arrName);
-
-            if (!varType.empty()) {
-                size_t bracket = varType.find('[');
-                if (bracket != std::string::npos) {
-                    size_t close = varType.find(']', bracket);
-                    std::string elemType = varType.substr(0, bracket) + varType.substr(close + 1);
-                    elemSize = sizeOf(elemType.empty() ? varType.substr(0, bracket) : elemType);
-                    if (elemSize <= 0)
-                        elemSize = 4;
-                }
+            TypeId varType = getIdType(baseNode);
+
+            if (varType && varType->isArray()) {
+                elemSize = sizeOf(varType->element ? varType->element : varType->scalar);
+                if (elemSize <= 0)
+                    elemSize = 4;
             }
 
-            bool isArrayParam = varType.find('[') != std::string::npos && m_currentFuncNode &&
+            bool isArrayParam = varType && varType->isArray() && m_currentFuncNode &&
                 std::any_of(m_currentFuncNode->table.begin(), m_currentFuncNode->table.end(), [&](const SymbolTableNode *e) {
                                     return e->kind == SymbolTableNode::Kind::Parameter && e->name == arrName;
                                 });
             bool isPointer = isPointerType(varType) || isArrayParam;
             if (isPointer) {
-                baseReg = allocReg();
+                baseReg = newReg();
                 auto fit = m_currentFrame.offsets.find(arrName);
                 if (fit != m_currentFrame.offsets.end()) {
-                    emit(std::format("         lw     r{},{}(r14)   % load array pointer param", baseReg, fit->second));
+                    emit({ .op = MoonOp::Lw, .rd = baseReg, .rs = 14, .imm = fit->second, .comment = "load array pointer param" });
                 } else {
                     auto git = m_globalLabels.find(arrName);
                     if (git != m_globalLabels.end()) {
-                        emit(std::format("         lw     r{},{}(r0)   % load array pointer global", baseReg, git->second));
+                        emit({ .op = MoonOp::Lw, .rd = baseReg, .rs = 0, .sym = git->second, .comment = "load array pointer global" });
                     } else {
-                        emit(std::format("         add    r{},r0,r0   % pointer base not found", baseReg));
+                        emit({ .op = MoonOp::Add, .rd = baseReg, .rs = 0, .rt = 0, .comment = "pointer base not found" });
                     }
                 }
             } else {
                 baseReg = addrOfVar(arrName);
             }
         } else {
-            baseReg = generateIndexedVarAddr(baseNode);
+            baseReg = operands.front().reg;
             elemSize = 4;
         }
 
-        int idxReg = generateExpr(indexNode);
+        Reg idxReg = operands.back().reg;
 
-        int offReg = allocReg();
+        Reg offReg = newReg();
         if (elemSize == 4) {
-            emit(std::format("         muli   r{},r{},4   % offset = index * 4", offReg, idxReg));
+            emit({ .op = MoonOp::Muli, .rd = offReg, .rs = idxReg, .imm = 4, .comment = "offset = index * 4" });
         } else {
-            emit(std::format("         muli   r{},r{},{}   % offset = index * elemSize", offReg, idxReg, elemSize));
+            emit({ .op = MoonOp::Muli, .rd = offReg, .rs = idxReg, .imm = elemSize, .comment = "offset = index * elemSize" });
         }
-        freeReg(idxReg);
-
-        emit(std::format("         add    r{},r{},r{}   % element address", baseReg, baseReg, offReg));
-        freeReg(offReg);
 
-        return baseReg;
+        Reg addrReg = newReg();
+        emit({ .op = MoonOp::Add, .rd = addrReg, .rs = baseReg, .rt = offReg, .comment = "element address" });
+        return addrReg;
     }
 
-    int CodeGenerator::generateMemberAccessAddr(std::shared_ptr<const ASTNode> node)
+    // The only operand is the object's address
+    Reg CodeGenerator::generateMemberAccessAddr(const ASTNode *node, std::span<const ExprValue> operands)
     {
-        if (!node || node->children.size() < 2)
-            return allocReg();
+        if (!node || node->children.size() < 2 || operands.empty())
+            return zeroReg();
 
         auto &objNode = node->children[0];
         auto &memberNode = node->children[1];
 
-        int objAddrReg;
-        std::string objType;
-
-        if (objNode->kind == ASTNode::Kind::Id) {
-            objType = getVarType(objNode->lexeme);
-            objAddrReg = addrOfVar(objNode->lexeme);
-        } else {
-            objAddrReg = generateLValue(objNode);
-            objType = getExprType(objNode);
-        }
+        Reg objAddrReg = operands.front().reg;
+        TypeId objType = objNode->kind == ASTNode::Kind::Id ? getIdType(objNode) : getExprType(objNode);
 
-        size_t br = objType.find('[');
-        std::string baseObjType = (br != std::string::npos) ? objType.substr(0, br) : objType;
-        const SymbolTableNode *cls = findClass(baseObjType);
+        const SymbolTableNode *cls = objType ? findClass(objType->scalar->spelling) : nullptr;
         int offset = cls ? memberOffset(cls, memberNode->lexeme) : -1;
 
         if (offset <= 0)
             return objAddrReg;
 
-        int addrReg = allocReg();
-        emit(std::format("         addi   r{},r{},{}   % member offset", addrReg, objAddrReg, offset));
-        freeReg(objAddrReg);
+        Reg addrReg = newReg();
+        emit({ .op = MoonOp::Addi, .rd = addrReg, .rs = objAddrReg, .imm = offset, .comment = "member offset" });
         return addrReg;
     }
 
-    int CodeGenerator::callFunction(
-        const SymbolTableNode *funcNode, const std::vector<std::shared_ptr<ASTNode>> &args, const SymbolTableNode *classNode, int selfAddrReg)
+    // Arguments arrive evaluated, arrays as addresses; storing them into the callee's frame, which sits below the caller's
+    // spill and save slots, waits for register allocation to fix the caller's frame size.
+    Reg CodeGenerator::callFunction(
+        const SymbolTableNode *funcNode, const std::vector<ASTNode *> &args, std::span<const ExprValue> argValues,
+        const SymbolTableNode *classNode, Reg selfAddrReg)
     {
-        if (!funcNode) {
-            int r = allocReg();
-            emit(std::format("         add    r{},r0,r0   % null func call", r));
-            return r;
-        }
+        if (!funcNode)
+            return zeroReg("null func call");
 
         bool isMember = (classNode != nullptr);
-        FrameInfo calleeFrame = computeFrameInfo(funcNode, isMember);
+        const FrameInfo &calleeFrame = frameInfo(funcNode, isMember);
 
         std::vector<const SymbolTableNode *> params;
         for (auto *entry : funcNode->table) {
@@ -1286,74 +1556,37 @@ namespace lang
                 params.push_back(entry);
         }
 
-        std::vector<int> argRegs;
-        for (size_t i = 0; i < args.size(); i++) {
-            bool passAsPointer = (i < params.size()) && (isPointerType(params[i]->signature.type) || params[i]->signature.type.find('[') != std::string::npos);
-            int reg = passAsPointer ? generateLValue(args[i]) : generateExpr(args[i]);
-            if (i < params.size() && params[i]->signature.type == "float" && !isFloatExpr(args[i])) {
-                emit(std::format("         muli   r{},r{},100   % promote int arg to float x100 for param '{}'", reg, reg, params[i]->name));
+        std::vector<Reg> argRegs;
+        for (size_t i = 0; i < args.size() && i < argValues.size(); i++) {
+            Reg reg = argValues[i].reg;
+            if (i < params.size() && params[i]->signature.type == "float" && !argValues[i].isFloat) {
+                reg = promoteToFloat(reg, std::format("promote int arg to float x100 for param '{}'", params[i]->name));
             }
             argRegs.push_back(reg);
         }
 
-        std::set<int> argRegSet(argRegs.begin(), argRegs.end());
-        std::vector<int> liveRegs;
-        for (int r = 1; r <= 12; r++) {
-            bool isFree = std::find(m_freeRegs.begin(), m_freeRegs.end(), r) != m_freeRegs.end();
-            if (!isFree && argRegSet.find(r) == argRegSet.end())
-                liveRegs.push_back(r);
-        }
-        int spillSize = (int)liveRegs.size() * 4;
-
-        for (size_t i = 0; i < liveRegs.size(); i++) {
-            int offset = -(m_currentFrame.frame_size + (int)(i + 1) * 4);
-            emit(std::format("         sw     {}(r14),r{}   % spill r{}", offset, liveRegs[i], liveRegs[i]));
-        }
-
-        int effectiveFrameSize = m_currentFrame.frame_size + spillSize;
+        CallSite call{ .target = functionLabel(funcNode, classNode), .comment = std::format("call {}", funcNode->name) };
 
-        if (isMember && selfAddrReg >= 0) {
+        if (isMember && selfAddrReg != NO_REG) {
             auto selfIt = calleeFrame.offsets.find("__self");
-            if (selfIt != calleeFrame.offsets.end()) {
-                int placementOffset = selfIt->second - effectiveFrameSize;
-                emit(std::format("         sw     {}(r14),r{}   % pass self pointer", placementOffset, selfAddrReg));
-            }
+            if (selfIt != calleeFrame.offsets.end())
+                call.args.push_back({ selfAddrReg, selfIt->second, "pass self pointer" });
         }
 
         for (size_t i = 0; i < argRegs.size() && i < params.size(); i++) {
             auto pit = calleeFrame.offsets.find(params[i]->name);
-            if (pit != calleeFrame.offsets.end()) {
-                int placementOffset = pit->second - effectiveFrameSize;
-                emit(std::format("         sw     {}(r14),r{}   % pass arg '{}'", placementOffset, argRegs[i], params[i]->name));
-            }
-        }
-
-        for (int r : argRegs) freeReg(r);
-
-        if (effectiveFrameSize > 0) {
-            emit(std::format("         subi   r14,r14,{}", effectiveFrameSize));
-        }
-
-        emit(std::format("         jl     r15,{}   % call {}", functionLabel(funcNode, classNode), funcNode->name));
-
-        if (effectiveFrameSize > 0) {
-            emit(std::format("         addi   r14,r14,{}", effectiveFrameSize));
-        }
-
-        int resultReg = allocReg();
-        emit(std::format("         add    r{},r13,r0   % copy return value", resultReg));
-
-        for (size_t i = 0; i < liveRegs.size(); i++) {
-            int offset = -(m_currentFrame.frame_size + (int)(i + 1) * 4);
-            emit(std::format("         lw     r{},{}(r14)   % restore r{}", liveRegs[i], offset, liveRegs[i]));
+            if (pit != calleeFrame.offsets.end())
+                call.args.push_back({ argRegs[i], pit->second, std::format("pass arg '{}'", params[i]->name) });
         }
 
+        Reg resultReg = newReg();
+        emitCall(std::move(call), resultReg);
         return resultReg;
     }
 
-    void CodeGenerator::appendIOHelpers(std::ostringstream &out)
+    void CodeGenerator::appendIOHelpers(OutputBuffer &out)
     {
-        out << R"(         align
+        out.append(R"(         align
 % Write an integer to the output.
 % Entry:  r1 contains the integer.
 % Uses: r1, r2, r3, r4, r5.
@@ -1537,6 +1770,6 @@ gflt6    muli   r1,r1,100        % no decimal: scale int_part by 100
          bz     r3,gfltpos
          sub    r1,r0,r1
          jr     r15
-)";
+)");
     }
 } // namespace lang
@@ -1,11 +1,19 @@
 #pragma once
 
-#include <sstream>
+#include <array>
+#include <format>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "AST/ASTNode.hpp"
+#include "Compiler/MoonInstr.hpp"
+#include "Compiler/OutputBuffer.hpp"
+#include "Compiler/PassManager.hpp"
+#include "Compiler/Peephole.hpp"
 #include "SemanticAnalyzer/SemanticAnalyzer.hpp"
 
 namespace lang
@@ -16,18 +24,36 @@ namespace lang
         bool is_member = false;
     };
 
+    struct ClassLayout {
+        int size = 0;
+        std::unordered_map<std::string, int> offsets;
+        bool complete = false;
+    };
+
     class CodeGenerator
     {
     public:
-        CodeGenerator(std::shared_ptr<const ASTNode> ast, const SymbolTableNode *globalTable);
-        std::string generate();
+        CodeGenerator(const ASTNode *ast, const SymbolTableNode *globalTable);
+        OutputBuffer generate();
+
+        // Keep every function's code, after the passes and before register allocation, for --dump-ir
+        void setDumpIR(bool dump) { m_dumpIR = dump; }
+        // Names an IR pass, "peephole" or a peephole rule
+        void disablePass(std::string_view name)
+        {
+            m_passes.disable(name);
+            m_peephole.disable(name);
+        }
+        // Whether disablePass() would turn anything off
+        static bool IsPassName(std::string_view name) { return DefaultPipeline().has(name) || PeepholeOptimizer::HasRule(name); }
+        const OutputBuffer &getIR() const { return m_ir; }
 
     private:
-        std::shared_ptr<const ASTNode> m_ast;
+        const ASTNode *m_ast = nullptr;
         const SymbolTableNode *m_globalTable;
 
-        std::ostringstream m_code;
-        std::ostringstream m_data;
+        OutputBuffer m_code;
+        OutputBuffer m_data;
         int m_labelCounter = 0;
 
         FrameInfo m_currentFrame;
@@ -35,70 +61,149 @@ namespace lang
         const SymbolTableNode *m_currentClassNode = nullptr;
         std::unordered_map<std::string, std::string> m_globalLabels;
 
-        std::vector<int> m_freeRegs;
-        int allocReg();
-        void freeReg(int r);
-
-        void emit(const std::string &line);
-        void emitData(const std::string &line);
+        // The function being generated. Its instructions compute into fresh virtual registers and are only mapped onto
+        // MOON's registers, by RegisterAllocator, once the whole function is known.
+        MachineFunction m_func;
+        // Scalar variables of the current function that live in a register rather than in their frame or data slot
+        std::unordered_map<std::string, Reg> m_varRegs;
+        // Variables of main that other functions read by name, which therefore have to stay in memory
+        std::unordered_set<std::string> m_globalsUsedElsewhere;
+
+        PassManager m_passes = DefaultPipeline();
+        PeepholeOptimizer m_peephole;
+        bool m_dumpIR = false;
+        OutputBuffer m_ir;
+
+        Reg newReg();
+        Reg zeroReg(std::string comment = {});
+        Reg promoteToFloat(Reg r, std::string comment);
+
+        void beginFunction(int frameSize);
+        void promoteVariables(const SymbolTableNode *funcNode);
+        void finishFunction();
+
+        void emit(MoonInstr instr);
+        void emitText(std::string text);
+        // A no-op carrying a label, used as a branch target
+        void emitLabel(std::string label, std::string comment);
+        void emitCall(CallSite call, Reg result);
+        void emitData(std::string_view line);
+
+        template <typename... Args>
+        void emitData(std::format_string<const Args &...> fmt, const Args &...args)
+        {
+            m_data.appendLine(fmt, args...);
+        }
 
         std::string newLabel(const std::string &hint = "L");
 
 
-        int sizeOf(const std::string &type) const;
+        mutable std::unordered_map<TypeId, int> m_typeSizes;
+        mutable std::unordered_map<const SymbolTableNode *, ClassLayout> m_classLayouts;
+        mutable std::array<std::unordered_map<const SymbolTableNode *, FrameInfo>, 2> m_frames;
+
+        std::unordered_map<std::string, const SymbolTableNode *> m_classesByName;
+        std::unordered_map<std::string, const SymbolTableNode *> m_classesByLowerName;
+        std::unordered_map<std::string, std::vector<const SymbolTableNode *>> m_freeFunctionsByName;
+        std::unordered_map<std::string, const SymbolTableNode *> m_freeFunctionsByLowerName;
+        mutable std::unordered_map<const SymbolTableNode *, std::unordered_map<std::string, const SymbolTableNode *>> m_methodsByClass;
+        mutable std::unordered_map<std::string, const SymbolTableNode *> m_freeCallTargets;
+
+        int sizeOf(TypeId type) const;
         int sizeOfClass(const SymbolTableNode *cls) const;
-        bool isPointerType(const std::string &type) const;
+        const ClassLayout &layoutOf(const SymbolTableNode *cls) const;
+        bool isPointerType(TypeId type) const;
         const SymbolTableNode *findClass(const std::string &name) const;
         const SymbolTableNode *findFreeFunction(const std::string &name) const;
         const SymbolTableNode *findMethod(const SymbolTableNode *cls, const std::string &name) const;
+        const SymbolTableNode *resolveFreeCall(const std::string &name, const std::vector<ASTNode *> &args) const;
         int memberOffset(const SymbolTableNode *cls, const std::string &name) const;
-        std::string getVarType(const std::string &name) const;
-        std::string getExprType(std::shared_ptr<const ASTNode> node) const;
+        TypeId getVarType(const std::string &name) const;
+        TypeId getIdType(const ASTNode *node) const;
+        TypeId getExprType(const ASTNode *node) const;
+        const SymbolTableNode *calledFreeFunction(const ASTNode *call) const;
+        const SymbolTableNode *calledMethod(const ASTNode *call, const SymbolTableNode *cls) const;
+        const SymbolTableNode *calledFunction(const ASTNode *call, const SymbolTableNode *&classSym) const;
 
         FrameInfo computeFrameInfo(const SymbolTableNode *funcNode, bool isMember = false) const;
+        const FrameInfo &frameInfo(const SymbolTableNode *funcNode, bool isMember = false) const;
         std::unordered_map<std::string, std::string> allocateGlobals(const SymbolTableNode *mainNode);
 
         std::string functionLabel(const SymbolTableNode *funcNode, const SymbolTableNode *classNode = nullptr) const;
-
-
-        int loadVar(const std::string &name);
-        void storeVar(const std::string &name, int valueReg);
-        int addrOfVar(const std::string &name);
-
-        void generateProg(std::shared_ptr<const ASTNode> prog);
-        void generateFuncDef(std::shared_ptr<const ASTNode> funcDef);
-
-        void generateStatBlock(std::shared_ptr<const ASTNode> node);
-        void generateStatement(std::shared_ptr<const ASTNode> node);
-        void generateAssignStat(std::shared_ptr<const ASTNode> node);
-        void generateIfStat(std::shared_ptr<const ASTNode> node);
-        void generateWhileStat(std::shared_ptr<const ASTNode> node);
-        void generatePutStat(std::shared_ptr<const ASTNode> node);
-        void generateReadStat(std::shared_ptr<const ASTNode> node);
-        void generateReturnStat(std::shared_ptr<const ASTNode> node);
-
-        int generateExpr(std::shared_ptr<const ASTNode> node);
-        int generateBinaryOp(std::shared_ptr<const ASTNode> node, const std::string &moonInstr);
-        int generateRelOp(std::shared_ptr<const ASTNode> node);
-        int generateNotExpr(std::shared_ptr<const ASTNode> node);
-        int generateSignExpr(std::shared_ptr<const ASTNode> node);
-        int generateNum(std::shared_ptr<const ASTNode> node);
-        int generateIdExpr(std::shared_ptr<const ASTNode> node);
-        int generateFuncCallExpr(std::shared_ptr<const ASTNode> node);
-        int generateIndexedVarExpr(std::shared_ptr<const ASTNode> node);
-        int generateMemberAccessExpr(std::shared_ptr<const ASTNode> node);
-
-        bool isFloatExpr(std::shared_ptr<const ASTNode> node) const;
-
-        int generateLValue(std::shared_ptr<const ASTNode> node);
-        int generateIndexedVarAddr(std::shared_ptr<const ASTNode> node);
-        int generateMemberAccessAddr(std::shared_ptr<const ASTNode> node);
-
-        int callFunction(
-            const SymbolTableNode *funcNode, const std::vector<std::shared_ptr<ASTNode>> &args, const SymbolTableNode *classNode = nullptr,
-            int selfAddrReg = -1);
-
-        void appendIOHelpers(std::ostringstream &out);
+        const SymbolTableNode *definedFunction(const ASTNode *funcDef, const SymbolTableNode *&classSym) const;
+        void findGlobalsUsedElsewhere(const ASTNode *funcDefs);
+
+
+        Reg loadVar(const std::string &name);
+        void storeVar(const std::string &name, Reg valueReg);
+        Reg addrOfVar(const std::string &name);
+
+        void generateProg(const ASTNode *prog);
+        void generateFuncDef(const ASTNode *funcDef);
+
+        void generateStatBlock(const ASTNode *node);
+        void generateStatement(const ASTNode *node);
+        void generateAssignStat(const ASTNode *node);
+
+        // Labels of an if (else, endif) or a while (body, condition) whose blocks are being generated
+        struct BranchLabels {
+            std::string head;
+            std::string end;
+        };
+
+        BranchLabels beginIfStat(const ASTNode *node);
+        void beginElse(const BranchLabels &labels);
+        void endIfStat(const BranchLabels &labels);
+        BranchLabels beginWhileStat(const ASTNode *node);
+        void endWhileStat(const ASTNode *node, const BranchLabels &labels);
+        void generateCondition(const ASTNode *node, bool whenTrue, const std::string &target);
+        Reg generateLogicalValue(const ASTNode *node);
+        void generatePutStat(const ASTNode *node);
+        void generateReadStat(const ASTNode *node);
+        void generateReturnStat(const ASTNode *node);
+
+        // A subexpression already evaluated into a register, with whether it holds a float
+        struct ExprValue {
+            Reg reg;
+            bool isFloat;
+        };
+
+        // What the expression walk makes of a node: its value, its address (an lvalue, or an array passed by pointer), or
+        // nothing of its own for a node that only groups operands (a call's arguments, a method call's receiver).
+        enum class ExprRole {
+            Value,
+            Address,
+            Operands,
+        };
+
+        Reg generateExpr(const ASTNode *node);
+        ExprValue evaluateExpr(const ASTNode *node, ExprRole role);
+        ExprRole operandRole(const ASTNode *node) const;
+        std::span<ASTNode *const> exprOperands(const ASTNode *node, ExprRole role) const;
+        ExprValue generateExprNode(const ASTNode *node, std::span<const ExprValue> operands);
+        Reg generateAddress(const ASTNode *node, std::span<const ExprValue> operands);
+        Reg generateBinaryOp(const ASTNode *node, ExprValue lhs, ExprValue rhs);
+        Reg generateRelOp(const ASTNode *node, ExprValue lhs, ExprValue rhs);
+        Reg generateNotExpr(const ASTNode *node, ExprValue operand);
+        Reg generateSignExpr(const ASTNode *node, ExprValue operand);
+        Reg generateNum(const ASTNode *node);
+        Reg generateIdExpr(const ASTNode *node);
+        Reg generateFuncCallExpr(const ASTNode *node, std::span<const ExprValue> operands);
+        Reg generateIndexedVarExpr(const ASTNode *node, std::span<const ExprValue> operands);
+        Reg generateMemberAccessExpr(const ASTNode *node, std::span<const ExprValue> operands);
+
+        bool isFloatExpr(const ASTNode *node) const;
+        bool isFloatTerm(const ASTNode *node) const;
+
+        Reg generateLValue(const ASTNode *node);
+        Reg generateIndexedVarAddr(const ASTNode *node, std::span<const ExprValue> operands);
+        Reg generateMemberAccessAddr(const ASTNode *node, std::span<const ExprValue> operands);
+
+        Reg callFunction(
+            const SymbolTableNode *funcNode, const std::vector<ASTNode *> &args, std::span<const ExprValue> argValues,
+            const SymbolTableNode *classNode = nullptr, Reg selfAddrReg = NO_REG);
+
+        void appendIOHelpers(OutputBuffer &out);
     };
 
 } // namespace lang
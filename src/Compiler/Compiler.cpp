@@ -3,11 +3,13 @@
 #include "LexicalAnalyzer/LexicalAnalyzer.hpp"
 #include "Problems/Problems.hpp"
 #include "SemanticAnalyzer/SemanticAnalyzer.hpp"
+#include "utils/ParallelFor.hpp"
 
+#include <algorithm>
 #include <format>
 #include <regex>
 
-static std::string makeTokensText(const std::vector<lang::Token> &tokens)
+static std::string makeTokensText(const lang::LexicalAnalyzer &lexer, const std::vector<lang::CompactToken> &tokens)
 {
     std::string out;
     std::uint64_t current_line = 1;
@@ -19,8 +21,8 @@ static std::string makeTokensText(const std::vector<lang::Token> &tokens)
             current_line++;
             first_token_of_line = true;
         }
-        std::string lexeme = std::regex_replace(token.lexeme, std::regex("\n"), "\\n");
-        std::string entry = std::format("[{}, {}, {}:{}]", lang::tokenTypeToString(token.type), lexeme, token.line, token.pos);
+        std::string lexeme = std::regex_replace(std::string(lexer.getLexeme(token)), std::regex("\n"), "\\n");
+        std::string entry = std::format("[{}, {}, {}:{}]", lang::tokenTypeToString(token.type), lexeme, token.line, lexer.getColumn(token));
         if (!first_token_of_line)
             out += ' ';
         out += entry;
@@ -30,7 +32,7 @@ static std::string makeTokensText(const std::vector<lang::Token> &tokens)
     return out;
 }
 
-static std::string makeTokensFlaciText(const std::vector<lang::Token> &tokens)
+static std::string makeTokensFlaciText(const std::vector<lang::CompactToken> &tokens)
 {
     std::string out;
     for (const auto &token : tokens) {
@@ -44,10 +46,14 @@ static std::string makeTokensFlaciText(const std::vector<lang::Token> &tokens)
 
 Compiler::Compiler(const Settings &settings) : m_settings(settings) {}
 
-std::unordered_map<std::string, Compiler::Output> Compiler::compileAll()
+std::vector<Compiler::Output> Compiler::compileAll()
 {
-    std::unordered_map<std::string, Compiler::Output> out;
-    for (auto &file : m_settings.files) out[file] = compile(file);
+    std::size_t jobs = lang::ResolveJobs(m_settings.jobs);
+
+    // Threads left over once every file has one go to indexing lines and checking function bodies within each file
+    std::vector<Compiler::Output> out(m_settings.files.size());
+    m_fileJobs = std::max<std::size_t>(1, jobs / std::max<std::size_t>(1, out.size()));
+    lang::ParallelFor(out.size(), jobs, [&](std::size_t i) { out[i] = compile(m_settings.files[i]); });
     return out;
 }
 
@@ -56,6 +62,9 @@ Compiler::Output Compiler::compile(const std::string &file)
     Output output = { .source_file = file };
 
     lang::SemanticAnalyzer sa;
+    sa.setKeepRawTokens(m_settings.emit_tokens || m_settings.emit_tokens_flaci);
+    sa.setLexJobs(m_fileJobs);
+    sa.setCheckJobs(m_fileJobs);
     sa.openFile(file);
     sa.parse();
 
@@ -70,7 +79,7 @@ Compiler::Output Compiler::compile(const std::string &file)
 
     // Optional intermediate outputs (only populated when the flag is set)
     if (m_settings.emit_tokens)
-        output.tokens_text = makeTokensText(synAna.getRawTokens());
+        output.tokens_text = makeTokensText(lexer, synAna.getRawTokens());
     if (m_settings.emit_tokens_flaci)
         output.tokens_flaci_text = makeTokensFlaciText(synAna.getRawTokens());
     if (m_settings.emit_derivation)
@@ -83,7 +92,11 @@ Compiler::Output Compiler::compile(const std::string &file)
     // Code generation (while sa is still alive)
     if (sa.getAST() && sa.getSymbolTable()) {
         lang::CodeGenerator cg(sa.getAST(), sa.getSymbolTable());
+        cg.setDumpIR(m_settings.emit_ir);
+        for (const auto &name : m_settings.disabled_passes) cg.disablePass(name);
         output.assembly = cg.generate();
+        if (m_settings.emit_ir)
+            output.ir_text = cg.getIR().str();
     }
 
     return output;
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
+#include "Compiler/OutputBuffer.hpp"
+
 class Compiler
 {
 public:
@@ -15,25 +17,32 @@ public:
         bool emit_derivation    = false;  // --derivation    → .outderivation
         bool emit_ast           = false;  // --ast           → .outast
         bool emit_symbol_tables = false;  // --symbol-tables → .outsymboltables
+        bool emit_ir            = false;  // --dump-ir       → .outir
+
+        std::vector<std::string> disabled_passes;  // --disable-pass — IR passes to skip, to measure what each one buys
+
+        int jobs = 1;  // -j, --jobs — worker threads for files, then function bodies; 0 uses every hardware thread
     };
 
     struct Output {
         std::string source_file;
-        std::string assembly;           // .moon — empty if compilation failed
+        lang::OutputBuffer assembly;    // .moon — empty if compilation failed
         std::string errors_text;        // .outerrors — unified, sorted by line+col; empty if no errors
         std::string tokens_text;        // .outlextokens
         std::string tokens_flaci_text;  // .outlextokensflaci
         std::string derivation_text;    // .outderivation
         std::string ast_dot_text;       // .outast
         std::string symbol_table_text;  // .outsymboltables
+        std::string ir_text;            // .outir
     };
 
     Compiler(const Settings &settings);
 
-    std::unordered_map<std::string, Output> compileAll();
+    std::vector<Output> compileAll();
 
 private:
     Output compile(const std::string &file);
 
     const Settings m_settings;
+    std::size_t m_fileJobs = 1;
 };
@@ -0,0 +1,80 @@
+#include "ControlFlowGraph.hpp"
+
+namespace lang
+{
+    ControlFlowGraph::ControlFlowGraph(const MachineFunction &func)
+    {
+        const auto &code = func.code;
+        m_blockOf.assign(code.size(), 0);
+
+        for (std::size_t i = 0; i < code.size(); i++) {
+            if (!code[i].label.empty())
+                m_labels.try_emplace(code[i].label, i);
+
+            const bool leader = i == 0 || !code[i].label.empty() || IsTerminator(code[i - 1].op);
+            if (leader)
+                m_blocks.push_back({ i, i, {}, {} });
+            m_blocks.back().last = i;
+            m_blockOf[i] = m_blocks.size() - 1;
+        }
+
+        for (std::size_t b = 0; b < m_blocks.size(); b++) {
+            const MoonInstr &last = code[m_blocks[b].last];
+            auto &succs = m_blocks[b].succs;
+            if (last.op == MoonOp::Bz || last.op == MoonOp::Bnz || last.op == MoonOp::J) {
+                if (std::size_t to = target(last.sym); to != NO_TARGET)
+                    succs.push_back(m_blockOf[to]);
+            }
+            if (last.op != MoonOp::J && last.op != MoonOp::Jr && last.op != MoonOp::Hlt && b + 1 < m_blocks.size())
+                succs.push_back(b + 1);
+            for (std::size_t s : succs) m_blocks[s].preds.push_back(b);
+        }
+    }
+
+    std::size_t ControlFlowGraph::target(std::string_view label) const
+    {
+        auto it = m_labels.find(label);
+        return it == m_labels.end() ? NO_TARGET : it->second;
+    }
+
+    std::vector<char> ControlFlowGraph::reachable() const
+    {
+        std::vector<char> seen(m_blocks.size(), 0);
+        if (m_blocks.empty())
+            return seen;
+
+        std::vector<std::size_t> work{ 0 };
+        seen[0] = 1;
+        while (!work.empty()) {
+            const std::size_t b = work.back();
+            work.pop_back();
+            for (std::size_t s : m_blocks[b].succs) {
+                if (!seen[s]) {
+                    seen[s] = 1;
+                    work.push_back(s);
+                }
+            }
+        }
+        return seen;
+    }
+
+    void PrintIR(const MachineFunction &func, OutputBuffer &out)
+    {
+        const ControlFlowGraph cfg(func);
+        const auto &blocks = cfg.blocks();
+
+        for (std::size_t b = 0; b < blocks.size(); b++) {
+            out.appendFormat("% B{}", b);
+            if (!blocks[b].preds.empty()) {
+                out.append("   from");
+                for (std::size_t p : blocks[b].preds) out.appendFormat(" B{}", p);
+            }
+            if (!blocks[b].succs.empty()) {
+                out.append("   to");
+                for (std::size_t s : blocks[b].succs) out.appendFormat(" B{}", s);
+            }
+            out.append("\n");
+            for (std::size_t i = blocks[b].first; i <= blocks[b].last; i++) PrintMoon(func.code[i], out, &func.calls);
+        }
+    }
+} // namespace lang
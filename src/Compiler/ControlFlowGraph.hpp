@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Compiler/MoonInstr.hpp"
+#include "Compiler/OutputBuffer.hpp"
+
+namespace lang
+{
+    struct BasicBlock {
+        std::size_t first;
+        std::size_t last;
+        std::vector<std::size_t> succs;
+        std::vector<std::size_t> preds;
+    };
+
+    // The basic blocks of a MachineFunction and the edges between them. A block starts at the first instruction, at
+    // every labelled instruction and after every terminator. The graph refers to the function's labels, so it is only
+    // valid until the code changes.
+    class ControlFlowGraph
+    {
+    public:
+        static constexpr std::size_t NO_TARGET = static_cast<std::size_t>(-1);
+
+        explicit ControlFlowGraph(const MachineFunction &func);
+
+        const std::vector<BasicBlock> &blocks() const { return m_blocks; }
+        std::size_t blockOf(std::size_t instr) const { return m_blockOf[instr]; }
+        // Index of the instruction carrying the label, or NO_TARGET for a label outside the function
+        std::size_t target(std::string_view label) const;
+        // Blocks that some path from the entry reaches
+        std::vector<char> reachable() const;
+
+    private:
+        std::unordered_map<std::string_view, std::size_t> m_labels;
+        std::vector<BasicBlock> m_blocks;
+        std::vector<std::size_t> m_blockOf;
+    };
+
+    // The function block by block, with virtual registers and calls still symbolic; the --dump-ir output.
+    void PrintIR(const MachineFunction &func, OutputBuffer &out);
+} // namespace lang
@@ -0,0 +1,138 @@
+#include "MoonInstr.hpp"
+
+#include <array>
+
+namespace lang
+{
+    static constexpr std::array<std::string_view, static_cast<std::size_t>(MoonOp::Text) + 1> MNEMONICS = {
+        "add",  "sub",  "mul",  "div",  "mod",  "and",  "or",   "ceq",  "cne",  "clt",  "cle",  "cgt",  "cge",
+        "addi", "subi", "muli", "divi", "modi", "andi", "ori",  "ceqi", "cnei", "clti", "clei", "cgti", "cgei",
+        "sl",   "sr",   "lw",   "sw",   "bz",   "bnz",  "j",    "jl",   "jr",   "putc", "hlt",  "call", "",
+    };
+
+    bool IsTerminator(MoonOp op)
+    {
+        return op == MoonOp::Bz || op == MoonOp::Bnz || op == MoonOp::J || op == MoonOp::Jr || op == MoonOp::Hlt;
+    }
+
+    bool IsPure(MoonOp op)
+    {
+        return op <= MoonOp::Lw;
+    }
+
+    std::string_view Mnemonic(MoonOp op)
+    {
+        return MNEMONICS[static_cast<std::size_t>(op)];
+    }
+
+    static void AppendReg(OutputBuffer &out, Reg r)
+    {
+        if (IsVirtualReg(r))
+            out.appendFormat("v{}", r - VREG_BASE);
+        else
+            out.appendFormat("r{}", r);
+    }
+
+    static void AppendImm(OutputBuffer &out, const MoonInstr &instr)
+    {
+        if (instr.sym.empty())
+            out.appendFormat("{}", instr.imm);
+        else
+            out.append(instr.sym);
+    }
+
+    void PrintMoon(const MoonInstr &instr, OutputBuffer &out, const std::vector<CallSite> *calls)
+    {
+        if (instr.op == MoonOp::Text) {
+            out.append(instr.sym);
+            out.append("\n");
+            return;
+        }
+
+        if (instr.label.empty())
+            out.append("         ");
+        else
+            out.appendFormat("{:<11} ", instr.label);
+
+        if (instr.op == MoonOp::Hlt) {
+            out.append("hlt");
+        } else {
+            out.appendFormat("{:<6} ", Mnemonic(instr.op));
+            switch (instr.op) {
+                case MoonOp::Lw:
+                    AppendReg(out, instr.rd);
+                    out.append(",");
+                    AppendImm(out, instr);
+                    out.append("(");
+                    AppendReg(out, instr.rs);
+                    out.append(")");
+                    break;
+                case MoonOp::Sw:
+                    AppendImm(out, instr);
+                    out.append("(");
+                    AppendReg(out, instr.rs);
+                    out.append("),");
+                    AppendReg(out, instr.rt);
+                    break;
+                case MoonOp::Sl:
+                case MoonOp::Sr:
+                    AppendReg(out, instr.rd);
+                    out.append(",");
+                    AppendImm(out, instr);
+                    break;
+                case MoonOp::Bz:
+                case MoonOp::Bnz:
+                    AppendReg(out, instr.rs);
+                    out.append(",");
+                    out.append(instr.sym);
+                    break;
+                case MoonOp::J:
+                    out.append(instr.sym);
+                    break;
+                case MoonOp::Jl:
+                    AppendReg(out, instr.rd);
+                    out.append(",");
+                    out.append(instr.sym);
+                    break;
+                case MoonOp::Jr:
+                case MoonOp::Putc:
+                    AppendReg(out, instr.rs);
+                    break;
+                case MoonOp::Call:
+                    if (!calls) {
+                        out.appendFormat("#{}", instr.imm);
+                        break;
+                    }
+                    out.append((*calls)[instr.imm].target);
+                    out.append("(");
+                    for (const auto &arg : (*calls)[instr.imm].args) {
+                        if (&arg != &(*calls)[instr.imm].args.front())
+                            out.append(",");
+                        AppendReg(out, arg.reg);
+                    }
+                    out.append(")");
+                    if (instr.rd != NO_REG) {
+                        out.append(" -> ");
+                        AppendReg(out, instr.rd);
+                    }
+                    break;
+                default:
+                    AppendReg(out, instr.rd);
+                    out.append(",");
+                    AppendReg(out, instr.rs);
+                    out.append(",");
+                    if (instr.op < MoonOp::Addi)
+                        AppendReg(out, instr.rt);
+                    else
+                        AppendImm(out, instr);
+                    break;
+            }
+        }
+
+        if (!instr.comment.empty()) {
+            out.append("   % ");
+            out.append(instr.comment);
+        }
+        out.append("\n");
+    }
+} // namespace lang
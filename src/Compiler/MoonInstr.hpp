@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Compiler/OutputBuffer.hpp"
+
+namespace lang
+{
+    // Register operands below VREG_BASE are MOON's r0-r15. The code generator numbers the values it computes from
+    // VREG_BASE upwards and RegisterAllocator maps them onto physical registers afterwards.
+    using Reg = int;
+    inline constexpr Reg NO_REG = -1;
+    inline constexpr Reg VREG_BASE = 16;
+
+    constexpr bool IsVirtualReg(Reg r)
+    {
+        return r >= VREG_BASE;
+    }
+
+    enum class MoonOp : std::uint8_t {
+        // op rd,rs,rt
+        Add,
+        Sub,
+        Mul,
+        Div,
+        Mod,
+        And,
+        Or,
+        Ceq,
+        Cne,
+        Clt,
+        Cle,
+        Cgt,
+        Cge,
+        // op rd,rs,k
+        Addi,
+        Subi,
+        Muli,
+        Divi,
+        Modi,
+        Andi,
+        Ori,
+        Ceqi,
+        Cnei,
+        Clti,
+        Clei,
+        Cgti,
+        Cgei,
+        Sl,   // sl rd,k with rs == rd, shifting in place
+        Sr,   // sr rd,k with rs == rd
+        Lw,   // lw rd,k(rs)
+        Sw,   // sw k(rs),rt
+        Bz,   // bz rs,target
+        Bnz,  // bnz rs,target
+        J,    // j target
+        Jl,   // jl rd,target
+        Jr,   // jr rs
+        Putc, // putc rs
+        Hlt,
+        Call, // pseudo instruction, see CallSite
+        Text, // line printed verbatim: directives, comments, blank lines
+    };
+
+    // One line of MOON assembly. Registers read are in rs/rt and the register written in rd, whatever the operand order
+    // of the printed form; the immediate is `sym` when that is set (a data label, a branch target) and `imm` otherwise.
+    struct MoonInstr {
+        MoonOp op = MoonOp::Text;
+        Reg rd = NO_REG;
+        Reg rs = NO_REG;
+        Reg rt = NO_REG;
+        int imm = 0;
+        std::string sym;
+        std::string label;
+        std::string comment;
+    };
+
+    // A call to a function or to one of the I/O helpers. It stays a single Call instruction (imm indexes
+    // MachineFunction::calls, rd receives the result) until registers are assigned, since only then is it known which
+    // registers must be saved around it and how large the caller's frame has become.
+    struct CallSite {
+        struct Arg {
+            Reg reg;
+            int offset; // where the callee finds it, relative to the callee's r14
+            std::string comment;
+        };
+
+        std::string target;
+        std::string comment;
+        std::vector<Arg> args;
+        // putint & co take their single argument and return their result in r1, keep r14, and only touch r1-r6
+        bool helper = false;
+    };
+
+    // The code of one function (main included) while it still uses virtual registers.
+    struct MachineFunction {
+        std::vector<MoonInstr> code;
+        std::vector<CallSite> calls;
+        int frameSize = 0;
+        Reg nextReg = VREG_BASE;
+
+        Reg newReg() { return nextReg++; }
+    };
+
+    // The virtual register an instruction writes, or NO_REG
+    inline Reg DefOf(const MoonInstr &instr)
+    {
+        return IsVirtualReg(instr.rd) ? instr.rd : NO_REG;
+    }
+
+    // Calls f once for every virtual register the instruction reads, the arguments of a call included
+    template <typename F>
+    void ForEachUse(const MoonInstr &instr, const MachineFunction &func, F &&f)
+    {
+        if (IsVirtualReg(instr.rs))
+            f(instr.rs);
+        if (IsVirtualReg(instr.rt) && instr.rt != instr.rs)
+            f(instr.rt);
+        if (instr.op == MoonOp::Call) {
+            for (const auto &arg : func.calls[instr.imm].args)
+                if (IsVirtualReg(arg.reg))
+                    f(arg.reg);
+        }
+    }
+
+    bool IsTerminator(MoonOp op);
+    bool IsPure(MoonOp op);
+    std::string_view Mnemonic(MoonOp op);
+    // Prints one instruction as a MOON source line. A Call only prints its target and operands when `calls` is given.
+    void PrintMoon(const MoonInstr &instr, OutputBuffer &out, const std::vector<CallSite> *calls = nullptr);
+} // namespace lang
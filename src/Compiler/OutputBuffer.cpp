@@ -0,0 +1,97 @@
+#include "OutputBuffer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace lang
+{
+    OutputBuffer::Chunk &OutputBuffer::room(std::size_t bytes)
+    {
+        if (!m_chunks.empty() && m_chunks.back().capacity - m_chunks.back().size >= bytes)
+            return m_chunks.back();
+
+        Chunk chunk;
+        chunk.capacity = std::max(bytes, CHUNK_SIZE);
+        chunk.data = std::make_unique_for_overwrite<char[]>(chunk.capacity);
+        return m_chunks.emplace_back(std::move(chunk));
+    }
+
+    void OutputBuffer::append(std::string_view text)
+    {
+        while (!text.empty()) {
+            Chunk &chunk = room(1);
+            const std::size_t n = std::min(text.size(), chunk.capacity - chunk.size);
+            std::memcpy(chunk.data.get() + chunk.size, text.data(), n);
+            chunk.size += n;
+            text.remove_prefix(n);
+        }
+    }
+
+    void OutputBuffer::splice(OutputBuffer &&other)
+    {
+        for (auto &chunk : other.m_chunks) m_chunks.push_back(std::move(chunk));
+        other.m_chunks.clear();
+    }
+
+    bool OutputBuffer::empty() const
+    {
+        return size() == 0;
+    }
+
+    std::size_t OutputBuffer::size() const
+    {
+        std::size_t total = 0;
+        for (const auto &chunk : m_chunks) total += chunk.size;
+        return total;
+    }
+
+    std::string OutputBuffer::str() const
+    {
+        std::string out;
+        out.reserve(size());
+        for (const auto &chunk : m_chunks) out.append(chunk.data.get(), chunk.size);
+        return out;
+    }
+
+    bool OutputBuffer::writeTo(const std::string &path) const
+    {
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+
+        std::vector<iovec> iov;
+        iov.reserve(m_chunks.size());
+        for (const auto &chunk : m_chunks)
+            if (chunk.size)
+                iov.push_back({ chunk.data.get(), chunk.size });
+
+        // Normally a single call; loops only on short writes or more than IOV_MAX chunks
+        std::size_t first = 0;
+        bool ok = true;
+        while (first < iov.size()) {
+            const int count = static_cast<int>(std::min<std::size_t>(iov.size() - first, IOV_MAX));
+            const ssize_t written = ::writev(fd, iov.data() + first, count);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                ok = false;
+                break;
+            }
+
+            auto remaining = static_cast<std::size_t>(written);
+            while (first < iov.size() && remaining >= iov[first].iov_len) remaining -= iov[first++].iov_len;
+            if (remaining) {
+                iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + remaining;
+                iov[first].iov_len -= remaining;
+            }
+        }
+
+        return ::close(fd) == 0 && ok;
+    }
+} // namespace lang
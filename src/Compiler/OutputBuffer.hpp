@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <format>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lang
+{
+    // Append-only text buffer made of fixed-size chunks. What is already written never moves, formatted text goes straight
+    // into the current chunk, and the whole buffer reaches its file through a single writev.
+    class OutputBuffer
+    {
+    public:
+        static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+        void append(std::string_view text);
+
+        template <typename... Args>
+        void appendFormat(std::format_string<const Args &...> fmt, const Args &...args)
+        {
+            Chunk &chunk = room(1);
+            const std::size_t free = chunk.capacity - chunk.size;
+            const auto result = std::format_to_n(chunk.data.get() + chunk.size, free, fmt, args...);
+            const auto written = static_cast<std::size_t>(result.size);
+            if (written <= free) {
+                chunk.size += written;
+                return;
+            }
+
+            // Did not fit: the partial text past chunk.size is simply overwritten later
+            Chunk &next = room(written);
+            std::format_to(next.data.get() + next.size, fmt, args...);
+            next.size += written;
+        }
+
+        template <typename... Args>
+        void appendLine(std::format_string<const Args &...> fmt, const Args &...args)
+        {
+            appendFormat(fmt, args...);
+            append("\n");
+        }
+
+        // Moves every chunk of `other` to the end of this buffer without copying the text.
+        void splice(OutputBuffer &&other);
+
+        void clear() { m_chunks.clear(); }
+        bool empty() const;
+        std::size_t size() const;
+
+        std::string str() const;
+        bool writeTo(const std::string &path) const;
+
+    private:
+        struct Chunk {
+            std::unique_ptr<char[]> data;
+            std::size_t size = 0;
+            std::size_t capacity = 0;
+        };
+
+        // The current chunk if it has `bytes` free, otherwise a new one large enough
+        Chunk &room(std::size_t bytes);
+
+        std::vector<Chunk> m_chunks;
+    };
+} // namespace lang
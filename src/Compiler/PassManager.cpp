@@ -0,0 +1,61 @@
+#include "PassManager.hpp"
+
+#include <algorithm>
+
+#include "Compiler/Passes.hpp"
+
+namespace lang
+{
+    void PassManager::add(std::unique_ptr<FunctionPass> pass)
+    {
+        const bool enabled = std::ranges::find(m_disabled, pass->name()) == m_disabled.end();
+        m_passes.push_back({ std::move(pass), enabled, {} });
+    }
+
+    void PassManager::disable(std::string_view name)
+    {
+        m_disabled.emplace_back(name);
+        for (auto &entry : m_passes) {
+            if (entry.pass->name() == name)
+                entry.enabled = false;
+        }
+    }
+
+    bool PassManager::has(std::string_view name) const
+    {
+        return std::ranges::any_of(m_passes, [&](const Entry &entry) { return entry.pass->name() == name; });
+    }
+
+    void PassManager::run(MachineFunction &func)
+    {
+        for (auto &entry : m_passes) {
+            if (!entry.enabled)
+                continue;
+            entry.stats.instructionsBefore += func.code.size();
+            if (entry.pass->run(func))
+                entry.stats.functionsChanged++;
+            entry.stats.instructionsAfter += func.code.size();
+        }
+    }
+
+    void PassManager::printStats(OutputBuffer &out) const
+    {
+        for (const auto &entry : m_passes) {
+            if (!entry.enabled) {
+                out.appendLine("% pass {}: disabled", entry.pass->name());
+                continue;
+            }
+            out.appendLine(
+                "% pass {}: changed {} function(s), {} -> {} instructions", entry.pass->name(), entry.stats.functionsChanged,
+                entry.stats.instructionsBefore, entry.stats.instructionsAfter);
+        }
+    }
+
+    PassManager DefaultPipeline()
+    {
+        PassManager passes;
+        passes.add(std::make_unique<ConstantFoldingPass>());
+        passes.add(std::make_unique<UnreachableCodePass>());
+        return passes;
+    }
+} // namespace lang
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Compiler/MoonInstr.hpp"
+#include "Compiler/OutputBuffer.hpp"
+
+namespace lang
+{
+    // A transformation of one function's code while it still uses virtual registers.
+    class FunctionPass
+    {
+    public:
+        virtual ~FunctionPass() = default;
+
+        // The name --disable-pass and the statistics know the pass by
+        virtual std::string_view name() const = 0;
+        // Returns whether the code changed
+        virtual bool run(MachineFunction &func) = 0;
+    };
+
+    // Runs its passes, in the order they were added, over every function handed to it, and counts what each did.
+    class PassManager
+    {
+    public:
+        struct Stats {
+            std::size_t functionsChanged = 0;
+            std::size_t instructionsBefore = 0;
+            std::size_t instructionsAfter = 0;
+        };
+
+        void add(std::unique_ptr<FunctionPass> pass);
+        // Passes added under this name are skipped; unknown names are ignored, see has()
+        void disable(std::string_view name);
+        bool has(std::string_view name) const;
+        void run(MachineFunction &func);
+
+        // One comment line per pass, for the end of the --dump-ir output
+        void printStats(OutputBuffer &out) const;
+
+    private:
+        struct Entry {
+            std::unique_ptr<FunctionPass> pass;
+            bool enabled = true;
+            Stats stats;
+        };
+
+        std::vector<Entry> m_passes;
+        std::vector<std::string> m_disabled;
+    };
+
+    // The passes run on every function, in order
+    PassManager DefaultPipeline();
+} // namespace lang
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Compiler/PassManager.hpp"
+
+namespace lang
+{
+    // Computes at compile time whatever only depends on constants, carrying the constants held by promoted variables
+    // from block to block, and turns branches whose condition is known into a jump or removes them.
+    class ConstantFoldingPass : public FunctionPass
+    {
+    public:
+        std::string_view name() const override { return "constant-folding"; }
+        bool run(MachineFunction &func) override;
+    };
+
+    // Drops the blocks no path from the entry reaches, such as the epilogue after a function's last return.
+    class UnreachableCodePass : public FunctionPass
+    {
+    public:
+        std::string_view name() const override { return "unreachable-code"; }
+        bool run(MachineFunction &func) override;
+    };
+} // namespace lang
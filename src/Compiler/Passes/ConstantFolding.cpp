@@ -0,0 +1,424 @@
+#include "../Passes.hpp"
+#include "Compiler/ControlFlowGraph.hpp"
+
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace lang
+{
+    // What is known about a value at some point: nothing yet (the block defining it has not run), that it always holds
+    // the same constant, or that it varies.
+    struct KnownValue {
+        enum class Kind : std::uint8_t { Unknown, Constant, Varying };
+
+        Kind kind = Kind::Unknown;
+        std::int64_t value = 0;
+
+        static KnownValue constant(std::int64_t value) { return { Kind::Constant, value }; }
+        static KnownValue varying() { return { Kind::Varying, 0 }; }
+
+        bool isConstant() const { return kind == Kind::Constant; }
+        bool operator==(const KnownValue &) const = default;
+    };
+
+    static KnownValue Meet(KnownValue a, KnownValue b)
+    {
+        if (a.kind == KnownValue::Kind::Unknown)
+            return b;
+        if (b.kind == KnownValue::Kind::Unknown || a == b)
+            return a;
+        return KnownValue::varying();
+    }
+
+    // MOON encodes immediates in 16 bits, so only those constants can be put back into an instruction
+    static bool FitsImmediate(std::int64_t value)
+    {
+        return value >= std::numeric_limits<std::int16_t>::min() && value <= std::numeric_limits<std::int16_t>::max();
+    }
+
+    // The immediate operand. A label's address is not known here, and a literal too wide for 16 bits is left for the
+    // loader to reject.
+    static KnownValue Immediate(const MoonInstr &instr)
+    {
+        std::int64_t value = instr.imm;
+        if (!instr.sym.empty()) {
+            const char *end = instr.sym.data() + instr.sym.size();
+            auto [ptr, ec] = std::from_chars(instr.sym.data(), end, value);
+            if (ec != std::errc{} || ptr != end)
+                return KnownValue::varying();
+        }
+        return FitsImmediate(value) ? KnownValue::constant(value) : KnownValue::varying();
+    }
+
+    static bool IsRegisterForm(MoonOp op)
+    {
+        return op <= MoonOp::Cge;
+    }
+
+    static bool IsImmediateForm(MoonOp op)
+    {
+        return op >= MoonOp::Addi && op <= MoonOp::Cgei;
+    }
+
+    // The two forms list their operations in the same order
+    static MoonOp ImmediateForm(MoonOp op)
+    {
+        return static_cast<MoonOp>(static_cast<int>(op) - static_cast<int>(MoonOp::Add) + static_cast<int>(MoonOp::Addi));
+    }
+
+    static MoonOp RegisterForm(MoonOp op)
+    {
+        return static_cast<MoonOp>(static_cast<int>(op) - static_cast<int>(MoonOp::Addi) + static_cast<int>(MoonOp::Add));
+    }
+
+    // The operation giving the same result with its operands swapped, if there is one
+    static std::optional<MoonOp> Swapped(MoonOp op)
+    {
+        switch (op) {
+            case MoonOp::Add:
+            case MoonOp::Mul:
+            case MoonOp::And:
+            case MoonOp::Or:
+            case MoonOp::Ceq:
+            case MoonOp::Cne:
+                return op;
+            case MoonOp::Clt:
+                return MoonOp::Cgt;
+            case MoonOp::Cle:
+                return MoonOp::Cge;
+            case MoonOp::Cgt:
+                return MoonOp::Clt;
+            case MoonOp::Cge:
+                return MoonOp::Cle;
+            default:
+                return std::nullopt;
+        }
+    }
+
+    // Evaluates a register-form operation the way the simulator would. Division by zero is left for run time to report,
+    // and results outside 32 bits are left alone, since the simulator's word is as wide as the host's long.
+    static std::optional<std::int64_t> Evaluate(MoonOp op, std::int64_t a, std::int64_t b)
+    {
+        std::int64_t result = 0;
+        switch (op) {
+            case MoonOp::Add:
+                result = a + b;
+                break;
+            case MoonOp::Sub:
+                result = a - b;
+                break;
+            case MoonOp::Mul:
+                result = a * b;
+                break;
+            case MoonOp::Div:
+                if (b == 0)
+                    return std::nullopt;
+                result = a / b;
+                break;
+            case MoonOp::Mod:
+                if (b == 0)
+                    return std::nullopt;
+                result = a % b;
+                break;
+            case MoonOp::And:
+                result = a & b;
+                break;
+            case MoonOp::Or:
+                result = a | b;
+                break;
+            case MoonOp::Ceq:
+                result = a == b;
+                break;
+            case MoonOp::Cne:
+                result = a != b;
+                break;
+            case MoonOp::Clt:
+                result = a < b;
+                break;
+            case MoonOp::Cle:
+                result = a <= b;
+                break;
+            case MoonOp::Cgt:
+                result = a > b;
+                break;
+            case MoonOp::Cge:
+                result = a >= b;
+                break;
+            default:
+                return std::nullopt;
+        }
+        if (result < std::numeric_limits<std::int32_t>::min() || result > std::numeric_limits<std::int32_t>::max())
+            return std::nullopt;
+        return result;
+    }
+
+    // Sparse conditional constant propagation over the blocks. Values written once and read only further down their
+    // own block are recomputed whenever that block is; every other virtual register (the promoted variables) is carried
+    // from block to block, and only along the edges a branch can still take.
+    class ConstantPropagation
+    {
+    public:
+        explicit ConstantPropagation(MachineFunction &func) : m_func(func), m_cfg(func) {}
+
+        bool run()
+        {
+            classifyValues();
+            solve();
+            return rewrite();
+        }
+
+    private:
+        // Beyond this many block entries times carried values the per-block states cost more than they find, and
+        // carried values are taken to vary at every block entry
+        static constexpr std::size_t MAX_STATE_ENTRIES = std::size_t{ 1 } << 22;
+
+        void classifyValues()
+        {
+            const auto &code = m_func.code;
+            const std::size_t count = static_cast<std::size_t>(m_func.nextReg - VREG_BASE);
+            constexpr std::size_t UNSEEN = static_cast<std::size_t>(-1);
+            std::vector<std::size_t> defBlock(count, UNSEEN);
+            m_carried.assign(count, -1);
+
+            auto carry = [&](Reg r) {
+                int &index = m_carried[r - VREG_BASE];
+                if (index < 0)
+                    index = static_cast<int>(m_carriedCount++);
+            };
+
+            for (std::size_t i = 0; i < code.size(); i++) {
+                const std::size_t block = m_cfg.blockOf(i);
+                ForEachUse(code[i], m_func, [&](Reg r) {
+                    if (defBlock[r - VREG_BASE] != block)
+                        carry(r);
+                });
+                if (Reg d = DefOf(code[i]); d != NO_REG) {
+                    if (defBlock[d - VREG_BASE] != UNSEEN)
+                        carry(d);
+                    defBlock[d - VREG_BASE] = block;
+                }
+            }
+
+            m_local.assign(count, {});
+            m_exact = m_cfg.blocks().size() * m_carriedCount <= MAX_STATE_ENTRIES;
+        }
+
+        KnownValue valueOf(Reg r, const std::vector<KnownValue> &state) const
+        {
+            if (r == 0)
+                return KnownValue::constant(0);
+            if (!IsVirtualReg(r))
+                return KnownValue::varying();
+            const int index = m_carried[r - VREG_BASE];
+            return index >= 0 ? state[index] : m_local[r - VREG_BASE];
+        }
+
+        void define(Reg r, KnownValue value, std::vector<KnownValue> &state)
+        {
+            if (!IsVirtualReg(r))
+                return;
+            const int index = m_carried[r - VREG_BASE];
+            if (index >= 0)
+                state[index] = value;
+            else
+                m_local[r - VREG_BASE] = value;
+        }
+
+        KnownValue result(const MoonInstr &instr, const std::vector<KnownValue> &state) const
+        {
+            if (!IsRegisterForm(instr.op) && !IsImmediateForm(instr.op))
+                return KnownValue::varying();
+
+            const KnownValue lhs = valueOf(instr.rs, state);
+            const KnownValue rhs = IsRegisterForm(instr.op) ? valueOf(instr.rt, state) : Immediate(instr);
+            if (lhs.kind == KnownValue::Kind::Varying || rhs.kind == KnownValue::Kind::Varying)
+                return KnownValue::varying();
+            if (!lhs.isConstant() || !rhs.isConstant())
+                return {};
+            const MoonOp op = IsRegisterForm(instr.op) ? instr.op : RegisterForm(instr.op);
+            const auto value = Evaluate(op, lhs.value, rhs.value);
+            return value ? KnownValue::constant(*value) : KnownValue::varying();
+        }
+
+        // The value of the branch condition, when the block ends in a conditional branch
+        KnownValue condition(std::size_t b, const std::vector<KnownValue> &state) const
+        {
+            const MoonInstr &last = m_func.code[m_cfg.blocks()[b].last];
+            if (last.op != MoonOp::Bz && last.op != MoonOp::Bnz)
+                return KnownValue::varying();
+            return valueOf(last.rs, state);
+        }
+
+        // Runs the block from its entry state, leaving its exit state in `state`
+        void transfer(std::size_t b, std::vector<KnownValue> &state)
+        {
+            const BasicBlock &block = m_cfg.blocks()[b];
+            for (std::size_t i = block.first; i <= block.last; i++) {
+                const MoonInstr &instr = m_func.code[i];
+                if (IsVirtualReg(instr.rd))
+                    define(instr.rd, result(instr, state), state);
+            }
+        }
+
+        void solve()
+        {
+            const auto &blocks = m_cfg.blocks();
+            m_entry.assign(m_exact ? blocks.size() * m_carriedCount : 0, {});
+            m_executable.assign(blocks.size(), 0);
+            if (blocks.empty())
+                return;
+
+            std::vector<std::size_t> worklist{ 0 };
+            std::vector<char> queued(blocks.size(), 0);
+            m_executable[0] = queued[0] = 1;
+            std::vector<KnownValue> state;
+
+            while (!worklist.empty()) {
+                const std::size_t b = worklist.back();
+                worklist.pop_back();
+                queued[b] = 0;
+
+                entryState(b, state);
+                transfer(b, state);
+
+                const KnownValue cond = condition(b, state);
+                const MoonInstr &last = m_func.code[blocks[b].last];
+                for (std::size_t s : blocks[b].succs) {
+                    if (cond.kind == KnownValue::Kind::Unknown)
+                        continue;
+                    if (cond.isConstant()) {
+                        const bool taken = (last.op == MoonOp::Bz) == (cond.value == 0);
+                        const std::size_t target = m_cfg.target(last.sym);
+                        const bool isTarget = target != ControlFlowGraph::NO_TARGET && s == m_cfg.blockOf(target);
+                        const bool isFallThrough = s == b + 1;
+                        if (!(taken ? isTarget : isFallThrough))
+                            continue;
+                    }
+
+                    bool changed = !m_executable[s];
+                    m_executable[s] = 1;
+                    if (m_exact) {
+                        KnownValue *entry = m_entry.data() + s * m_carriedCount;
+                        for (std::size_t v = 0; v < m_carriedCount; v++) {
+                            const KnownValue met = Meet(entry[v], state[v]);
+                            changed |= met != entry[v];
+                            entry[v] = met;
+                        }
+                    }
+                    if (changed && !queued[s]) {
+                        queued[s] = 1;
+                        worklist.push_back(s);
+                    }
+                }
+            }
+        }
+
+        void entryState(std::size_t b, std::vector<KnownValue> &state) const
+        {
+            if (m_exact)
+                state.assign(m_entry.begin() + b * m_carriedCount, m_entry.begin() + (b + 1) * m_carriedCount);
+            else
+                state.assign(m_carriedCount, b == 0 ? KnownValue{} : KnownValue::varying());
+        }
+
+        // Replaces what the solution proved constant: whole computations by the constant, constant operands by
+        // immediates, and branches that always go the same way by a jump or by nothing.
+        bool rewrite()
+        {
+            auto &code = m_func.code;
+            const auto &blocks = m_cfg.blocks();
+            bool changed = false;
+            std::vector<char> removed(code.size(), 0);
+            std::vector<KnownValue> state;
+
+            for (std::size_t b = 0; b < blocks.size(); b++) {
+                if (!m_executable[b])
+                    continue;
+                entryState(b, state);
+                for (std::size_t i = blocks[b].first; i <= blocks[b].last; i++) {
+                    MoonInstr &instr = code[i];
+
+                    if (instr.op == MoonOp::Bz || instr.op == MoonOp::Bnz) {
+                        const KnownValue cond = valueOf(instr.rs, state);
+                        if (!cond.isConstant())
+                            continue;
+                        changed = true;
+                        if ((instr.op == MoonOp::Bz) == (cond.value == 0)) {
+                            instr.op = MoonOp::J;
+                            instr.rs = NO_REG;
+                        } else if (instr.label.empty()) {
+                            removed[i] = 1;
+                        } else {
+                            instr = { .op = MoonOp::Add, .rd = 0, .rs = 0, .rt = 0, .label = std::move(instr.label), .comment = std::move(instr.comment) };
+                        }
+                        continue;
+                    }
+
+                    if (!IsVirtualReg(instr.rd))
+                        continue;
+                    const KnownValue value = result(instr, state);
+                    changed |= simplify(instr, value, state);
+                    define(instr.rd, value, state);
+                }
+            }
+
+            if (changed)
+                std::erase_if(code, [&](const MoonInstr &instr) { return removed[&instr - code.data()]; });
+            return changed;
+        }
+
+        bool simplify(MoonInstr &instr, KnownValue value, const std::vector<KnownValue> &state) const
+        {
+            if (value.isConstant() && FitsImmediate(value.value)) {
+                if (instr.op == MoonOp::Addi && instr.rs == 0)
+                    return false;
+                instr.op = MoonOp::Addi;
+                instr.rs = 0;
+                instr.rt = NO_REG;
+                instr.imm = static_cast<int>(value.value);
+                instr.sym.clear();
+                return true;
+            }
+            if (!IsRegisterForm(instr.op))
+                return false;
+
+            const KnownValue lhs = valueOf(instr.rs, state);
+            const KnownValue rhs = valueOf(instr.rt, state);
+            if (rhs.isConstant() && FitsImmediate(rhs.value) && instr.rt != 0) {
+                instr.op = ImmediateForm(instr.op);
+                instr.rt = NO_REG;
+                instr.imm = static_cast<int>(rhs.value);
+                return true;
+            }
+            const auto swapped = Swapped(instr.op);
+            if (swapped && lhs.isConstant() && FitsImmediate(lhs.value) && instr.rs != 0) {
+                instr.op = ImmediateForm(*swapped);
+                instr.rs = instr.rt;
+                instr.rt = NO_REG;
+                instr.imm = static_cast<int>(lhs.value);
+                return true;
+            }
+            return false;
+        }
+
+        MachineFunction &m_func;
+        const ControlFlowGraph m_cfg;
+
+        // Index among the values carried between blocks, or -1 for a value local to its block
+        std::vector<int> m_carried;
+        std::size_t m_carriedCount = 0;
+        std::vector<KnownValue> m_local;
+        bool m_exact = true;
+
+        std::vector<KnownValue> m_entry;
+        std::vector<char> m_executable;
+    };
+
+    bool ConstantFoldingPass::run(MachineFunction &func)
+    {
+        return ConstantPropagation(func).run();
+    }
+} // namespace lang
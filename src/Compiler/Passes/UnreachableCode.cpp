@@ -0,0 +1,27 @@
+#include "../Passes.hpp"
+#include "Compiler/ControlFlowGraph.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace lang
+{
+    // Verbatim lines are kept wherever they are, since they may be directives or layout rather than code.
+    bool UnreachableCodePass::run(MachineFunction &func)
+    {
+        const ControlFlowGraph cfg(func);
+        const std::vector<char> reachable = cfg.reachable();
+        if (std::ranges::find(reachable, 0) == reachable.end())
+            return false;
+
+        std::vector<MoonInstr> kept;
+        kept.reserve(func.code.size());
+        for (std::size_t i = 0; i < func.code.size(); i++) {
+            if (reachable[cfg.blockOf(i)] || func.code[i].op == MoonOp::Text)
+                kept.push_back(std::move(func.code[i]));
+        }
+        const bool changed = kept.size() != func.code.size();
+        func.code = std::move(kept);
+        return changed;
+    }
+} // namespace lang
@@ -0,0 +1,496 @@
+#include "Peephole.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+
+#include "Compiler/ControlFlowGraph.hpp"
+
+namespace lang
+{
+    static constexpr std::size_t NONE = static_cast<std::size_t>(-1);
+    static constexpr std::uint32_t ALL_REGS = 0xfffe; // r1-r15
+    static constexpr int MAX_SWEEPS = 8;
+    static constexpr int MAX_HOPS = 16;
+
+    static std::uint32_t Bit(Reg r)
+    {
+        return r > 0 ? 1u << r : 0;
+    }
+
+    // Registers an allocated instruction reads and writes. A callee reads its frame through r14 and an I/O helper its
+    // argument in r1; what a callee writes is left out, which only makes more registers look live.
+    static void UsesAndDefs(const MoonInstr &instr, std::uint32_t &uses, std::uint32_t &defs)
+    {
+        uses = defs = 0;
+        switch (instr.op) {
+            case MoonOp::Text:
+            case MoonOp::J:
+            case MoonOp::Hlt:
+                return;
+            case MoonOp::Sw:
+            case MoonOp::Bz:
+            case MoonOp::Bnz:
+            case MoonOp::Putc:
+                uses = Bit(instr.rs) | Bit(instr.rt);
+                return;
+            case MoonOp::Jl:
+                uses = Bit(1) | Bit(14);
+                defs = Bit(instr.rd);
+                return;
+            case MoonOp::Jr:
+                uses = ALL_REGS;
+                return;
+            default:
+                uses = Bit(instr.rs) | Bit(instr.rt);
+                defs = Bit(instr.rd);
+                return;
+        }
+    }
+
+    static bool IsPad(const MoonInstr &instr)
+    {
+        return instr.op == MoonOp::Add && instr.rd == 0 && instr.rs == 0 && instr.rt == 0;
+    }
+
+    static bool IsBranch(const MoonInstr &instr)
+    {
+        return instr.op == MoonOp::J || instr.op == MoonOp::Bz || instr.op == MoonOp::Bnz;
+    }
+
+    static bool SameAddress(const MoonInstr &a, const MoonInstr &b)
+    {
+        return a.rs == b.rs && a.imm == b.imm && a.sym == b.sym;
+    }
+
+    static bool FitsImmediate(long long value)
+    {
+        return value >= std::numeric_limits<std::int16_t>::min() && value <= std::numeric_limits<std::int16_t>::max();
+    }
+
+    static MoonInstr Move(Reg to, Reg from, std::string comment)
+    {
+        return { .op = MoonOp::Add, .rd = to, .rs = from, .rt = 0, .comment = std::move(comment) };
+    }
+
+    // The code of one function during a sweep. Removed instructions stay in place, marked, until the sweep ends, and
+    // labels of removed instructions either move to the next one or become aliases of its label.
+    class PeepholeWindow
+    {
+    public:
+        explicit PeepholeWindow(MachineFunction &func) : code(func.code), removed(func.code.size(), 0)
+        {
+            for (std::size_t i = 0; i < code.size(); i++) {
+                if (!code[i].label.empty())
+                    m_labels.try_emplace(code[i].label, i);
+            }
+            computeLiveness(func);
+        }
+
+        std::vector<MoonInstr> &code;
+        std::vector<char> removed;
+
+        // The next instruction still in the code. Verbatim lines are not skipped, so no rule looks past a directive.
+        std::size_t next(std::size_t i) const
+        {
+            for (i++; i < code.size(); i++) {
+                if (!removed[i])
+                    return i;
+            }
+            return NONE;
+        }
+
+        // The first instruction doing something at or after `i`
+        std::size_t skipNoOps(std::size_t i) const
+        {
+            for (; i < code.size(); i++) {
+                if (!removed[i] && !IsPad(code[i]) && code[i].op != MoonOp::Text)
+                    return i;
+            }
+            return NONE;
+        }
+
+        // Where a branch to `label` ends up doing something, or NONE for a label outside the function
+        std::size_t landing(const std::string &label) const
+        {
+            auto it = m_labels.find(resolve(label));
+            return it == m_labels.end() ? NONE : skipNoOps(it->second);
+        }
+
+        bool deadAfter(Reg r, std::size_t i) const { return r > 0 && !(m_liveAfter[i] & Bit(r)); }
+
+        void remove(std::size_t i) { removed[i] = 1; }
+
+        // Removes an instruction, handing its label to the next one. Fails when there is no next instruction to take it.
+        bool removeKeepingLabel(std::size_t i)
+        {
+            if (code[i].label.empty()) {
+                remove(i);
+                return true;
+            }
+            const std::size_t n = next(i);
+            if (n == NONE || code[n].op == MoonOp::Text)
+                return false;
+            if (code[n].label.empty()) {
+                m_labels[code[i].label] = n;
+                code[n].label = std::move(code[i].label);
+            } else {
+                m_aliases[code[i].label] = code[n].label;
+            }
+            code[i].label.clear();
+            remove(i);
+            return true;
+        }
+
+        // Drops the removed instructions and points every branch at a label that still exists
+        void finish()
+        {
+            std::size_t kept = 0;
+            for (std::size_t i = 0; i < code.size(); i++) {
+                if (removed[i])
+                    continue;
+                if (IsBranch(code[i]))
+                    code[i].sym = resolve(code[i].sym);
+                if (kept != i)
+                    code[kept] = std::move(code[i]);
+                kept++;
+            }
+            code.resize(kept);
+        }
+
+    private:
+        std::string resolve(std::string label) const
+        {
+            for (auto it = m_aliases.find(label); it != m_aliases.end(); it = m_aliases.find(label)) label = it->second;
+            return label;
+        }
+
+        void computeLiveness(const MachineFunction &func)
+        {
+            const ControlFlowGraph cfg(func);
+            const auto &blocks = cfg.blocks();
+            std::vector<std::uint32_t> gen(blocks.size(), 0);
+            std::vector<std::uint32_t> kill(blocks.size(), 0);
+            std::vector<std::uint32_t> liveIn(blocks.size(), 0);
+            std::vector<std::uint32_t> liveOut(blocks.size(), 0);
+
+            for (std::size_t b = 0; b < blocks.size(); b++) {
+                for (std::size_t i = blocks[b].last + 1; i-- > blocks[b].first;) {
+                    std::uint32_t uses, defs;
+                    UsesAndDefs(code[i], uses, defs);
+                    gen[b] = uses | (gen[b] & ~defs);
+                    kill[b] |= defs;
+                }
+            }
+
+            for (bool changed = true; changed;) {
+                changed = false;
+                for (std::size_t b = blocks.size(); b-- > 0;) {
+                    std::uint32_t out = 0;
+                    for (std::size_t s : blocks[b].succs) out |= liveIn[s];
+                    const std::uint32_t in = gen[b] | (out & ~kill[b]);
+                    changed |= in != liveIn[b];
+                    liveOut[b] = out;
+                    liveIn[b] = in;
+                }
+            }
+
+            m_liveAfter.assign(code.size(), 0);
+            for (std::size_t b = 0; b < blocks.size(); b++) {
+                std::uint32_t live = liveOut[b];
+                for (std::size_t i = blocks[b].last + 1; i-- > blocks[b].first;) {
+                    m_liveAfter[i] = live;
+                    std::uint32_t uses, defs;
+                    UsesAndDefs(code[i], uses, defs);
+                    live = uses | (live & ~defs);
+                }
+            }
+        }
+
+        std::unordered_map<std::string, std::size_t> m_labels;
+        std::unordered_map<std::string, std::string> m_aliases;
+        std::vector<std::uint32_t> m_liveAfter;
+    };
+
+    // add r0,r0,r0 only exists to carry a label for the instruction after it
+    static bool DropLabelPad(PeepholeWindow &w, std::size_t at)
+    {
+        if (!IsPad(w.code[at]))
+            return false;
+        return w.removeKeepingLabel(at);
+    }
+
+    // add rX,rY,r0, addi rX,rY,0, muli rX,rY,1 and the like copy rY, or do nothing when rX is rY
+    static bool SimplifyIdentity(PeepholeWindow &w, std::size_t at)
+    {
+        MoonInstr &instr = w.code[at];
+        if (instr.rd <= 0)
+            return false;
+
+        Reg copied = NO_REG;
+        switch (instr.op) {
+            case MoonOp::Add:
+                if (instr.rt == 0)
+                    copied = instr.rs;
+                else if (instr.rs == 0)
+                    copied = instr.rt;
+                break;
+            case MoonOp::Sub:
+            case MoonOp::Or:
+                if (instr.rt == 0)
+                    copied = instr.rs;
+                break;
+            case MoonOp::Addi:
+            case MoonOp::Subi:
+            case MoonOp::Ori:
+                if (instr.sym.empty() && instr.imm == 0)
+                    copied = instr.rs;
+                break;
+            case MoonOp::Muli:
+            case MoonOp::Divi:
+                if (instr.sym.empty() && instr.imm == 1)
+                    copied = instr.rs;
+                break;
+            default:
+                break;
+        }
+
+        if (copied == NO_REG)
+            return false;
+        if (copied == instr.rd)
+            return w.removeKeepingLabel(at);
+        if (instr.op == MoonOp::Add && instr.rt == 0)
+            return false;
+        std::string label = std::move(instr.label);
+        instr = Move(instr.rd, copied, std::move(instr.comment));
+        instr.label = std::move(label);
+        return true;
+    }
+
+    // muli rX,rX,2^k shifts rX left in place
+    static bool MultiplyToShift(PeepholeWindow &w, std::size_t at)
+    {
+        MoonInstr &instr = w.code[at];
+        if (instr.op != MoonOp::Muli || instr.rd != instr.rs || instr.rd <= 0 || !instr.sym.empty() || instr.imm < 2 || !std::has_single_bit(static_cast<unsigned>(instr.imm)))
+            return false;
+        instr.op = MoonOp::Sl;
+        instr.imm = std::countr_zero(static_cast<unsigned>(instr.imm));
+        return true;
+    }
+
+    // A load right after a store to the same word takes the stored register instead
+    static bool ForwardStoreToLoad(PeepholeWindow &w, std::size_t at)
+    {
+        const MoonInstr &store = w.code[at];
+        const std::size_t l = w.next(at);
+        if (store.op != MoonOp::Sw || l == NONE)
+            return false;
+        MoonInstr &load = w.code[l];
+        if (load.op != MoonOp::Lw || !load.label.empty() || !SameAddress(store, load))
+            return false;
+        if (load.rd == store.rt)
+            w.remove(l);
+        else
+            load = Move(load.rd, store.rt, std::move(load.comment));
+        return true;
+    }
+
+    // Storing back the value just loaded from the same word changes nothing
+    static bool DropStoreOfLoad(PeepholeWindow &w, std::size_t at)
+    {
+        const MoonInstr &load = w.code[at];
+        const std::size_t s = w.next(at);
+        if (load.op != MoonOp::Lw || s == NONE || load.rd == load.rs)
+            return false;
+        const MoonInstr &store = w.code[s];
+        if (store.op != MoonOp::Sw || !store.label.empty() || store.rt != load.rd || !SameAddress(load, store))
+            return false;
+        w.remove(s);
+        return true;
+    }
+
+    // Loading the same word twice in a row reads memory once. When only the second load's register is read later, the
+    // first load takes it over; a copy would read a register the liveness of this sweep still thinks dead.
+    static bool ReuseLoad(PeepholeWindow &w, std::size_t at)
+    {
+        MoonInstr &first = w.code[at];
+        const std::size_t s = w.next(at);
+        if (first.op != MoonOp::Lw || s == NONE || first.rd == first.rs)
+            return false;
+        MoonInstr &second = w.code[s];
+        if (second.op != MoonOp::Lw || !second.label.empty() || !SameAddress(first, second))
+            return false;
+        if (second.rd == first.rd || w.deadAfter(first.rd, at)) {
+            first.rd = second.rd;
+            w.remove(s);
+        } else {
+            second = Move(second.rd, first.rd, std::move(second.comment));
+        }
+        return true;
+    }
+
+    // addi rA,rB,K followed by an access at J(rA) accesses K+J(rB) directly, when nothing else needs rA
+    static bool FoldAddressOffset(PeepholeWindow &w, std::size_t at)
+    {
+        const MoonInstr &add = w.code[at];
+        const std::size_t m = w.next(at);
+        if (add.op != MoonOp::Addi || !add.sym.empty() || add.rd <= 0 || m == NONE)
+            return false;
+        MoonInstr &access = w.code[m];
+        if ((access.op != MoonOp::Lw && access.op != MoonOp::Sw) || access.rs != add.rd || !access.sym.empty() || !access.label.empty())
+            return false;
+        if (!FitsImmediate(static_cast<long long>(add.imm) + access.imm))
+            return false;
+        if (access.op == MoonOp::Sw && access.rt == add.rd)
+            return false;
+        const bool overwritten = access.op == MoonOp::Lw && access.rd == add.rd;
+        if (!overwritten && !w.deadAfter(add.rd, m))
+            return false;
+        const Reg base = add.rs;
+        const int offset = add.imm;
+        if (!w.removeKeepingLabel(at))
+            return false;
+        access.rs = base;
+        access.imm += offset;
+        return true;
+    }
+
+    // cnei rX,rY,0 or ceqi rX,rY,0 only feeding a bz/bnz on rX: the branch can test rY itself
+    static bool FuseCompareBranch(PeepholeWindow &w, std::size_t at)
+    {
+        const MoonInstr &cmp = w.code[at];
+        Reg tested = NO_REG;
+        if ((cmp.op == MoonOp::Cnei || cmp.op == MoonOp::Ceqi) && cmp.sym.empty() && cmp.imm == 0)
+            tested = cmp.rs;
+        else if ((cmp.op == MoonOp::Cne || cmp.op == MoonOp::Ceq) && (cmp.rs == 0 || cmp.rt == 0))
+            tested = cmp.rt == 0 ? cmp.rs : cmp.rt;
+        else
+            return false;
+
+        const std::size_t b = w.next(at);
+        if (cmp.rd <= 0 || b == NONE)
+            return false;
+        MoonInstr &branch = w.code[b];
+        if ((branch.op != MoonOp::Bz && branch.op != MoonOp::Bnz) || branch.rs != cmp.rd || !branch.label.empty() || !w.deadAfter(cmp.rd, b))
+            return false;
+
+        const bool negated = cmp.op == MoonOp::Ceqi || cmp.op == MoonOp::Ceq;
+        if (!w.removeKeepingLabel(at))
+            return false;
+        if (negated)
+            branch.op = branch.op == MoonOp::Bz ? MoonOp::Bnz : MoonOp::Bz;
+        branch.rs = tested;
+        return true;
+    }
+
+    // A branch to a jump goes straight to where that jump goes
+    static bool ThreadJump(PeepholeWindow &w, std::size_t at)
+    {
+        MoonInstr &branch = w.code[at];
+        if (!IsBranch(branch))
+            return false;
+
+        std::string target = branch.sym;
+        for (int hops = 0; hops < MAX_HOPS; hops++) {
+            const std::size_t t = w.landing(target);
+            if (t == NONE || t == at || w.code[t].op != MoonOp::J || w.code[t].sym == target)
+                break;
+            target = w.code[t].sym;
+        }
+        if (target == branch.sym)
+            return false;
+        branch.sym = std::move(target);
+        return true;
+    }
+
+    // A branch to where execution would continue anyway
+    static bool DropJumpToNext(PeepholeWindow &w, std::size_t at)
+    {
+        if (!IsBranch(w.code[at]))
+            return false;
+        const std::size_t t = w.landing(w.code[at].sym);
+        if (t == NONE || t != w.skipNoOps(at + 1))
+            return false;
+        return w.removeKeepingLabel(at);
+    }
+
+    // A computation or load whose register nothing reads afterwards
+    static bool DropDeadDef(PeepholeWindow &w, std::size_t at)
+    {
+        const MoonInstr &instr = w.code[at];
+        if (!IsPure(instr.op) || instr.rd <= 0 || !w.deadAfter(instr.rd, at))
+            return false;
+        return w.removeKeepingLabel(at);
+    }
+
+    static const PeepholeOptimizer::Rule RULES[] = {
+        { "label-pad", DropLabelPad },
+        { "identity", SimplifyIdentity },
+        { "shift", MultiplyToShift },
+        { "store-load", ForwardStoreToLoad },
+        { "load-store", DropStoreOfLoad },
+        { "load-load", ReuseLoad },
+        { "address-offset", FoldAddressOffset },
+        { "compare-branch", FuseCompareBranch },
+        { "jump-thread", ThreadJump },
+        { "jump-next", DropJumpToNext },
+        { "dead-code", DropDeadDef },
+    };
+
+    PeepholeOptimizer::PeepholeOptimizer()
+    {
+        for (const Rule &rule : RULES) m_rules.push_back({ rule });
+    }
+
+    void PeepholeOptimizer::disable(std::string_view name)
+    {
+        if (name == "peephole")
+            m_enabled = false;
+        for (auto &entry : m_rules) {
+            if (entry.rule.name == name)
+                entry.enabled = false;
+        }
+    }
+
+    bool PeepholeOptimizer::HasRule(std::string_view name)
+    {
+        return name == "peephole" || std::ranges::any_of(RULES, [&](const Rule &rule) { return rule.name == name; });
+    }
+
+    void PeepholeOptimizer::run(MachineFunction &func)
+    {
+        if (!m_enabled)
+            return;
+
+        for (int sweep = 0; sweep < MAX_SWEEPS; sweep++) {
+            PeepholeWindow window(func);
+            bool changed = false;
+            for (std::size_t i = 0; i < func.code.size(); i++) {
+                for (auto &entry : m_rules) {
+                    if (window.removed[i])
+                        break;
+                    if (entry.enabled && entry.rule.apply(window, i)) {
+                        entry.hits++;
+                        changed = true;
+                    }
+                }
+            }
+            window.finish();
+            if (!changed)
+                break;
+        }
+    }
+
+    void PeepholeOptimizer::printStats(OutputBuffer &out) const
+    {
+        for (const auto &entry : m_rules) {
+            if (!m_enabled || !entry.enabled)
+                out.appendLine("% peephole {}: disabled", entry.rule.name);
+            else
+                out.appendLine("% peephole {}: {} hit(s)", entry.rule.name, entry.hits);
+        }
+    }
+} // namespace lang
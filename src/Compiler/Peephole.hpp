@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "Compiler/MoonInstr.hpp"
+#include "Compiler/OutputBuffer.hpp"
+
+namespace lang
+{
+    class PeepholeWindow;
+
+    // Local rewrites of a function once its registers are assigned. Every rule looks at one instruction and the one or
+    // two after it; the rules are tried in table order at each instruction, and the function is swept again until a
+    // sweep changes nothing.
+    class PeepholeOptimizer
+    {
+    public:
+        struct Rule {
+            std::string_view name;
+            // Tries the rule at instruction `at`; returns whether it rewrote anything
+            bool (*apply)(PeepholeWindow &window, std::size_t at);
+        };
+
+        PeepholeOptimizer();
+
+        // "peephole" turns every rule off, the name of a rule only that rule
+        void disable(std::string_view name);
+        void run(MachineFunction &func);
+
+        // Whether disable() knows the name
+        static bool HasRule(std::string_view name);
+
+        // One comment line per rule with how often it applied, for the end of the --dump-ir output
+        void printStats(OutputBuffer &out) const;
+
+    private:
+        struct Entry {
+            Rule rule;
+            bool enabled = true;
+            std::size_t hits = 0;
+        };
+
+        std::vector<Entry> m_rules;
+        bool m_enabled = true;
+    };
+} // namespace lang
@@ -0,0 +1,515 @@
+#include "RegisterAllocator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <deque>
+#include <format>
+#include <functional>
+#include <queue>
+
+namespace lang
+{
+    static constexpr Reg STACK_REG = 14;
+    static constexpr Reg LINK_REG = 15;
+    static constexpr Reg RETURN_REG = 13;
+    static constexpr Reg HELPER_REG = 1;
+    static constexpr Reg LAST_HELPER_CLOBBER = 6;
+    static constexpr std::size_t WORD_BITS = 64;
+
+    static std::size_t ValueIndex(Reg r)
+    {
+        return static_cast<std::size_t>(r - VREG_BASE);
+    }
+
+    static bool TestBit(const std::uint64_t *bits, std::size_t i)
+    {
+        return (bits[i / WORD_BITS] >> (i % WORD_BITS)) & 1;
+    }
+
+    static void SetBit(std::uint64_t *bits, std::size_t i)
+    {
+        bits[i / WORD_BITS] |= std::uint64_t{ 1 } << (i % WORD_BITS);
+    }
+
+    static void ClearBit(std::uint64_t *bits, std::size_t i)
+    {
+        bits[i / WORD_BITS] &= ~(std::uint64_t{ 1 } << (i % WORD_BITS));
+    }
+
+    RegisterAllocator::RegisterAllocator(MachineFunction &func) : m_func(func), m_cfg(func) {}
+
+    void RegisterAllocator::run()
+    {
+        computeLoopWeights();
+        classifyValues();
+        solveLiveness();
+        removeDeadCode();
+        buildIntervals();
+        linearScan();
+        assignSpillSlots();
+        rewrite();
+    }
+
+    // Loop depth comes from the backward branches: every instruction between a target and a branch back to it is in the loop.
+    void RegisterAllocator::computeLoopWeights()
+    {
+        const auto &code = m_func.code;
+        std::vector<int> depth(code.size() + 1, 0);
+        for (std::size_t i = 0; i < code.size(); i++) {
+            const MoonOp op = code[i].op;
+            if (op != MoonOp::Bz && op != MoonOp::Bnz && op != MoonOp::J)
+                continue;
+            if (std::size_t target = m_cfg.target(code[i].sym); target <= i) {
+                depth[target]++;
+                depth[i + 1]--;
+            }
+        }
+        for (std::size_t i = 1; i < depth.size(); i++) depth[i] += depth[i - 1];
+
+        static constexpr std::array<std::uint64_t, 5> LOOP_WEIGHTS = { 1, 10, 100, 1000, 10000 };
+        m_weightAt.resize(code.size());
+        for (std::size_t i = 0; i < code.size(); i++) m_weightAt[i] = LOOP_WEIGHTS[std::min<std::size_t>(depth[i], LOOP_WEIGHTS.size() - 1)];
+    }
+
+    // A value is a temporary when it is written once, before it is read, and never leaves the block that writes it; its
+    // interval is then exactly where it is live. Anything else takes part in the liveness solve.
+    void RegisterAllocator::classifyValues()
+    {
+        constexpr std::size_t UNSEEN = static_cast<std::size_t>(-1);
+        std::vector<std::size_t> home(valueCount(), UNSEEN);
+        m_globalIndex.assign(valueCount(), -1);
+
+        auto makeGlobal = [&](Reg r) {
+            int &index = m_globalIndex[ValueIndex(r)];
+            if (index < 0) {
+                index = static_cast<int>(m_globals.size());
+                m_globals.push_back(r);
+            }
+        };
+
+        for (std::size_t i = 0; i < m_func.code.size(); i++) {
+            const MoonInstr &instr = m_func.code[i];
+            ForEachUse(instr, m_func, [&](Reg r) {
+                std::size_t &block = home[ValueIndex(r)];
+                if (block != m_cfg.blockOf(i))
+                    makeGlobal(r);
+                if (block == UNSEEN)
+                    block = m_cfg.blockOf(i);
+            });
+            if (Reg d = DefOf(instr); d != NO_REG) {
+                std::size_t &block = home[ValueIndex(d)];
+                if (block == UNSEEN)
+                    block = m_cfg.blockOf(i);
+                else
+                    makeGlobal(d);
+            }
+        }
+
+        m_words = (m_globals.size() + WORD_BITS - 1) / WORD_BITS;
+    }
+
+    // Backward liveness of the cross-block values, with a worklist so each block is revisited only when a successor's
+    // live-in set grows.
+    void RegisterAllocator::solveLiveness()
+    {
+        const auto &blocks = m_cfg.blocks();
+        const std::size_t blockCount = blocks.size();
+        m_liveIn.assign(blockCount * m_words, 0);
+        m_liveOut.assign(blockCount * m_words, 0);
+        if (m_words == 0)
+            return;
+
+        std::vector<Word> gen(blockCount * m_words, 0);
+        std::vector<Word> kill(blockCount * m_words, 0);
+        for (std::size_t b = 0; b < blockCount; b++) {
+            Word *g = gen.data() + b * m_words;
+            Word *k = kill.data() + b * m_words;
+            for (std::size_t i = blocks[b].first; i <= blocks[b].last; i++) {
+                const MoonInstr &instr = m_func.code[i];
+                ForEachUse(instr, m_func, [&](Reg r) {
+                    if (int index = m_globalIndex[ValueIndex(r)]; index >= 0 && !TestBit(k, index))
+                        SetBit(g, index);
+                });
+                if (Reg d = DefOf(instr); d != NO_REG && m_globalIndex[ValueIndex(d)] >= 0)
+                    SetBit(k, m_globalIndex[ValueIndex(d)]);
+            }
+        }
+
+        std::deque<std::size_t> worklist;
+        std::vector<char> queued(blockCount, 1);
+        for (std::size_t b = blockCount; b-- > 0;) worklist.push_back(b);
+
+        std::vector<Word> in(m_words);
+        while (!worklist.empty()) {
+            const std::size_t b = worklist.front();
+            worklist.pop_front();
+            queued[b] = 0;
+
+            Word *out = liveOut(b);
+            for (std::size_t s : blocks[b].succs) {
+                const Word *succIn = liveIn(s);
+                for (std::size_t w = 0; w < m_words; w++) out[w] |= succIn[w];
+            }
+
+            const Word *g = gen.data() + b * m_words;
+            const Word *k = kill.data() + b * m_words;
+            Word *current = liveIn(b);
+            bool changed = false;
+            for (std::size_t w = 0; w < m_words; w++) {
+                in[w] = g[w] | (out[w] & ~k[w]);
+                changed |= in[w] != current[w];
+                current[w] = in[w];
+            }
+
+            if (!changed)
+                continue;
+            for (std::size_t p : blocks[b].preds) {
+                if (!queued[p]) {
+                    queued[p] = 1;
+                    worklist.push_back(p);
+                }
+            }
+        }
+    }
+
+    // Drops computations whose result is never read, such as the initial load of a variable assigned before its first
+    // use, and forgets the result of calls made only for their effect.
+    void RegisterAllocator::removeDeadCode()
+    {
+        auto &code = m_func.code;
+        m_dead.assign(code.size(), 0);
+        std::vector<char> tempLive(valueCount(), 0);
+        std::vector<Word> live(m_words);
+        m_liveAcross.assign(m_func.calls.size() * m_words, 0);
+        m_helpersCrossed.assign(m_globals.size(), 0);
+        m_functionsCrossed.assign(m_globals.size(), 0);
+
+        const auto &blocks = m_cfg.blocks();
+        for (std::size_t b = 0; b < blocks.size(); b++) {
+            std::copy_n(liveOut(b), m_words, live.begin());
+            for (std::size_t i = blocks[b].last + 1; i-- > blocks[b].first;) {
+                MoonInstr &instr = code[i];
+                if (Reg d = DefOf(instr); d != NO_REG) {
+                    const int index = m_globalIndex[ValueIndex(d)];
+                    const bool isLive = index >= 0 ? TestBit(live.data(), index) : tempLive[ValueIndex(d)];
+                    if (!isLive && IsPure(instr.op)) {
+                        m_dead[i] = 1;
+                        continue;
+                    }
+                    if (!isLive)
+                        instr.rd = NO_REG;
+                    if (index >= 0)
+                        ClearBit(live.data(), index);
+                    else
+                        tempLive[ValueIndex(d)] = 0;
+                }
+                if (instr.op == MoonOp::Call)
+                    recordCallCrossings(i, live.data());
+                ForEachUse(instr, m_func, [&](Reg r) {
+                    if (int index = m_globalIndex[ValueIndex(r)]; index >= 0)
+                        SetBit(live.data(), index);
+                    else
+                        tempLive[ValueIndex(r)] = 1;
+                });
+            }
+        }
+    }
+
+    // The cross-block values still needed after a call, and what crossing calls costs each of them
+    void RegisterAllocator::recordCallCrossings(std::size_t at, const Word *live)
+    {
+        const int index = m_func.code[at].imm;
+        std::copy_n(live, m_words, m_liveAcross.data() + index * m_words);
+        auto &crossed = m_func.calls[index].helper ? m_helpersCrossed : m_functionsCrossed;
+        for (std::size_t w = 0; w < m_words; w++) {
+            for (Word bits = live[w]; bits; bits &= bits - 1) crossed[w * WORD_BITS + std::countr_zero(bits)] += m_weightAt[at];
+        }
+    }
+
+    void RegisterAllocator::buildIntervals()
+    {
+        const auto &code = m_func.code;
+        m_intervalOf.assign(valueCount(), -1);
+        auto touch = [&](Reg r, std::size_t from, std::size_t to, std::uint64_t weight) {
+            int &index = m_intervalOf[ValueIndex(r)];
+            if (index < 0) {
+                index = static_cast<int>(m_intervals.size());
+                m_intervals.push_back({ r, from, to });
+            }
+            Interval &interval = m_intervals[index];
+            interval.start = std::min(interval.start, from);
+            interval.end = std::max(interval.end, to);
+            interval.weight += weight;
+        };
+
+        for (std::size_t i = 0; i < code.size(); i++) {
+            if (m_dead[i])
+                continue;
+            ForEachUse(code[i], m_func, [&](Reg r) { touch(r, i, i, m_weightAt[i]); });
+            if (Reg d = DefOf(code[i]); d != NO_REG)
+                touch(d, i, i, m_weightAt[i]);
+        }
+
+        const auto &blocks = m_cfg.blocks();
+        for (std::size_t b = 0; b < blocks.size(); b++) {
+            const Word *in = liveIn(b);
+            const Word *out = liveOut(b);
+            for (std::size_t g = 0; g < m_globals.size(); g++) {
+                if (TestBit(in, g))
+                    touch(m_globals[g], blocks[b].first, blocks[b].first, 0);
+                if (TestBit(out, g))
+                    touch(m_globals[g], blocks[b].last + 1, blocks[b].last + 1, 0);
+            }
+        }
+
+        // A temporary's interval is exact, so the calls inside it are the calls it crosses
+        std::vector<std::uint64_t> helperCalls(code.size() + 1, 0);
+        std::vector<std::uint64_t> functionCalls(code.size() + 1, 0);
+        for (std::size_t i = 0; i < code.size(); i++) {
+            const bool isCall = code[i].op == MoonOp::Call;
+            const bool isHelper = isCall && m_func.calls[code[i].imm].helper;
+            helperCalls[i + 1] = helperCalls[i] + (isHelper ? m_weightAt[i] : 0);
+            functionCalls[i + 1] = functionCalls[i] + (isCall && !isHelper ? m_weightAt[i] : 0);
+        }
+        for (Interval &interval : m_intervals) {
+            if (const int g = m_globalIndex[ValueIndex(interval.vreg)]; g >= 0) {
+                interval.helpersCrossed = m_helpersCrossed[g];
+                interval.functionsCrossed = m_functionsCrossed[g];
+            } else if (interval.end > interval.start + 1) {
+                interval.helpersCrossed = helperCalls[interval.end] - helperCalls[interval.start + 1];
+                interval.functionsCrossed = functionCalls[interval.end] - functionCalls[interval.start + 1];
+            }
+        }
+
+        std::stable_sort(m_intervals.begin(), m_intervals.end(), [](const Interval &a, const Interval &b) { return a.start < b.start; });
+        for (std::size_t k = 0; k < m_intervals.size(); k++) m_intervalOf[ValueIndex(m_intervals[k].vreg)] = static_cast<int>(k);
+    }
+
+    // A register costs a save and a restore at every call its value lives across, and only r1-r6 need them around the
+    // I/O helpers. Values crossing helpers therefore take registers from the top and the others from the bottom, and a
+    // value whose saves would outweigh its uses stays in memory.
+    void RegisterAllocator::linearScan()
+    {
+        auto worthKeeping = [](const Interval &interval, Reg r) {
+            const std::uint64_t saves = interval.functionsCrossed + (r <= LAST_HELPER_CLOBBER ? interval.helpersCrossed : 0);
+            return 2 * saves <= interval.weight;
+        };
+
+        std::uint32_t freeRegs = 0;
+        for (Reg r = FIRST_REG; r <= LAST_REG; r++) freeRegs |= 1u << r;
+        std::vector<std::size_t> active;
+
+        for (std::size_t k = 0; k < m_intervals.size(); k++) {
+            Interval &current = m_intervals[k];
+
+            std::erase_if(active, [&](std::size_t a) {
+                if (m_intervals[a].end > current.start)
+                    return false;
+                freeRegs |= 1u << m_intervals[a].phys;
+                return true;
+            });
+
+            if (freeRegs) {
+                const Reg r = current.helpersCrossed ? std::bit_width(freeRegs) - 1 : std::countr_zero(freeRegs);
+                if (!worthKeeping(current, r))
+                    continue;
+                current.phys = r;
+                freeRegs &= ~(1u << r);
+                active.push_back(k);
+                continue;
+            }
+
+            // Spill whichever of the live intervals is used least, preferring the one that ends last
+            auto cheaper = [](const Interval &a, const Interval &b) { return a.weight < b.weight || (a.weight == b.weight && a.end > b.end); };
+            auto victim = std::min_element(active.begin(), active.end(), [&](std::size_t a, std::size_t b) {
+                return cheaper(m_intervals[a], m_intervals[b]);
+            });
+            if (!cheaper(m_intervals[*victim], current) || !worthKeeping(current, m_intervals[*victim].phys))
+                continue;
+            current.phys = m_intervals[*victim].phys;
+            m_intervals[*victim].phys = NO_REG;
+            *victim = k;
+        }
+    }
+
+    // Spilled intervals that do not overlap share a slot.
+    void RegisterAllocator::assignSpillSlots()
+    {
+        using Busy = std::pair<std::size_t, int>;
+        std::priority_queue<Busy, std::vector<Busy>, std::greater<>> busy;
+        std::vector<int> freeSlots;
+
+        for (Interval &interval : m_intervals) {
+            if (interval.phys != NO_REG)
+                continue;
+            while (!busy.empty() && busy.top().first <= interval.start) {
+                freeSlots.push_back(busy.top().second);
+                busy.pop();
+            }
+            if (freeSlots.empty()) {
+                interval.slot = m_spillSlots++;
+            } else {
+                interval.slot = freeSlots.back();
+                freeSlots.pop_back();
+            }
+            busy.push({ interval.end, interval.slot });
+        }
+    }
+
+    void RegisterAllocator::rewrite()
+    {
+        const auto &code = m_func.code;
+
+        // Registers holding a value across each call, found by sweeping the intervals in order of start: for every
+        // register only the latest interval to start before the call can still be live at it. A temporary is live for
+        // its whole interval; a cross-block value only where the liveness solve says so.
+        std::vector<std::uint32_t> savedAt(m_func.calls.size(), 0);
+        std::uint32_t savedAny = 0;
+        {
+            std::array<const Interval *, 16> occupant{};
+            std::size_t next = 0;
+            for (std::size_t i = 0; i < code.size(); i++) {
+                for (; next < m_intervals.size() && m_intervals[next].start < i; next++) {
+                    if (m_intervals[next].phys != NO_REG)
+                        occupant[m_intervals[next].phys] = &m_intervals[next];
+                }
+                if (code[i].op != MoonOp::Call || m_dead[i])
+                    continue;
+                const Word *liveAcross = m_liveAcross.data() + code[i].imm * m_words;
+                auto livesAcross = [&](const Interval &interval) {
+                    const int g = m_globalIndex[ValueIndex(interval.vreg)];
+                    return g >= 0 ? TestBit(liveAcross, g) : interval.end > i;
+                };
+                const Reg lastClobbered = m_func.calls[code[i].imm].helper ? LAST_HELPER_CLOBBER : LAST_REG;
+                std::uint32_t mask = 0;
+                for (Reg r = FIRST_REG; r <= lastClobbered; r++)
+                    if (occupant[r] && livesAcross(*occupant[r]))
+                        mask |= 1u << r;
+                savedAt[code[i].imm] = mask;
+                savedAny |= mask;
+            }
+        }
+
+        std::array<int, 16> saveSlot{};
+        int slots = m_spillSlots;
+        for (Reg r = FIRST_REG; r <= LAST_REG; r++)
+            if (savedAny & (1u << r))
+                saveSlot[r] = slots++;
+
+        const int frameBase = m_func.frameSize;
+        const int frameSize = frameBase + slots * 4;
+        auto slotOffset = [&](int slot) { return -(frameBase + (slot + 1) * 4); };
+
+        std::vector<MoonInstr> out;
+        out.reserve(code.size());
+        for (std::size_t i = 0; i < code.size(); i++) {
+            if (m_dead[i])
+                continue;
+            const MoonInstr &instr = code[i];
+
+            // The label of the original instruction goes on the first one emitted for it
+            std::string label = instr.label;
+            auto push = [&](MoonInstr emitted) {
+                if (!label.empty())
+                    emitted.label = std::move(label);
+                label.clear();
+                out.push_back(std::move(emitted));
+            };
+
+            auto slotOf = [&](Reg r) { return m_intervals[m_intervalOf[ValueIndex(r)]].slot; };
+            auto physOf = [&](Reg r) { return IsVirtualReg(r) ? m_intervals[m_intervalOf[ValueIndex(r)]].phys : r; };
+
+            if (instr.op == MoonOp::Call) {
+                const CallSite &call = m_func.calls[instr.imm];
+                const std::uint32_t saved = savedAt[instr.imm];
+                for (Reg r = FIRST_REG; r <= LAST_REG; r++) {
+                    if (saved & (1u << r))
+                        push({ .op = MoonOp::Sw, .rs = STACK_REG, .rt = r, .imm = slotOffset(saveSlot[r]), .comment = std::format("save r{}", r) });
+                }
+
+                // A spilled argument is loaded straight into the register or the frame slot it is passed in
+                auto argInto = [&](const CallSite::Arg &arg, Reg scratch) {
+                    const Reg phys = physOf(arg.reg);
+                    if (phys != NO_REG)
+                        return phys;
+                    push({ .op = MoonOp::Lw, .rd = scratch, .rs = STACK_REG, .imm = slotOffset(slotOf(arg.reg)), .comment = "reload" });
+                    return scratch;
+                };
+
+                Reg resultFrom = RETURN_REG;
+                if (call.helper) {
+                    for (const auto &arg : call.args) {
+                        const Reg from = argInto(arg, HELPER_REG);
+                        if (from != HELPER_REG)
+                            push({ .op = MoonOp::Add, .rd = HELPER_REG, .rs = from, .rt = 0, .comment = arg.comment });
+                    }
+                    push({ .op = MoonOp::Jl, .rd = LINK_REG, .sym = call.target, .comment = call.comment });
+                    resultFrom = HELPER_REG;
+                } else {
+                    for (const auto &arg : call.args) {
+                        const Reg from = argInto(arg, SCRATCH_REGS[0]);
+                        push({ .op = MoonOp::Sw, .rs = STACK_REG, .rt = from, .imm = arg.offset - frameSize, .comment = arg.comment });
+                    }
+                    if (frameSize > 0)
+                        push({ .op = MoonOp::Subi, .rd = STACK_REG, .rs = STACK_REG, .imm = frameSize });
+                    push({ .op = MoonOp::Jl, .rd = LINK_REG, .sym = call.target, .comment = call.comment });
+                    if (frameSize > 0)
+                        push({ .op = MoonOp::Addi, .rd = STACK_REG, .rs = STACK_REG, .imm = frameSize });
+                }
+
+                if (instr.rd != NO_REG) {
+                    const Reg phys = physOf(instr.rd);
+                    if (phys == NO_REG)
+                        push({ .op = MoonOp::Sw, .rs = STACK_REG, .rt = resultFrom, .imm = slotOffset(slotOf(instr.rd)), .comment = "spill" });
+                    else if (phys != resultFrom)
+                        push({ .op = MoonOp::Add, .rd = phys, .rs = resultFrom, .rt = 0, .comment = "copy return value" });
+                }
+
+                for (Reg r = FIRST_REG; r <= LAST_REG; r++) {
+                    if (saved & (1u << r))
+                        push({ .op = MoonOp::Lw, .rd = r, .rs = STACK_REG, .imm = slotOffset(saveSlot[r]), .comment = std::format("restore r{}", r) });
+                }
+                continue;
+            }
+
+            MoonInstr rewritten = instr;
+            std::size_t scratchUsed = 0;
+            Reg reloaded = NO_REG;
+            auto use = [&](Reg r) {
+                if (!IsVirtualReg(r))
+                    return r;
+                if (const Reg phys = physOf(r); phys != NO_REG)
+                    return phys;
+                if (r == reloaded)
+                    return SCRATCH_REGS[0];
+                const Reg scratch = SCRATCH_REGS[scratchUsed++];
+                push({ .op = MoonOp::Lw, .rd = scratch, .rs = STACK_REG, .imm = slotOffset(slotOf(r)), .comment = "reload" });
+                reloaded = r;
+                return scratch;
+            };
+            rewritten.rs = use(instr.rs);
+            rewritten.rt = use(instr.rt);
+
+            int spillTo = 0;
+            if (IsVirtualReg(instr.rd)) {
+                rewritten.rd = physOf(instr.rd);
+                if (rewritten.rd == NO_REG) {
+                    rewritten.rd = SCRATCH_REGS[0];
+                    spillTo = slotOffset(slotOf(instr.rd));
+                }
+            }
+
+            // Copies between values that ended up sharing a register vanish
+            if (rewritten.op == MoonOp::Add && rewritten.rt == 0 && rewritten.rd == rewritten.rs && rewritten.label.empty() && spillTo == 0)
+                continue;
+            push(std::move(rewritten));
+            if (spillTo != 0)
+                push({ .op = MoonOp::Sw, .rs = STACK_REG, .rt = SCRATCH_REGS[0], .imm = spillTo, .comment = "spill" });
+        }
+
+        m_func.code = std::move(out);
+        m_func.calls.clear();
+        m_func.frameSize = frameSize;
+    }
+} // namespace lang
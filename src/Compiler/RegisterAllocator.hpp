@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Compiler/ControlFlowGraph.hpp"
+#include "Compiler/MoonInstr.hpp"
+
+namespace lang
+{
+    // Linear-scan register allocation over one MachineFunction.
+    //
+    // Values that cross a basic block boundary (promoted variables) get their liveness solved over the blocks; expression
+    // temporaries stay within one block and need no more than a scan. Each value then has a single interval, and the
+    // intervals take r1-r10 in order of start. When none is free, the interval with the lowest use count, weighted by
+    // loop depth, lives in a stack slot below the frame instead and goes through r11/r12 at each instruction touching
+    // it. Calls are expanded last, saving only the registers whose values live across them.
+    class RegisterAllocator
+    {
+    public:
+        static constexpr Reg FIRST_REG = 1;
+        static constexpr Reg LAST_REG = 10;
+        static constexpr Reg SCRATCH_REGS[2] = { 11, 12 };
+
+        explicit RegisterAllocator(MachineFunction &func);
+
+        // Rewrites the function onto physical registers; afterwards its code holds no virtual register and no Call.
+        void run();
+
+    private:
+        struct Interval {
+            Reg vreg;
+            std::size_t start;
+            std::size_t end;
+            std::uint64_t weight = 0;
+            // Loop-weighted counts of the calls this value lives across
+            std::uint64_t helpersCrossed = 0;
+            std::uint64_t functionsCrossed = 0;
+            Reg phys = NO_REG;
+            int slot = -1;
+        };
+
+        using Word = std::uint64_t;
+
+        void computeLoopWeights();
+        void classifyValues();
+        void solveLiveness();
+        void removeDeadCode();
+        void recordCallCrossings(std::size_t at, const Word *live);
+        void buildIntervals();
+        void linearScan();
+        void assignSpillSlots();
+        void rewrite();
+
+        std::size_t valueCount() const { return static_cast<std::size_t>(m_func.nextReg - VREG_BASE); }
+        Word *liveIn(std::size_t block) { return m_liveIn.data() + block * m_words; }
+        Word *liveOut(std::size_t block) { return m_liveOut.data() + block * m_words; }
+
+        MachineFunction &m_func;
+
+        ControlFlowGraph m_cfg;
+
+        // Index of each value among those live across blocks, or -1 for a temporary
+        std::vector<int> m_globalIndex;
+        std::vector<Reg> m_globals;
+        std::size_t m_words = 0;
+        std::vector<Word> m_liveIn;
+        std::vector<Word> m_liveOut;
+
+        std::vector<char> m_dead;
+        // Per call, the cross-block values live after it; per cross-block value, the calls it lives across
+        std::vector<Word> m_liveAcross;
+        std::vector<std::uint64_t> m_helpersCrossed;
+        std::vector<std::uint64_t> m_functionsCrossed;
+        // How much an instruction counts towards spill decisions: 10 to the power of its loop depth, capped
+        std::vector<std::uint64_t> m_weightAt;
+        std::vector<Interval> m_intervals;
+        std::vector<int> m_intervalOf;
+        int m_spillSlots = 0;
+    };
+} // namespace lang
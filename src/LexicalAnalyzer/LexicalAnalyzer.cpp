@@ -1,16 +1,26 @@
 #include "LexicalAnalyzer.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <deque>
 #include <fcntl.h>
 #include <iterator>
+#include <limits>
+#include <mutex>
 #include <regex>
-#include <span>
 #include <string>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
-#include <unordered_map>
-#include "ctre.hpp"
 #include "spdlog/spdlog.h"
+#include "utils/ParallelFor.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 std::string lang::tokenTypeToCompString(TokenType type)
 {
@@ -224,25 +234,450 @@ std::string lang::tokenTypeToString(TokenType type)
     }
 }
 
-lang::Token lang::LexicalAnalyzer::makeToken(TokenType type, std::string lexeme)
+// Byte classes of the lexer DFA: every byte that behaves identically in all states shares a column
+enum class DFAClass : std::uint8_t {
+    OTHER,
+    LETTER,
+    LETTER_E,
+    ZERO,
+    NONZERO,
+    UNDERSCORE,
+    NEWLINE,
+    DOT,
+    PLUS,
+    MINUS,
+    STAR,
+    SLASH,
+    EQUAL,
+    LESS,
+    GREATER,
+    COLON,
+    SEMICOLON,
+    COMMA,
+    OPEN_PARENTHESIS,
+    CLOSE_PARENTHESIS,
+    OPEN_BRACE,
+    CLOSE_BRACE,
+    OPEN_BRACKET,
+    CLOSE_BRACKET,
+    COUNT
+};
+
+enum class DFAState : std::uint8_t {
+    DEAD,
+    START,
+    ID,
+    INT_ZERO,
+    INT,
+    FRACTION_START,    // "1."
+    FRACTION_ZERO,     // "1.0"
+    FRACTION,          // "1.05"
+    FRACTION_TRAILING, // "1.00", "1.50": not a float until another non-zero digit
+    EXPONENT_START,    // "1.5e"
+    EXPONENT_SIGN,     // "1.5e-"
+    EXPONENT_ZERO,     // "1.5e0"
+    EXPONENT,          // "1.5e12"
+    SLASH,
+    INLINE_COMMENT,
+    BLOCK_COMMENT_BODY,
+    BLOCK_COMMENT_STAR,
+    BLOCK_COMMENT_END,
+    ASSIGN,
+    EQUAL,
+    LESS_THAN,
+    NOT_EQUAL,
+    LESS_EQUAL,
+    GREATER_THAN,
+    GREATER_EQUAL,
+    COLON,
+    DOUBLE_COLON,
+    PLUS,
+    MINUS,
+    MULTIPLY,
+    DOT,
+    SEMICOLON,
+    COMMA,
+    OPEN_PARENTHESIS,
+    CLOSE_PARENTHESIS,
+    OPEN_BRACE,
+    CLOSE_BRACE,
+    OPEN_BRACKET,
+    CLOSE_BRACKET,
+    COUNT
+};
+
+static constexpr std::size_t DFA_CLASS_COUNT = static_cast<std::size_t>(DFAClass::COUNT);
+static constexpr std::size_t DFA_STATE_COUNT = static_cast<std::size_t>(DFAState::COUNT);
+
+using DFATransitionTable = std::array<std::array<DFAState, DFA_CLASS_COUNT>, DFA_STATE_COUNT>;
+
+static constexpr std::array<std::uint8_t, 256> MakeDFACharClasses()
+{
+    std::array<std::uint8_t, 256> classes{};
+    auto set = [&](unsigned char c, DFAClass cls) { classes[c] = static_cast<std::uint8_t>(cls); };
+
+    for (unsigned char c = 'a'; c <= 'z'; c++) set(c, DFAClass::LETTER);
+    for (unsigned char c = 'A'; c <= 'Z'; c++) set(c, DFAClass::LETTER);
+    for (unsigned char c = '1'; c <= '9'; c++) set(c, DFAClass::NONZERO);
+    set('e', DFAClass::LETTER_E);
+    set('0', DFAClass::ZERO);
+    set('_', DFAClass::UNDERSCORE);
+    set('\n', DFAClass::NEWLINE);
+    set('.', DFAClass::DOT);
+    set('+', DFAClass::PLUS);
+    set('-', DFAClass::MINUS);
+    set('*', DFAClass::STAR);
+    set('/', DFAClass::SLASH);
+    set('=', DFAClass::EQUAL);
+    set('<', DFAClass::LESS);
+    set('>', DFAClass::GREATER);
+    set(':', DFAClass::COLON);
+    set(';', DFAClass::SEMICOLON);
+    set(',', DFAClass::COMMA);
+    set('(', DFAClass::OPEN_PARENTHESIS);
+    set(')', DFAClass::CLOSE_PARENTHESIS);
+    set('{', DFAClass::OPEN_BRACE);
+    set('}', DFAClass::CLOSE_BRACE);
+    set('[', DFAClass::OPEN_BRACKET);
+    set(']', DFAClass::CLOSE_BRACKET);
+
+    return classes;
+}
+
+/*
+ * Union of the lexical rules (comments, floatNum, intNum, id) and of the operator table. A state is
+ * accepting when DFA_ACCEPTS maps it to a token type; runDFA() keeps the longest accepted prefix.
+ * BLOCK_COMMENT_END has no outgoing edge so a block comment stops at its first closing delimiter.
+ */
+static constexpr DFATransitionTable MakeDFATransitions()
+{
+    DFATransitionTable table{};
+    auto on = [&](DFAState from, DFAClass cls, DFAState to) { table[static_cast<std::size_t>(from)][static_cast<std::size_t>(cls)] = to; };
+    auto onAll = [&](DFAState from, DFAState to) {
+        for (std::size_t cls = 0; cls < DFA_CLASS_COUNT; cls++) table[static_cast<std::size_t>(from)][cls] = to;
+    };
+    auto onDigit = [&](DFAState from, DFAState zero, DFAState nonzero) {
+        on(from, DFAClass::ZERO, zero);
+        on(from, DFAClass::NONZERO, nonzero);
+    };
+
+    on(DFAState::START, DFAClass::LETTER, DFAState::ID);
+    on(DFAState::START, DFAClass::LETTER_E, DFAState::ID);
+    onDigit(DFAState::START, DFAState::INT_ZERO, DFAState::INT);
+    on(DFAState::START, DFAClass::SLASH, DFAState::SLASH);
+    on(DFAState::START, DFAClass::EQUAL, DFAState::ASSIGN);
+    on(DFAState::START, DFAClass::LESS, DFAState::LESS_THAN);
+    on(DFAState::START, DFAClass::GREATER, DFAState::GREATER_THAN);
+    on(DFAState::START, DFAClass::COLON, DFAState::COLON);
+    on(DFAState::START, DFAClass::PLUS, DFAState::PLUS);
+    on(DFAState::START, DFAClass::MINUS, DFAState::MINUS);
+    on(DFAState::START, DFAClass::STAR, DFAState::MULTIPLY);
+    on(DFAState::START, DFAClass::DOT, DFAState::DOT);
+    on(DFAState::START, DFAClass::SEMICOLON, DFAState::SEMICOLON);
+    on(DFAState::START, DFAClass::COMMA, DFAState::COMMA);
+    on(DFAState::START, DFAClass::OPEN_PARENTHESIS, DFAState::OPEN_PARENTHESIS);
+    on(DFAState::START, DFAClass::CLOSE_PARENTHESIS, DFAState::CLOSE_PARENTHESIS);
+    on(DFAState::START, DFAClass::OPEN_BRACE, DFAState::OPEN_BRACE);
+    on(DFAState::START, DFAClass::CLOSE_BRACE, DFAState::CLOSE_BRACE);
+    on(DFAState::START, DFAClass::OPEN_BRACKET, DFAState::OPEN_BRACKET);
+    on(DFAState::START, DFAClass::CLOSE_BRACKET, DFAState::CLOSE_BRACKET);
+
+    // id: [a-zA-Z]([a-zA-Z]|[0-9]|_)*
+    on(DFAState::ID, DFAClass::LETTER, DFAState::ID);
+    on(DFAState::ID, DFAClass::LETTER_E, DFAState::ID);
+    on(DFAState::ID, DFAClass::UNDERSCORE, DFAState::ID);
+    onDigit(DFAState::ID, DFAState::ID, DFAState::ID);
+
+    // intNum: [1-9][0-9]* | 0
+    onDigit(DFAState::INT, DFAState::INT, DFAState::INT);
+    on(DFAState::INT, DFAClass::DOT, DFAState::FRACTION_START);
+    on(DFAState::INT_ZERO, DFAClass::DOT, DFAState::FRACTION_START);
+
+    // floatNum fraction: [0-9]*[1-9] | 0
+    onDigit(DFAState::FRACTION_START, DFAState::FRACTION_ZERO, DFAState::FRACTION);
+    onDigit(DFAState::FRACTION_ZERO, DFAState::FRACTION_TRAILING, DFAState::FRACTION);
+    onDigit(DFAState::FRACTION, DFAState::FRACTION_TRAILING, DFAState::FRACTION);
+    onDigit(DFAState::FRACTION_TRAILING, DFAState::FRACTION_TRAILING, DFAState::FRACTION);
+
+    // floatNum exponent: e(+|-)?([1-9][0-9]*|0)
+    on(DFAState::FRACTION_ZERO, DFAClass::LETTER_E, DFAState::EXPONENT_START);
+    on(DFAState::FRACTION, DFAClass::LETTER_E, DFAState::EXPONENT_START);
+    on(DFAState::EXPONENT_START, DFAClass::PLUS, DFAState::EXPONENT_SIGN);
+    on(DFAState::EXPONENT_START, DFAClass::MINUS, DFAState::EXPONENT_SIGN);
+    onDigit(DFAState::EXPONENT_START, DFAState::EXPONENT_ZERO, DFAState::EXPONENT);
+    onDigit(DFAState::EXPONENT_SIGN, DFAState::EXPONENT_ZERO, DFAState::EXPONENT);
+    onDigit(DFAState::EXPONENT, DFAState::EXPONENT, DFAState::EXPONENT);
+
+    // comments: //.*$ and /\*[\s\S]*?\*\/
+    on(DFAState::SLASH, DFAClass::SLASH, DFAState::INLINE_COMMENT);
+    on(DFAState::SLASH, DFAClass::STAR, DFAState::BLOCK_COMMENT_BODY);
+    onAll(DFAState::INLINE_COMMENT, DFAState::INLINE_COMMENT);
+    on(DFAState::INLINE_COMMENT, DFAClass::NEWLINE, DFAState::DEAD);
+    onAll(DFAState::BLOCK_COMMENT_BODY, DFAState::BLOCK_COMMENT_BODY);
+    on(DFAState::BLOCK_COMMENT_BODY, DFAClass::STAR, DFAState::BLOCK_COMMENT_STAR);
+    onAll(DFAState::BLOCK_COMMENT_STAR, DFAState::BLOCK_COMMENT_BODY);
+    on(DFAState::BLOCK_COMMENT_STAR, DFAClass::STAR, DFAState::BLOCK_COMMENT_STAR);
+    on(DFAState::BLOCK_COMMENT_STAR, DFAClass::SLASH, DFAState::BLOCK_COMMENT_END);
+
+    // two-character operators
+    on(DFAState::ASSIGN, DFAClass::EQUAL, DFAState::EQUAL);
+    on(DFAState::LESS_THAN, DFAClass::GREATER, DFAState::NOT_EQUAL);
+    on(DFAState::LESS_THAN, DFAClass::EQUAL, DFAState::LESS_EQUAL);
+    on(DFAState::GREATER_THAN, DFAClass::EQUAL, DFAState::GREATER_EQUAL);
+    on(DFAState::COLON, DFAClass::COLON, DFAState::DOUBLE_COLON);
+
+    return table;
+}
+
+static constexpr std::array<lang::TokenType, DFA_STATE_COUNT> MakeDFAAccepts()
+{
+    std::array<lang::TokenType, DFA_STATE_COUNT> accepts{};
+    accepts.fill(lang::TokenType::UNKNOWN);
+    auto accept = [&](DFAState state, lang::TokenType type) { accepts[static_cast<std::size_t>(state)] = type; };
+
+    accept(DFAState::ID, lang::TokenType::ID);
+    accept(DFAState::INT_ZERO, lang::TokenType::INT_NUM);
+    accept(DFAState::INT, lang::TokenType::INT_NUM);
+    accept(DFAState::FRACTION_ZERO, lang::TokenType::FLOAT_NUM);
+    accept(DFAState::FRACTION, lang::TokenType::FLOAT_NUM);
+    accept(DFAState::EXPONENT_ZERO, lang::TokenType::FLOAT_NUM);
+    accept(DFAState::EXPONENT, lang::TokenType::FLOAT_NUM);
+    accept(DFAState::SLASH, lang::TokenType::DIVIDE);
+    accept(DFAState::INLINE_COMMENT, lang::TokenType::INLINE_COMMENT);
+    accept(DFAState::BLOCK_COMMENT_END, lang::TokenType::BLOCK_COMMENT);
+    accept(DFAState::ASSIGN, lang::TokenType::ASSIGN);
+    accept(DFAState::EQUAL, lang::TokenType::EQUAL);
+    accept(DFAState::LESS_THAN, lang::TokenType::LESS_THAN);
+    accept(DFAState::NOT_EQUAL, lang::TokenType::NOT_EQUAL);
+    accept(DFAState::LESS_EQUAL, lang::TokenType::LESS_EQUAL);
+    accept(DFAState::GREATER_THAN, lang::TokenType::GREATER_THAN);
+    accept(DFAState::GREATER_EQUAL, lang::TokenType::GREATER_EQUAL);
+    accept(DFAState::COLON, lang::TokenType::COLON);
+    accept(DFAState::DOUBLE_COLON, lang::TokenType::DOUBLE_COLON);
+    accept(DFAState::PLUS, lang::TokenType::PLUS);
+    accept(DFAState::MINUS, lang::TokenType::MINUS);
+    accept(DFAState::MULTIPLY, lang::TokenType::MULTIPLY);
+    accept(DFAState::DOT, lang::TokenType::DOT);
+    accept(DFAState::SEMICOLON, lang::TokenType::SEMICOLON);
+    accept(DFAState::COMMA, lang::TokenType::COMMA);
+    accept(DFAState::OPEN_PARENTHESIS, lang::TokenType::OPEN_PARENTHESIS);
+    accept(DFAState::CLOSE_PARENTHESIS, lang::TokenType::CLOSE_PARENTHESIS);
+    accept(DFAState::OPEN_BRACE, lang::TokenType::OPEN_BRACE);
+    accept(DFAState::CLOSE_BRACE, lang::TokenType::CLOSE_BRACE);
+    accept(DFAState::OPEN_BRACKET, lang::TokenType::OPEN_BRACKET);
+    accept(DFAState::CLOSE_BRACKET, lang::TokenType::CLOSE_BRACKET);
+
+    return accepts;
+}
+
+static constexpr auto DFA_CHAR_CLASSES = MakeDFACharClasses();
+static constexpr auto DFA_TRANSITIONS = MakeDFATransitions();
+static constexpr auto DFA_ACCEPTS = MakeDFAAccepts();
+
+#if defined(__AVX2__)
+static constexpr std::uint64_t SIMD_WIDTH = 32;
+
+static std::uint32_t MatchMask(const char *data, char c)
+{
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(c))));
+}
+
+static std::uint32_t WhitespaceMask(const char *data)
+{
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+    __m256i spaces = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t')));
+    __m256i breaks = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r')));
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(spaces, breaks)));
+}
+#elif defined(__SSE2__)
+static constexpr std::uint64_t SIMD_WIDTH = 16;
+
+static std::uint32_t MatchMask(const char *data, char c)
+{
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(c))));
+}
+
+static std::uint32_t WhitespaceMask(const char *data)
+{
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    __m128i spaces = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\t')));
+    __m128i breaks = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\r')));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_or_si128(spaces, breaks)));
+}
+#else
+static constexpr std::uint64_t SIMD_WIDTH = 8;
+
+static std::uint32_t MatchMask(const char *data, char c)
+{
+    std::uint32_t mask = 0;
+    for (std::uint64_t i = 0; i < SIMD_WIDTH; i++) mask |= static_cast<std::uint32_t>(data[i] == c) << i;
+    return mask;
+}
+
+static std::uint32_t WhitespaceMask(const char *data)
+{
+    return MatchMask(data, ' ') | MatchMask(data, '\t') | MatchMask(data, '\n') | MatchMask(data, '\r');
+}
+#endif
+
+static constexpr std::uint32_t SIMD_FULL_MASK = static_cast<std::uint32_t>((std::uint64_t{ 1 } << SIMD_WIDTH) - 1);
+
+static bool IsWhitespace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+// Index of the first non-whitespace byte at or after i
+static std::uint64_t SkipWhitespace(std::string_view text, std::uint64_t i)
+{
+    for (; i + SIMD_WIDTH <= text.size(); i += SIMD_WIDTH) {
+        std::uint32_t other = ~WhitespaceMask(text.data() + i) & SIMD_FULL_MASK;
+        if (other)
+            return i + std::countr_zero(other);
+    }
+    while (i < text.size() && IsWhitespace(text[i])) i++;
+    return i;
+}
+
+// Index of the first c at or after i, or text.size()
+static std::uint64_t FindByte(std::string_view text, std::uint64_t i, char c)
+{
+    for (; i + SIMD_WIDTH <= text.size(); i += SIMD_WIDTH) {
+        std::uint32_t mask = MatchMask(text.data() + i, c);
+        if (mask)
+            return i + std::countr_zero(mask);
+    }
+    while (i < text.size() && text[i] != c) i++;
+    return i;
+}
+
+static std::uint64_t CountNewlines(std::string_view text, std::uint64_t begin, std::uint64_t end)
 {
-    return { .type = type, .lexeme = lexeme, .line = m_lineNumber, .pos = m_position - lexeme.size(), .file_path = m_filePath };
+    std::uint64_t count = 0;
+    for (; begin + SIMD_WIDTH <= end; begin += SIMD_WIDTH) count += std::popcount(MatchMask(text.data() + begin, '\n'));
+    for (; begin < end; begin++) count += text[begin] == '\n';
+    return count;
+}
+
+// One past the first "*/" at or after i, or 0 if the comment is never closed
+static std::uint64_t FindBlockCommentEnd(std::string_view text, std::uint64_t i)
+{
+    while ((i = FindByte(text, i, '*')) + 1 < text.size()) {
+        if (text[i + 1] == '/')
+            return i + 2;
+        i++;
+    }
+    return 0;
+}
+
+// Appends the offset following every '\n' in [begin, end)
+static void CollectLineStarts(std::string_view text, std::uint64_t begin, std::uint64_t end, std::vector<std::uint32_t> &out)
+{
+    for (; begin + SIMD_WIDTH <= end; begin += SIMD_WIDTH) {
+        for (std::uint32_t mask = MatchMask(text.data() + begin, '\n'); mask; mask &= mask - 1)
+            out.push_back(static_cast<std::uint32_t>(begin + std::countr_zero(mask) + 1));
+    }
+    for (; begin < end; begin++) {
+        if (text[begin] == '\n')
+            out.push_back(static_cast<std::uint32_t>(begin + 1));
+    }
+}
+
+static constexpr std::uint64_t LINE_INDEX_CHUNK_SIZE = 1 << 20;
+
+// Large inputs are split into up to `jobs` chunks scanned in parallel, then concatenated in order
+static std::vector<std::uint32_t> BuildLineIndex(std::string_view text, std::size_t jobs)
+{
+    std::vector<std::uint32_t> lineStarts{ 0 };
+
+    std::uint64_t chunks = std::min<std::uint64_t>(jobs, text.size() / LINE_INDEX_CHUNK_SIZE);
+    if (chunks <= 1) {
+        CollectLineStarts(text, 0, text.size(), lineStarts);
+        return lineStarts;
+    }
+
+    std::uint64_t chunkSize = text.size() / chunks;
+    std::vector<std::vector<std::uint32_t>> parts(chunks);
+    lang::ParallelFor(chunks, chunks, [&](std::size_t i) {
+        std::uint64_t begin = i * chunkSize;
+        std::uint64_t end = i + 1 == chunks ? text.size() : begin + chunkSize;
+        CollectLineStarts(text, begin, end, parts[i]);
+    });
+
+    std::uint64_t total = 1;
+    for (const auto &part : parts) total += part.size();
+    lineStarts.reserve(total);
+    for (const auto &part : parts) lineStarts.insert(lineStarts.end(), part.begin(), part.end());
+
+    return lineStarts;
+}
+
+lang::CompactToken lang::LexicalAnalyzer::makeToken(TokenType type, std::uint64_t offset, std::uint64_t length) const
+{
+    return {
+        .offset = static_cast<std::uint32_t>(offset),
+        .length = static_cast<std::uint32_t>(length),
+        .line = static_cast<std::uint32_t>(m_lineNumber),
+        .file_id = m_fileId,
+        .type = type,
+    };
+}
+
+static std::deque<std::string> &FilePathTable()
+{
+    static std::deque<std::string> paths;
+    return paths;
+}
+
+static std::mutex &FilePathTableMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::uint16_t lang::LexicalAnalyzer::internFilePath(std::string_view path)
+{
+    std::lock_guard lock(FilePathTableMutex());
+    auto &paths = FilePathTable();
+
+    auto it = std::find(paths.begin(), paths.end(), path);
+    if (it != paths.end())
+        return static_cast<std::uint16_t>(it - paths.begin());
+
+    if (paths.size() > std::numeric_limits<std::uint16_t>::max())
+        throw std::runtime_error("Too many source files");
+
+    paths.emplace_back(path);
+    return static_cast<std::uint16_t>(paths.size() - 1);
+}
+
+const std::string &lang::LexicalAnalyzer::getFilePath(std::uint16_t id)
+{
+    std::lock_guard lock(FilePathTableMutex());
+    return FilePathTable().at(id);
 }
 
 std::uint64_t lang::LexicalAnalyzer::readFile(std::string_view path)
 {
     m_fd = open(path.data(), O_RDONLY);
 
-    if (!m_fd) {
+    if (m_fd < 0) {
         throw std::runtime_error("Failed to open file: " + std::string(path));
     }
 
-    m_filePath = std::string(path);
+    m_fileId = internFilePath(path);
 
     m_fileSize = lseek(m_fd, 0, SEEK_END);
 
+    if (m_fileSize > std::numeric_limits<std::uint32_t>::max()) {
+        close(m_fd);
+        m_fd = -1;
+        throw std::runtime_error("File too large: " + std::string(path));
+    }
+
     m_lineNumber = 1;
-    m_position = 1;
     m_iter = 0;
 
     if (m_data) {
@@ -252,23 +687,8 @@ std::uint64_t lang::LexicalAnalyzer::readFile(std::string_view path)
 
     m_data = mmap(nullptr, m_fileSize, PROT_READ, MAP_PRIVATE, m_fd, 0);
 
-    m_lineStartIndexes.clear();
-    m_lineStartIndexes.push_back(0);
-
-    std::span<const char> view(static_cast<const char *>(m_data), m_fileSize);
-    auto it = view.begin();
-    while (it != view.end()) {
-        it = std::find(it, view.end(), '\n');
-        if (it == view.end())
-            break;
-
-        m_lineStartIndexes.push_back((it - view.begin()) + 1);
-        ++it;
-    }
-
-
     m_fileContents = std::string_view(static_cast<const char *>(m_data), m_fileSize);
-    m_slice = std::string_view(m_fileContents);
+    m_lineStartIndexes = BuildLineIndex(m_fileContents, m_jobs);
 
     close(m_fd);
     m_fd = -1;
@@ -276,6 +696,11 @@ std::uint64_t lang::LexicalAnalyzer::readFile(std::string_view path)
     return m_fileContents.size();
 }
 
+void lang::LexicalAnalyzer::setJobs(std::size_t jobs)
+{
+    m_jobs = std::max<std::size_t>(1, jobs);
+}
+
 void lang::LexicalAnalyzer::closeFile()
 {
     if (m_data) {
@@ -288,50 +713,26 @@ void lang::LexicalAnalyzer::closeFile()
     }
 }
 
-lang::Token lang::LexicalAnalyzer::next()
+lang::CompactToken lang::LexicalAnalyzer::next()
 {
     if (m_iter >= m_fileContents.size())
-        return makeToken(TokenType::END_OF_FILE, "");
-
-    std::uint64_t start_iter = m_iter;
-
-    while (m_fileContents[m_iter] == ' ' || m_fileContents[m_iter] == '\n' || m_fileContents[m_iter] == '\t' || m_fileContents[m_iter] == '\r') {
-        if (m_fileContents[m_iter] == '\n') {
-            m_lineNumber++;
-            m_position = 1;
-        } else if (m_fileContents[m_iter] == '\t') {
-            m_position += NEXT_TAB_POS(m_position);
-        } else if (m_fileContents[m_iter] != '\r') {
-            m_position++;
-        }
-        m_iter++;
-    }
+        return makeToken(TokenType::END_OF_FILE, m_iter, 0);
 
-    m_slice = std::string_view(m_fileContents).substr(m_iter);
+    std::uint64_t start = m_iter;
+    m_iter = SkipWhitespace(m_fileContents, m_iter);
+    m_lineNumber += CountNewlines(m_fileContents, start, m_iter);
 
     if (m_iter >= m_fileContents.size())
-        return makeToken(TokenType::END_OF_FILE, "");
-
-    lang::Token token = runRegEx();
-    if (token.type != lang::TokenType::UNKNOWN) [[likely]] {
-        if (token.type == lang::TokenType::ID) {
-            lang::Token keywordToken = checkKeywords(token);
-            if (keywordToken.type != lang::TokenType::UNKNOWN) {
-                return keywordToken;
-            }
-        }
+        return makeToken(TokenType::END_OF_FILE, m_iter, 0);
+
+    lang::CompactToken token = runDFA();
+    if (token.type == lang::TokenType::ID)
+        token.type = checkKeywords(getLexeme(token));
+    if (token.type != lang::TokenType::UNKNOWN) [[likely]]
         return token;
-    } else {
-        lang::Token operatorToken = checkOperators();
-        if (operatorToken.type != lang::TokenType::UNKNOWN) {
-            return operatorToken;
-        }
-    }
 
-    std::string unknownLexeme(1, m_fileContents[m_iter]);
     m_iter++;
-    m_position++;
-    return makeToken(lang::TokenType::UNKNOWN, std::move(unknownLexeme));
+    return makeToken(lang::TokenType::UNKNOWN, m_iter - 1, 1);
 }
 
 float lang::LexicalAnalyzer::getProgress() const
@@ -345,114 +746,127 @@ std::string_view lang::LexicalAnalyzer::getLine(std::uint64_t lineNumber) const
         throw std::out_of_range("Line number out of range");
     }
 
-    for (size_t i = m_lineStartIndexes[lineNumber - 1]; i < m_fileSize; i++) {
-        if (static_cast<const char *>(m_data)[i] == '\n') {
-            return std::string_view(static_cast<const char *>(m_data) + m_lineStartIndexes[lineNumber - 1], i - m_lineStartIndexes[lineNumber - 1]);
-        }
-    }
-
-    return std::string_view(static_cast<const char *>(m_data) + m_lineStartIndexes[lineNumber - 1], m_fileSize - m_lineStartIndexes[lineNumber - 1]);
-}
-
-std::uint32_t lang::LexicalAnalyzer::MatchBlockComment(std::string_view s)
-{
-    if (auto m = REGEX_BLOCK_COMMENT(s))
-        return m.size();
-    return 0;
-}
-
-std::uint32_t lang::LexicalAnalyzer::MatchInlineComment(std::string_view s)
-{
-    if (auto m = REGEX_INLINE_COMMENT(s))
-        return m.size();
-    return 0;
+    std::uint64_t begin = m_lineStartIndexes[lineNumber - 1];
+    std::uint64_t end = lineNumber < m_lineStartIndexes.size() ? m_lineStartIndexes[lineNumber] - 1 : m_fileContents.size();
+    return m_fileContents.substr(begin, end - begin);
 }
 
-std::uint32_t lang::LexicalAnalyzer::MatchFloatNum(std::string_view s)
+std::string_view lang::LexicalAnalyzer::getLexeme(const CompactToken &token) const
 {
-    if (auto m = REGEX_FLOAT_NUM(s))
-        return m.size();
-    return 0;
+    return m_fileContents.substr(token.offset, token.length);
 }
 
-std::uint32_t lang::LexicalAnalyzer::MatchIntNum(std::string_view s)
+// Replays the tab-aware column tracking of next() over the token's line. Like the eager
+// version, the column is the one reached at the end of the token minus its length.
+std::uint64_t lang::LexicalAnalyzer::getColumn(const CompactToken &token) const
 {
-    if (auto m = REGEX_INT_NUM(s))
-        return m.size();
-    return 0;
+    std::uint64_t position = 1;
+    std::uint64_t end = static_cast<std::uint64_t>(token.offset) + token.length;
+    for (std::uint64_t i = m_lineStartIndexes[token.line - 1]; i < end; i++) {
+        if (m_fileContents[i] == '\t')
+            position += NEXT_TAB_POS(position);
+        else if (m_fileContents[i] != '\r')
+            position++;
+    }
+    return position - token.length;
 }
 
-std::uint32_t lang::LexicalAnalyzer::MatchID(std::string_view s)
+lang::Token lang::LexicalAnalyzer::toToken(const CompactToken &token) const
 {
-    if (auto m = REGEX_ID(s))
-        return m.size();
-    return 0;
+    return { .type = token.type, .lexeme = std::string(getLexeme(token)), .line = token.line, .pos = getColumn(token), .file_path = getFilePath(token.file_id) };
 }
 
-lang::Token lang::LexicalAnalyzer::runRegEx()
+lang::CompactToken lang::LexicalAnalyzer::runDFA()
 {
-    std::uint32_t best = 0;
-    lang::TokenType best_kind{};
+    std::uint64_t start = m_iter;
 
-    for (auto &r : rules) {
-        std::uint32_t n = r.match(m_slice);
-        if (n > best) {
-            best = n;
-            best_kind = r.type;
+    // Comment bodies are skipped with the block scanners instead of stepping the table byte by byte.
+    // An unterminated block comment falls through to the DFA, which only accepts the leading '/'.
+    if (m_fileContents.substr(m_iter, 2) == "//") {
+        m_iter = FindByte(m_fileContents, m_iter + 2, '\n');
+        return makeToken(lang::TokenType::INLINE_COMMENT, start, m_iter - start);
+    }
+    if (m_fileContents.substr(m_iter, 2) == "/*") {
+        if (std::uint64_t end = FindBlockCommentEnd(m_fileContents, m_iter + 2)) {
+            m_lineNumber += CountNewlines(m_fileContents, start, end);
+            m_iter = end;
+            return makeToken(lang::TokenType::BLOCK_COMMENT, start, end - start);
         }
     }
 
-    if (best > 0) {
-        for (std::uint32_t i = 0; i < best; i++) {
-            if (m_fileContents[m_iter] == '\n') {
-                m_lineNumber++;
-                m_position = 1;
-            } else if (m_fileContents[m_iter] == '\t') {
-                m_position += NEXT_TAB_POS(m_position);
-            } else if (m_fileContents[m_iter] != '\r') {
-                m_position++;
-            }
-            m_iter++;
+    std::uint64_t best = 0;
+    lang::TokenType best_kind = lang::TokenType::UNKNOWN;
+
+    DFAState state = DFAState::START;
+    for (std::uint64_t i = m_iter; i < m_fileContents.size(); i++) {
+        state = DFA_TRANSITIONS[static_cast<std::size_t>(state)][DFA_CHAR_CLASSES[static_cast<unsigned char>(m_fileContents[i])]];
+        if (state == DFAState::DEAD)
+            break;
+        if (DFA_ACCEPTS[static_cast<std::size_t>(state)] != lang::TokenType::UNKNOWN) {
+            best = i - m_iter + 1;
+            best_kind = DFA_ACCEPTS[static_cast<std::size_t>(state)];
         }
-        lang::Token token = makeToken(best_kind, std::string(m_slice.substr(0, best)));
-        m_slice.remove_prefix(best);
-        return token;
     }
 
-    return makeToken(lang::TokenType::UNKNOWN, std::string(1, m_fileContents[m_iter]));
+    if (best == 0)
+        return makeToken(lang::TokenType::UNKNOWN, m_iter, 1);
+
+    m_iter += best;
+
+    return makeToken(best_kind, start, best);
 }
 
-const std::unordered_map<std::string, lang::TokenType> lang::LexicalAnalyzer::m_Keywords{
-    { "if", TokenType::IF },         { "then", TokenType::THEN },         { "else", TokenType::ELSE },       { "while", TokenType::WHILE },
-    { "class", TokenType::CLASS },   { "integer", TokenType::INTEGER },   { "float", TokenType::FLOAT },     { "do", TokenType::DO },
-    { "end", TokenType::END },       { "public", TokenType::PUBLIC },     { "private", TokenType::PRIVATE }, { "or", TokenType::OR },
-    { "and", TokenType::AND },       { "not", TokenType::NOT },           { "read", TokenType::READ },       { "write", TokenType::WRITE },
-    { "return", TokenType::RETURN }, { "inherits", TokenType::INHERITS }, { "local", TokenType::LOCAL },     { "void", TokenType::VOID },
-    { "main", TokenType::MAIN }
+struct KeywordEntry {
+    std::string_view text;
+    lang::TokenType type;
 };
 
-lang::Token lang::LexicalAnalyzer::checkKeywords(lang::Token &token)
+// clang-format off
+static constexpr std::array<KeywordEntry, 21> KEYWORDS{ {
+    { "if", lang::TokenType::IF },         { "then", lang::TokenType::THEN },         { "else", lang::TokenType::ELSE },       { "while", lang::TokenType::WHILE },
+    { "class", lang::TokenType::CLASS },   { "integer", lang::TokenType::INTEGER },   { "float", lang::TokenType::FLOAT },     { "do", lang::TokenType::DO },
+    { "end", lang::TokenType::END },       { "public", lang::TokenType::PUBLIC },     { "private", lang::TokenType::PRIVATE }, { "or", lang::TokenType::OR },
+    { "and", lang::TokenType::AND },       { "not", lang::TokenType::NOT },           { "read", lang::TokenType::READ },       { "write", lang::TokenType::WRITE },
+    { "return", lang::TokenType::RETURN }, { "inherits", lang::TokenType::INHERITS }, { "local", lang::TokenType::LOCAL },     { "void", lang::TokenType::VOID },
+    { "main", lang::TokenType::MAIN }
+} };
+// clang-format on
+
+static constexpr std::size_t KEYWORD_TABLE_SIZE = 32;
+static constexpr std::size_t KEYWORD_MIN_LENGTH = 2;
+static constexpr std::size_t KEYWORD_MAX_LENGTH = 8;
+
+// Length, first, second and last characters; the second one separates "while" from "write"
+static constexpr std::size_t KeywordHash(std::string_view word)
 {
+    return (word.size() * 4 + static_cast<unsigned char>(word[0]) * 2 + static_cast<unsigned char>(word[1]) * 3 + static_cast<unsigned char>(word.back()))
+           % KEYWORD_TABLE_SIZE;
+}
 
-    auto find = m_Keywords.find(token.lexeme);
-    if (find != m_Keywords.end()) {
-        token.type = find->second;
-        return token;
+static constexpr std::array<KeywordEntry, KEYWORD_TABLE_SIZE> MakeKeywordTable()
+{
+    std::array<KeywordEntry, KEYWORD_TABLE_SIZE> table{};
+    for (auto &entry : table) entry = { "", lang::TokenType::ID };
+
+    for (const auto &keyword : KEYWORDS) {
+        if (keyword.text.size() < KEYWORD_MIN_LENGTH || keyword.text.size() > KEYWORD_MAX_LENGTH)
+            throw "keyword length outside of the hashed range";
+        auto &slot = table[KeywordHash(keyword.text)];
+        if (!slot.text.empty())
+            throw "keyword hash collision";
+        slot = keyword;
     }
 
-    return makeToken(lang::TokenType::UNKNOWN, std::string(1, m_fileContents[m_iter]));
+    return table;
 }
 
-lang::Token lang::LexicalAnalyzer::checkOperators()
+static constexpr auto KEYWORD_TABLE = MakeKeywordTable();
+
+lang::TokenType lang::LexicalAnalyzer::checkKeywords(std::string_view lexeme)
 {
-    for (const auto &op : m_Operators) {
-        if (m_slice.starts_with(op.first)) {
-            m_iter += op.first.size();
-            m_slice.remove_prefix(op.first.size());
-            m_position += op.first.size();
-            return makeToken(op.second, std::string(op.first));
-        }
-    }
+    if (lexeme.size() < KEYWORD_MIN_LENGTH || lexeme.size() > KEYWORD_MAX_LENGTH)
+        return lang::TokenType::ID;
 
-    return makeToken(lang::TokenType::UNKNOWN, std::string(1, m_fileContents[m_iter]));
+    const auto &entry = KEYWORD_TABLE[KeywordHash(lexeme)];
+    return entry.text == lexeme ? entry.type : lang::TokenType::ID;
 }
@@ -1,28 +1,20 @@
 #pragma once
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
 #include <fstream>
 #include <regex>
 #include <string>
 #include <string_view>
-#include <unordered_map>
 #include <vector>
 
-
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wmissing-template-arg-list-after-template-kw"
-
-#include "ctre.hpp"
-
-#pragma clang diagnostic pop
-
 #define TAB_SIZE 4
 #define NEXT_TAB_POS(pos) TAB_SIZE - ((pos - 1) % TAB_SIZE)
 
 namespace lang
 {
-    enum class TokenType {
+    enum class TokenType : std::uint8_t {
         BLOCK_COMMENT,
         INLINE_COMMENT,
         INT_NUM,
@@ -75,6 +67,8 @@ namespace lang
         UNKNOWN
     };
 
+    inline constexpr std::size_t TOKEN_TYPE_COUNT = static_cast<std::size_t>(TokenType::UNKNOWN) + 1;
+
     struct Token {
         TokenType type;
         std::string lexeme;
@@ -83,6 +77,17 @@ namespace lang
         std::string file_path;
     };
 
+    // Lexer output: a view into the mapped source of the file identified by file_id.
+    // The column is recomputed from the line start on demand, see LexicalAnalyzer::getColumn.
+    struct CompactToken {
+        std::uint32_t offset;
+        std::uint32_t length;
+        std::uint32_t line;
+        std::uint16_t file_id;
+        TokenType type;
+    };
+    static_assert(sizeof(CompactToken) == 16);
+
     std::string tokenTypeToCompString(TokenType type);
     std::string tokenTypeToString(TokenType type);
 
@@ -97,78 +102,36 @@ namespace lang
 
         std::uint64_t readFile(std::string_view path);
         void closeFile();
+        void setJobs(std::size_t jobs);
 
-        Token next();
+        CompactToken next();
         float getProgress() const;
 
         std::string_view getLine(std::uint64_t lineNumber) const;
 
+        std::string_view getLexeme(const CompactToken &token) const;
+        std::uint64_t getColumn(const CompactToken &token) const;
+        Token toToken(const CompactToken &token) const;
+
+        static std::uint16_t internFilePath(std::string_view path);
+        static const std::string &getFilePath(std::uint16_t id);
+
     private:
         int m_fd{ -1 };
         void *m_data{ nullptr };
 
         std::string_view m_fileContents;
         std::uint64_t m_fileSize{ 0 };
-        std::string m_filePath;
-        std::string_view m_slice;
+        std::uint16_t m_fileId{ 0 };
         std::uint64_t m_lineNumber{ 1 };
-        std::uint64_t m_position{ 1 };
         std::uint64_t m_iter{ 0 };
+        std::size_t m_jobs{ 1 };
+
+        std::vector<std::uint32_t> m_lineStartIndexes;
+
+        CompactToken makeToken(TokenType type, std::uint64_t offset, std::uint64_t length) const;
 
-        std::vector<std::uint64_t> m_lineStartIndexes;
-
-        struct LexRule {
-            TokenType type;
-            std::uint32_t (*match)(std::string_view);
-        };
-
-        static constexpr auto REGEX_BLOCK_COMMENT = ctre::multiline_starts_with<R"(\/\*[\s\S]*?\*\/)">;
-        static constexpr auto REGEX_INLINE_COMMENT = ctre::multiline_starts_with<R"(\/\/.*$)">;
-        static constexpr auto REGEX_FLOAT_NUM = ctre::starts_with<R"(([1-9][0-9]*|0)\.([0-9]*[1-9]|0)(e(\+|\-)?([1-9][0-9]*|0))?)">;
-        static constexpr auto REGEX_INT_NUM = ctre::starts_with<R"(([1-9][0-9]*)|0)">;
-        static constexpr auto REGEX_ID = ctre::starts_with<R"([a-zA-Z]([a-zA-Z]|[0-9]|_)*)">;
-
-        static std::uint32_t MatchBlockComment(std::string_view s);
-        static std::uint32_t MatchInlineComment(std::string_view s);
-        static std::uint32_t MatchFloatNum(std::string_view s);
-        static std::uint32_t MatchIntNum(std::string_view s);
-        static std::uint32_t MatchID(std::string_view s);
-
-        static constexpr LexRule rules[] = { { TokenType::BLOCK_COMMENT, MatchBlockComment },
-                                             { TokenType::INLINE_COMMENT, MatchInlineComment },
-                                             { TokenType::FLOAT_NUM, MatchFloatNum },
-                                             { TokenType::INT_NUM, MatchIntNum },
-                                             { TokenType::ID, MatchID } };
-
-        static const std::unordered_map<std::string, TokenType> m_Keywords;
-
-        static constexpr std::array<std::pair<std::string_view, TokenType>, 22> m_Operators{ { { "==", TokenType::EQUAL },
-                                                                                               { "<>", TokenType::NOT_EQUAL },
-                                                                                               { "<=", TokenType::LESS_EQUAL },
-                                                                                               { ">=", TokenType::GREATER_EQUAL },
-                                                                                               { "::", TokenType::DOUBLE_COLON },
-                                                                                               { "<", TokenType::LESS_THAN },
-                                                                                               { ">", TokenType::GREATER_THAN },
-                                                                                               { "+", TokenType::PLUS },
-                                                                                               { "-", TokenType::MINUS },
-                                                                                               { "*", TokenType::MULTIPLY },
-                                                                                               { "/", TokenType::DIVIDE },
-                                                                                               { "=", TokenType::ASSIGN },
-                                                                                               { "(", TokenType::OPEN_PARENTHESIS },
-                                                                                               { ")", TokenType::CLOSE_PARENTHESIS },
-                                                                                               { "{", TokenType::OPEN_BRACE },
-                                                                                               { "}", TokenType::CLOSE_BRACE },
-                                                                                               { ";", TokenType::SEMICOLON },
-                                                                                               { ",", TokenType::COMMA },
-                                                                                               { ".", TokenType::DOT },
-                                                                                               { ":", TokenType::COLON },
-                                                                                               { "[", TokenType::OPEN_BRACKET },
-                                                                                               { "]", TokenType::CLOSE_BRACKET } } };
-
-        Token makeToken(TokenType type, std::string lexeme);
-
-        Token runRegEx();
-        Token checkKeywords(lang::Token &token);
-        Token checkOperators();
+        CompactToken runDFA();
+        static TokenType checkKeywords(std::string_view lexeme);
     };
 } // namespace lang
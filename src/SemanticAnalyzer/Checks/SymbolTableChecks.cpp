@@ -1,104 +1,141 @@
 #include "../SemanticAnalyzer.hpp"
 
+#include <algorithm>
 #include <format>
 #include <functional>
-#include <set>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace lang
 {
+    // Hash and equality over a function's parameter TypeIds, optionally including its return TypeId.
+    template <bool WithReturn>
+    struct SignatureHash {
+        size_t operator()(const SymbolTableNode *f) const
+        {
+            size_t h = WithReturn ? std::hash<TypeId>{}(f->signature.typeId) : 0;
+            for (TypeId p : f->signature.paramTypeIds) h ^= std::hash<TypeId>{}(p) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            return h;
+        }
+    };
+
+    template <bool WithReturn>
+    struct SignatureEqual {
+        bool operator()(const SymbolTableNode *a, const SymbolTableNode *b) const
+        {
+            return (!WithReturn || a->signature.typeId == b->signature.typeId) && a->signature.paramTypeIds == b->signature.paramTypeIds;
+        }
+    };
+
+    // Buckets overloads by exact signature; each bucket lists positions in `funcs` in declaration order.
+    using SignatureGroups = std::unordered_map<const SymbolTableNode *, std::vector<size_t>, SignatureHash<true>, SignatureEqual<true>>;
+
+    static SignatureGroups GroupBySignature(const std::vector<SymbolTableNode *> &funcs)
+    {
+        SignatureGroups groups;
+        for (size_t i = 0; i < funcs.size(); ++i) groups[funcs[i]].push_back(i);
+        return groups;
+    }
+
     void SemanticAnalyzer::semanticChecks()
     {
         if (!m_symbolTable)
             return;
 
-        checkMultiplyDeclared(m_symbolTable);
-        checkFunctionDeclarationDefinitionParity(m_symbolTable);
-        checkOverloadsAndOverrides(m_symbolTable);
-        checkShadowing(m_symbolTable);
-        checkCircularDependencies(m_symbolTable);
-        checkUndeclaredClassTypes(m_symbolTable);
+        const SymbolTableIndex index = buildSymbolTableIndex(m_symbolTable);
+
+        checkMultiplyDeclared(index);
+        checkFunctionDeclarationDefinitionParity(m_symbolTable, index);
+        checkOverloadsAndOverrides(index);
+        checkShadowing(index);
+        checkCircularDependencies(index);
+        checkUndeclaredClassTypes(index);
 
         checkAllFunctionBodies(m_symbolTable);
     }
 
-    void SemanticAnalyzer::checkMultiplyDeclared(SymbolTableNode *globalTable)
+    SemanticAnalyzer::SymbolTableIndex SemanticAnalyzer::buildSymbolTableIndex(SymbolTableNode *globalTable) const
     {
-        std::unordered_map<std::string, SymbolTableNode *> seenClasses;
-        for (auto *entry : globalTable->table) {
-            if (entry->kind != SymbolTableNode::Kind::Class)
-                continue;
-            const std::string key = lowercase(entry->name);
-            if (seenClasses.count(key))
-                m_problems.error("8.1 multiply declared class", std::format("class '{}' was already declared", entry->name), { entry->token });
-            else
-                seenClasses[key] = entry;
-        }
-
-        {
-            std::unordered_map<std::string, std::vector<SymbolTableNode *>> freeFuncs;
-            for (auto *entry : globalTable->table) {
-                if (entry->kind == SymbolTableNode::Kind::Function)
-                    freeFuncs[lowercase(entry->name)].push_back(entry);
-            }
-            for (auto &[name, funcs] : freeFuncs) {
-                for (size_t i = 0; i < funcs.size(); ++i) {
-                    for (size_t j = i + 1; j < funcs.size(); ++j) {
-                        if (funcs[i]->signature.params == funcs[j]->signature.params && funcs[i]->signature.type == funcs[j]->signature.type) {
-                            m_problems.error(
-                                "8.2 multiply declared free function",
-                                std::format("free function '{}' with this signature was already declared", funcs[j]->name),
-                                { funcs[j]->token });
-                        }
-                    }
-                }
+        auto scopeOf = [](SymbolTableNode *function) {
+            SymbolTableIndex::FunctionScope scope{ function, {} };
+            for (auto *entry : function->table) {
+                if (entry->kind == SymbolTableNode::Kind::Parameter || entry->kind == SymbolTableNode::Kind::Local)
+                    scope.variables.push_back(entry);
             }
-        }
+            return scope;
+        };
 
+        SymbolTableIndex index;
         for (auto *entry : globalTable->table) {
-            if (entry->kind == SymbolTableNode::Kind::Class) {
-                std::unordered_map<std::string, SymbolTableNode *> seenData;
-                for (auto *member : entry->table) {
-                    if (member->kind != SymbolTableNode::Kind::Data)
-                        continue;
-                    const std::string key = lowercase(member->name);
-                    if (seenData.count(key))
-                        m_problems.error(
-                            "8.3 multiply declared data member in class",
-                            std::format("data member '{}' in class '{}' was already declared", member->name, entry->name),
-                            { member->token });
-                    else
-                        seenData[key] = member;
-                }
+            if (entry->kind == SymbolTableNode::Kind::Function) {
+                index.freeFunctions.push_back(scopeOf(entry));
+                index.freeFunctionGroups[*entry->key].push_back(entry);
+            } else if (entry->kind == SymbolTableNode::Kind::Class) {
+                auto &members = index.classes.emplace_back(SymbolTableIndex::ClassMembers{ entry, {}, {}, {} });
                 for (auto *member : entry->table) {
-                    if (member->kind == SymbolTableNode::Kind::Function)
-                        checkMultiplyDeclaredInFunction(member);
+                    if (member->kind == SymbolTableNode::Kind::Data) {
+                        members.data.push_back(member);
+                    } else if (member->kind == SymbolTableNode::Kind::Function) {
+                        members.functions.push_back(scopeOf(member));
+                        members.functionGroups[*member->key].push_back(member);
+                    }
                 }
             }
-            if (entry->kind == SymbolTableNode::Kind::Function)
-                checkMultiplyDeclaredInFunction(entry);
         }
+        return index;
     }
 
-    void SemanticAnalyzer::checkMultiplyDeclaredInFunction(SymbolTableNode *funcNode)
+    void SemanticAnalyzer::checkMultiplyDeclared(const SymbolTableIndex &index)
     {
-        std::unordered_map<std::string, SymbolTableNode *> seen;
-        for (auto *entry : funcNode->table) {
-            if (entry->kind != SymbolTableNode::Kind::Parameter && entry->kind != SymbolTableNode::Kind::Local)
+        std::unordered_map<const std::string *, SymbolTableNode *> seenClasses;
+        for (const auto &cls : index.classes) {
+            if (!seenClasses.try_emplace(cls.node->key, cls.node).second)
+                m_problems.error("8.1 multiply declared class", std::format("class '{}' was already declared", cls.node->name), { cls.node->token });
+        }
+
+        for (auto &[name, funcs] : index.freeFunctionGroups) {
+            if (funcs.size() <= 1)
                 continue;
-            const std::string key = lowercase(entry->name);
-            if (seen.count(key))
+            // every later declaration with the same signature is reported once per earlier one, in (earlier, later) order
+            const SignatureGroups groups = GroupBySignature(funcs);
+            for (size_t i = 0; i < funcs.size(); ++i) {
+                const auto &group = groups.at(funcs[i]);
+                for (auto it = std::upper_bound(group.begin(), group.end(), i); it != group.end(); ++it)
+                    m_problems.error(
+                        "8.2 multiply declared free function",
+                        std::format("free function '{}' with this signature was already declared", funcs[*it]->name),
+                        { funcs[*it]->token });
+            }
+        }
+
+        for (const auto &cls : index.classes) {
+            std::unordered_map<const std::string *, SymbolTableNode *> seenData;
+            for (auto *member : cls.data) {
+                if (!seenData.try_emplace(member->key, member).second)
+                    m_problems.error(
+                        "8.3 multiply declared data member in class",
+                        std::format("data member '{}' in class '{}' was already declared", member->name, cls.node->name),
+                        { member->token });
+            }
+            for (const auto &function : cls.functions) checkMultiplyDeclaredInFunction(function);
+        }
+        for (const auto &function : index.freeFunctions) checkMultiplyDeclaredInFunction(function);
+    }
+
+    void SemanticAnalyzer::checkMultiplyDeclaredInFunction(const SymbolTableIndex::FunctionScope &function)
+    {
+        std::unordered_map<const std::string *, SymbolTableNode *> seen;
+        for (auto *entry : function.variables) {
+            if (!seen.try_emplace(entry->key, entry).second)
                 m_problems.error(
                     "8.4 multiply declared variable in function",
-                    std::format("variable '{}' in function '{}' was already declared", entry->name, funcNode->name),
+                    std::format("variable '{}' in function '{}' was already declared", entry->name, function.node->name),
                     { entry->token });
-            else
-                seen[key] = entry;
         }
     }
 
-    void SemanticAnalyzer::checkFunctionDeclarationDefinitionParity(SymbolTableNode *globalTable)
+    void SemanticAnalyzer::checkFunctionDeclarationDefinitionParity(SymbolTableNode *globalTable, const SymbolTableIndex &index)
     {
         if (!m_ast || m_ast->children.size() < 2)
             return;
@@ -119,7 +156,7 @@ namespace lang
             }
         };
 
-        std::unordered_map<FuncKey, std::shared_ptr<const ASTNode>, FuncKeyHash> definitions;
+        std::unordered_map<FuncKey, const ASTNode *, FuncKeyHash> definitions;
 
         for (const auto &funcDef : funcDefList->children) {
             if (!funcDef || funcDef->kind != ASTNode::Kind::FuncDef || funcDef->children.size() < 4)
@@ -131,25 +168,37 @@ namespace lang
             const std::string funcName = nameNode->children[1]->lexeme;
             const std::string retType = normalizeType(funcDef->children[0]->lexeme);
             const std::vector<std::string> params = parameterTypes(funcDef->children[2]);
-            definitions[{ lowercase(className), lowercase(funcName), params, retType }] = funcDef;
+            definitions[{ SymbolInterner::Fold(className), SymbolInterner::Fold(funcName), params, retType }] = funcDef;
         }
 
-        for (auto *classEntry : globalTable->table) {
-            if (classEntry->kind != SymbolTableNode::Kind::Class)
-                continue;
-            for (auto *funcEntry : classEntry->table) {
-                if (funcEntry->kind != SymbolTableNode::Kind::Function)
-                    continue;
-                FuncKey key{ lowercase(classEntry->name), lowercase(funcEntry->name), funcEntry->signature.params, funcEntry->signature.type };
+        for (const auto &cls : index.classes) {
+            for (const auto &function : cls.functions) {
+                const SymbolTableNode *funcEntry = function.node;
+                FuncKey key{ *cls.node->key, *funcEntry->key, funcEntry->signature.params, funcEntry->signature.type };
                 if (!definitions.count(key))
                     m_problems.error(
                         "6.2 undefined member function declaration",
-                        std::format("member function '{}::{}' is declared but has no definition", classEntry->name, funcEntry->name),
+                        std::format("member function '{}::{}' is declared but has no definition", cls.node->name, funcEntry->name),
                         { funcEntry->token });
             }
         }
 
+        std::unordered_set<FuncKey, FuncKeyHash> declarations;
         const auto &classList = m_ast->children[0];
+        if (classList && classList->kind == ASTNode::Kind::ClassList) {
+            for (const auto &classNode : classList->children) {
+                if (!classNode || classNode->children.empty())
+                    continue;
+                const std::string classKey = SymbolInterner::Fold(classNode->children[0]->lexeme);
+                for (const auto &member : classNode->children) {
+                    if (member->kind != ASTNode::Kind::FuncDecl || member->children.size() < 3)
+                        continue;
+                    declarations.insert(
+                        { classKey, SymbolInterner::Fold(member->children[1]->lexeme), parameterTypes(member->children[2]), normalizeType(member->children[0]->lexeme) });
+                }
+            }
+        }
+
         for (const auto &funcDef : funcDefList->children) {
             if (!funcDef || funcDef->kind != ASTNode::Kind::FuncDef || funcDef->children.size() < 4)
                 continue;
@@ -165,26 +214,7 @@ namespace lang
             if (!classSymbol)
                 continue;
 
-            bool hasDeclAST = false;
-            if (classList && classList->kind == ASTNode::Kind::ClassList) {
-                for (const auto &classNode : classList->children) {
-                    if (!classNode || classNode->children.empty())
-                        continue;
-                    if (lowercase(classNode->children[0]->lexeme) != lowercase(className))
-                        continue;
-                    for (const auto &member : classNode->children) {
-                        if (member->kind != ASTNode::Kind::FuncDecl || member->children.size() < 3)
-                            continue;
-                        if (lowercase(member->children[1]->lexeme) == lowercase(funcName) && normalizeType(member->children[0]->lexeme) == retType &&
-                            parameterTypes(member->children[2]) == params) {
-                            hasDeclAST = true;
-                            break;
-                        }
-                    }
-                    if (hasDeclAST)
-                        break;
-                }
-            }
+            const bool hasDeclAST = declarations.count({ SymbolInterner::Fold(className), SymbolInterner::Fold(funcName), params, retType }) > 0;
 
             if (!hasDeclAST)
                 m_problems.error(
@@ -194,76 +224,46 @@ namespace lang
         }
     }
 
-    void SemanticAnalyzer::checkOverloadsAndOverrides(SymbolTableNode *globalTable)
+    void SemanticAnalyzer::checkOverloads(const std::vector<SymbolTableNode *> &funcs, const SymbolTableNode *classEntry)
     {
-        std::unordered_map<std::string, std::vector<SymbolTableNode *>> freeFuncsByName;
-        for (auto *entry : globalTable->table) {
-            if (entry->kind == SymbolTableNode::Kind::Function)
-                freeFuncsByName[lowercase(entry->name)].push_back(entry);
-        }
-        for (auto &[name, funcs] : freeFuncsByName) {
-            if (funcs.size() <= 1)
-                continue;
-            std::set<std::vector<std::string>> seenParams;
-            for (auto *f : funcs) seenParams.insert(f->signature.params);
-            if (seenParams.size() <= 1)
+        if (funcs.size() <= 1)
+            return;
+
+        std::unordered_set<const SymbolTableNode *, SignatureHash<false>, SignatureEqual<false>> distinctParams(funcs.begin(), funcs.end());
+        if (distinctParams.size() <= 1)
+            return;
+
+        // a declaration is an overload unless an earlier one has exactly the same signature
+        const SignatureGroups groups = GroupBySignature(funcs);
+        for (size_t i = 1; i < funcs.size(); ++i) {
+            if (groups.at(funcs[i]).front() != i)
                 continue;
-            for (size_t i = 1; i < funcs.size(); ++i) {
-                bool isExact = false;
-                for (size_t j = 0; j < i; ++j) {
-                    if (funcs[j]->signature.params == funcs[i]->signature.params && funcs[j]->signature.type == funcs[i]->signature.type) {
-                        isExact = true;
-                        break;
-                    }
-                }
-                if (!isExact)
-                    m_problems.warn("9.1 overloaded free function", std::format("free function '{}' is overloaded", funcs[i]->name), { funcs[i]->token });
-            }
+            if (classEntry)
+                m_problems.warn(
+                    "9.2 overloaded member function",
+                    std::format("member function '{}::{}' is overloaded", classEntry->name, funcs[i]->name),
+                    { funcs[i]->token });
+            else
+                m_problems.warn("9.1 overloaded free function", std::format("free function '{}' is overloaded", funcs[i]->name), { funcs[i]->token });
         }
+    }
 
-        for (auto *classEntry : globalTable->table) {
-            if (classEntry->kind != SymbolTableNode::Kind::Class)
-                continue;
+    void SemanticAnalyzer::checkOverloadsAndOverrides(const SymbolTableIndex &index)
+    {
+        for (auto &[name, funcs] : index.freeFunctionGroups) checkOverloads(funcs, nullptr);
 
-            std::unordered_map<std::string, std::vector<SymbolTableNode *>> memberFuncsByName;
-            for (auto *member : classEntry->table) {
-                if (member->kind == SymbolTableNode::Kind::Function)
-                    memberFuncsByName[lowercase(member->name)].push_back(member);
-            }
-            for (auto &[name, funcs] : memberFuncsByName) {
-                if (funcs.size() <= 1)
-                    continue;
-                std::set<std::vector<std::string>> seenParams;
-                for (auto *f : funcs) seenParams.insert(f->signature.params);
-                if (seenParams.size() <= 1)
-                    continue;
-                for (size_t i = 1; i < funcs.size(); ++i) {
-                    bool isExact = false;
-                    for (size_t j = 0; j < i; ++j) {
-                        if (funcs[j]->signature.params == funcs[i]->signature.params && funcs[j]->signature.type == funcs[i]->signature.type) {
-                            isExact = true;
-                            break;
-                        }
-                    }
-                    if (!isExact)
-                        m_problems.warn(
-                            "9.2 overloaded member function",
-                            std::format("member function '{}::{}' is overloaded", classEntry->name, funcs[i]->name),
-                            { funcs[i]->token });
-                }
-            }
+        for (const auto &cls : index.classes) {
+            for (auto &[name, funcs] : cls.functionGroups) checkOverloads(funcs, cls.node);
 
-            for (auto *parentClass : collectInheritedClasses(classEntry)) {
-                for (auto *member : classEntry->table) {
-                    if (member->kind != SymbolTableNode::Kind::Function)
-                        continue;
-                    for (auto *parentMember : parentClass->table) {
-                        if (parentMember->kind == SymbolTableNode::Kind::Function && lowercase(member->name) == lowercase(parentMember->name) &&
-                            member->signature.params == parentMember->signature.params) {
+            for (auto *parentClass : collectInheritedClasses(cls.node)) {
+                for (const auto &function : cls.functions) {
+                    const SymbolTableNode *member = function.node;
+                    for (auto *parentMember : parentClass->entriesNamed(member->key)) {
+                        if (parentMember->kind == SymbolTableNode::Kind::Function && member->signature.paramTypeIds == parentMember->signature.paramTypeIds) {
                             m_problems.warn(
                                 "9.3 overridden member function",
                                 std::format(
-                                    "member function '{}::{}' overrides '{}::{}'", classEntry->name, member->name, parentClass->name, parentMember->name),
+                                    "member function '{}::{}' overrides '{}::{}'", cls.node->name, member->name, parentClass->name, parentMember->name),
                                 { member->token });
                         }
                     }
@@ -272,46 +272,39 @@ namespace lang
         }
     }
 
-    void SemanticAnalyzer::checkShadowing(SymbolTableNode *globalTable)
+    void SemanticAnalyzer::checkShadowing(const SymbolTableIndex &index)
     {
-        for (auto *classEntry : globalTable->table) {
-            if (classEntry->kind != SymbolTableNode::Kind::Class)
-                continue;
-
-            auto parents = collectInheritedClasses(classEntry);
+        for (const auto &cls : index.classes) {
+            const auto &parents = collectInheritedClasses(cls.node);
 
-            for (auto *member : classEntry->table) {
-                if (member->kind != SymbolTableNode::Kind::Data)
-                    continue;
+            for (auto *member : cls.data) {
                 for (auto *parentClass : parents) {
-                    for (auto *parentMember : parentClass->table) {
-                        if (parentMember->kind == SymbolTableNode::Kind::Data && lowercase(parentMember->name) == lowercase(member->name)) {
+                    for (auto *parentMember : parentClass->entriesNamed(member->key)) {
+                        if (parentMember->kind == SymbolTableNode::Kind::Data) {
                             m_problems.warn(
                                 "8.5 shadowed inherited data member",
                                 std::format(
-                                    "data member '{}' in class '{}' shadows inherited member from '{}'", member->name, classEntry->name, parentClass->name),
+                                    "data member '{}' in class '{}' shadows inherited member from '{}'", member->name, cls.node->name, parentClass->name),
                                 { member->token });
                         }
                     }
                 }
             }
 
-            for (auto *funcEntry : classEntry->table) {
-                if (funcEntry->kind != SymbolTableNode::Kind::Function)
-                    continue;
-                for (auto *local : funcEntry->table) {
+            for (const auto &function : cls.functions) {
+                for (auto *local : function.variables) {
                     if (local->kind != SymbolTableNode::Kind::Local)
                         continue;
-                    for (auto *dataMember : classEntry->table) {
-                        if (dataMember->kind == SymbolTableNode::Kind::Data && lowercase(dataMember->name) == lowercase(local->name)) {
+                    for (auto *dataMember : cls.node->entriesNamed(local->key)) {
+                        if (dataMember->kind == SymbolTableNode::Kind::Data) {
                             m_problems.warn(
                                 "8.6 local variable shadows data member",
                                 std::format(
                                     "local variable '{}' in '{}::{}' shadows a data member of class '{}'",
                                     local->name,
-                                    classEntry->name,
-                                    funcEntry->name,
-                                    classEntry->name),
+                                    cls.node->name,
+                                    function.node->name,
+                                    cls.node->name),
                                 { local->token });
                         }
                     }
@@ -320,27 +313,24 @@ namespace lang
         }
     }
 
-    void SemanticAnalyzer::checkCircularDependencies(SymbolTableNode *globalTable)
+    void SemanticAnalyzer::checkCircularDependencies(const SymbolTableIndex &index)
     {
         enum class Color {
             White,
             Gray,
             Black
         };
-        std::unordered_map<std::string, Color> color;
+        std::unordered_map<const std::string *, Color> color;
 
-        for (auto *entry : globalTable->table) {
-            if (entry->kind == SymbolTableNode::Kind::Class)
-                color[lowercase(entry->name)] = Color::White;
-        }
+        for (const auto &cls : index.classes) color[cls.node->key] = Color::White;
 
         std::function<bool(SymbolTableNode *, std::vector<std::string> &)> dfs = [&](SymbolTableNode *node, std::vector<std::string> &path) -> bool {
-            const std::string key = lowercase(node->name);
+            const std::string *key = node->key;
             color[key] = Color::Gray;
             path.push_back(node->name);
 
             for (auto *parentClass : collectInheritedClasses(node)) {
-                const std::string parentKey = lowercase(parentClass->name);
+                const std::string *parentKey = parentClass->key;
                 if (color[parentKey] == Color::Gray) {
                     m_problems.error(
                         "14.1 circular class dependency", std::format("circular class dependency detected involving class '{}'", node->name), { node->token });
@@ -358,47 +348,36 @@ namespace lang
             return false;
         };
 
-        for (auto *entry : globalTable->table) {
-            if (entry->kind == SymbolTableNode::Kind::Class && color[lowercase(entry->name)] == Color::White) {
+        for (const auto &cls : index.classes) {
+            if (color[cls.node->key] == Color::White) {
                 std::vector<std::string> path;
-                dfs(entry, path);
+                dfs(cls.node, path);
             }
         }
     }
 
-    void SemanticAnalyzer::checkUndeclaredClassTypes(SymbolTableNode *globalTable)
+    void SemanticAnalyzer::checkUndeclaredClassTypes(const SymbolTableIndex &index)
     {
-        auto check = [&](SymbolTableNode *node, const std::string &typeStr) {
-            const std::string base = StripAllDimensions(typeStr);
-            if (base.empty() || base == "int" || base == "float" || base == "void")
+        auto check = [&](SymbolTableNode *node) {
+            const TypeId type = node->signature.typeId;
+            if (!type || type->scalar->base != TypeInfo::Base::Class || type->scalar->classNode)
                 return;
-            const std::string key = lowercase(base);
+            const std::string &base = type->scalar->spelling;
+            const std::string key = SymbolInterner::Fold(base);
             if (key == "int" || key == "integer" || key == "float" || key == "void")
                 return;
-            if (!m_classTypeNames.count(key))
-                m_problems.error("11.5 undeclared class", std::format("type '{}' is not a declared class", base), { node->token });
+            m_problems.error("11.5 undeclared class", std::format("type '{}' is not a declared class", base), { node->token });
         };
 
-        for (auto *entry : globalTable->table) {
-            if (entry->kind == SymbolTableNode::Kind::Class) {
-                for (auto *member : entry->table) {
-                    if (member->kind == SymbolTableNode::Kind::Data)
-                        check(member, member->signature.type);
-                    if (member->kind == SymbolTableNode::Kind::Function) {
-                        for (auto *local : member->table) {
-                            if (local->kind == SymbolTableNode::Kind::Parameter || local->kind == SymbolTableNode::Kind::Local)
-                                check(local, local->signature.type);
-                        }
-                    }
-                }
-            }
-            if (entry->kind == SymbolTableNode::Kind::Function) {
-                for (auto *local : entry->table) {
-                    if (local->kind == SymbolTableNode::Kind::Parameter || local->kind == SymbolTableNode::Kind::Local)
-                        check(local, local->signature.type);
-                }
+        for (const auto &cls : index.classes) {
+            for (auto *member : cls.data) check(member);
+            for (const auto &function : cls.functions) {
+                for (auto *variable : function.variables) check(variable);
             }
         }
+        for (const auto &function : index.freeFunctions) {
+            for (auto *variable : function.variables) check(variable);
+        }
     }
 
 } // namespace lang
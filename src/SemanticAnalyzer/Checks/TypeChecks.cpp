@@ -1,86 +1,83 @@
 #include "../SemanticAnalyzer.hpp"
+#include "AST/ASTWalker.hpp"
+#include "utils/ParallelFor.hpp"
 
+#include <cstddef>
 #include <format>
+#include <span>
 #include <vector>
 
 namespace lang
 {
-    int SemanticAnalyzer::CountArrayDimensions(const std::string &type)
-    {
-        int count = 0;
-        for (char c : type) {
-            if (c == '[')
-                ++count;
-        }
-        return count;
-    }
+    using ChildSpan = std::span<ASTNode *const>;
 
-    std::string SemanticAnalyzer::StripAllDimensions(const std::string &type)
+    // Nodes the type walk goes through without typing them: a call's argument list, the callee of a method call, and the
+    // call in `obj.f(...)`. They only lead to operands of the expression above them.
+    static bool GroupsOperands(const ASTNode *node)
     {
-        const size_t pos = type.find('[');
-        return pos == std::string::npos ? type : type.substr(0, pos);
+        const ASTNode *parent = node->parent;
+        if (!parent || parent->children.size() < 2)
+            return false;
+        if (parent->kind == ASTNode::Kind::FuncCall)
+            return node == parent->children[1] || (node == parent->children[0] && node->kind == ASTNode::Kind::MemberAccess);
+        return parent->kind == ASTNode::Kind::MemberAccess && node == parent->children[1] && node->kind == ASTNode::Kind::FuncCall;
     }
 
-    std::string SemanticAnalyzer::StripOneDimension(const std::string &type)
+    // The operands inferNodeType reads, in the order it reads them. Typing these bottom-up ahead of the node gives the same
+    // diagnostics in the same order as recursing from inferNodeType would, as long as an operand it would never reach is
+    // skipped (see SemanticAnalyzer::inferType).
+    static ChildSpan OperandsInferredFirst(const ASTNode *node, bool grouping)
     {
-        const size_t pos = type.find('[');
-        if (pos == std::string::npos)
-            return type;
-        const size_t end = type.find(']', pos);
-        return end == std::string::npos ? type : type.substr(0, pos) + type.substr(end + 1);
+        const ChildSpan children(node->children);
+        if (grouping) {
+            if (node->kind == ASTNode::Kind::MemberAccess)
+                return children.first(1);
+            if (node->kind == ASTNode::Kind::FuncCall)
+                return children.subspan(1, 1);
+            return children;
+        }
+        switch (node->kind) {
+            case ASTNode::Kind::AddOp:
+            case ASTNode::Kind::MultOp:
+            case ASTNode::Kind::RelOp:
+                return children.size() >= 2 ? children.first(2) : ChildSpan();
+            case ASTNode::Kind::NotExpr:
+            case ASTNode::Kind::SignExpr:
+                return children.first(children.empty() ? 0 : 1);
+            case ASTNode::Kind::MemberAccess:
+                if (children.size() < 2)
+                    return {};
+                return children[1] && children[1]->kind == ASTNode::Kind::FuncCall && children[1]->children.size() >= 2 ? children.first(2) : children.first(1);
+            case ASTNode::Kind::IndexedVar:
+                if (children.size() < 2 || !children[0])
+                    return {};
+                return children[0]->kind == ASTNode::Kind::Id ? children.subspan(1, 1) : children.first(2);
+            case ASTNode::Kind::FuncCall:
+                {
+                    if (children.size() < 2 || !children[0] || !children[1])
+                        return {};
+                    const ASTNode *callee = children[0];
+                    if (callee->kind == ASTNode::Kind::MemberAccess)
+                        return callee->children.size() >= 2 ? children.first(2) : ChildSpan();
+                    return children.subspan(1, 1);
+                }
+            default:
+                return {};
+        }
     }
 
-    bool SemanticAnalyzer::TypesCompatible(const std::string &a, const std::string &b)
+    const std::vector<SymbolTableNode *> &SemanticAnalyzer::collectInheritedClasses(SymbolTableNode *classNode) const
     {
-        if (a.empty() || b.empty())
-            return true;
-        if (a == b)
-            return true;
-        if (a == "int" && b == "float")
-            return true;
-        return false;
-    }
-
-    std::vector<SymbolTableNode *> SemanticAnalyzer::collectInheritedClasses(SymbolTableNode *classNode) const
-    {
-        std::vector<SymbolTableNode *> result;
-        if (!classNode)
-            return result;
-
-        for (const auto *entry : classNode->table) {
-            if (entry->kind != SymbolTableNode::Kind::Inherit)
-                continue;
-            if (entry->name == "none" || entry->name.empty())
-                break;
-
-            std::string names = entry->name;
-            size_t pos = 0;
-            while (pos < names.size()) {
-                size_t comma = names.find(',', pos);
-                std::string parentName = (comma == std::string::npos) ? names.substr(pos) : names.substr(pos, comma - pos);
-                while (!parentName.empty() && parentName.front() == ' ') parentName.erase(0, 1);
-                while (!parentName.empty() && parentName.back() == ' ') parentName.pop_back();
-                if (!parentName.empty()) {
-                    SymbolTableNode *parentClass = findClassByName(parentName);
-                    if (parentClass)
-                        result.push_back(parentClass);
-                }
-                if (comma == std::string::npos)
-                    break;
-                pos = comma + 1;
-            }
-            break;
-        }
-        return result;
+        static const std::vector<SymbolTableNode *> none;
+        return classNode ? classNode->bases : none;
     }
 
     SymbolTableNode *SemanticAnalyzer::findClassByName(const std::string &name) const
     {
         if (!m_symbolTable)
             return nullptr;
-        const std::string key = lowercase(name);
-        for (auto *entry : m_symbolTable->table) {
-            if (entry->kind == SymbolTableNode::Kind::Class && lowercase(entry->name) == key)
+        for (auto *entry : m_symbolTable->entriesNamed(m_symbolKeys.find(name))) {
+            if (entry->kind == SymbolTableNode::Kind::Class)
                 return entry;
         }
         return nullptr;
@@ -90,27 +87,25 @@ namespace lang
     {
         if (!m_symbolTable)
             return nullptr;
-        const std::string key = lowercase(name);
-        for (auto *entry : m_symbolTable->table) {
-            if (entry->kind == SymbolTableNode::Kind::Function && lowercase(entry->name) == key)
+        for (auto *entry : m_symbolTable->entriesNamed(m_symbolKeys.find(name))) {
+            if (entry->kind == SymbolTableNode::Kind::Function)
                 return entry;
         }
         return nullptr;
     }
 
-    SymbolTableNode *SemanticAnalyzer::findFreeFunctionByNameAndArgs(const std::string &name, const std::vector<std::string> &argTypes) const
+    SymbolTableNode *SemanticAnalyzer::findFreeFunctionByNameAndArgs(const std::string &name, const std::vector<TypeId> &argTypes) const
     {
         if (!m_symbolTable)
             return nullptr;
-        const std::string key = lowercase(name);
         SymbolTableNode *bestMatch = nullptr;
-        for (auto *entry : m_symbolTable->table) {
-            if (entry->kind != SymbolTableNode::Kind::Function || lowercase(entry->name) != key)
+        for (auto *entry : m_symbolTable->entriesNamed(m_symbolKeys.find(name))) {
+            if (entry->kind != SymbolTableNode::Kind::Function)
                 continue;
-            if (entry->signature.params.size() == argTypes.size()) {
+            if (entry->signature.paramTypeIds.size() == argTypes.size()) {
                 bool allMatch = true;
                 for (size_t i = 0; i < argTypes.size(); ++i) {
-                    if (!argTypes[i].empty() && !entry->signature.params[i].empty() && argTypes[i] != entry->signature.params[i]) {
+                    if (argTypes[i] && entry->signature.paramTypeIds[i] && argTypes[i] != entry->signature.paramTypeIds[i]) {
                         allMatch = false;
                         break;
                     }
@@ -128,11 +123,13 @@ namespace lang
 
     SymbolTableNode *SemanticAnalyzer::lookupInScope(const std::string &name, const ScopeContext &ctx) const
     {
-        const std::string key = lowercase(name);
+        const std::string *key = m_symbolKeys.find(name);
+        if (!key)
+            return nullptr;
 
         if (ctx.function_node) {
-            for (auto *entry : ctx.function_node->table) {
-                if ((entry->kind == SymbolTableNode::Kind::Local || entry->kind == SymbolTableNode::Kind::Parameter) && lowercase(entry->name) == key)
+            for (auto *entry : ctx.function_node->entriesNamed(key)) {
+                if (entry->kind == SymbolTableNode::Kind::Local || entry->kind == SymbolTableNode::Kind::Parameter)
                     return entry;
             }
         }
@@ -144,8 +141,8 @@ namespace lang
         }
 
         if (ctx.global_table) {
-            for (auto *entry : ctx.global_table->table) {
-                if (entry->kind == SymbolTableNode::Kind::Function && lowercase(entry->name) == key)
+            for (auto *entry : ctx.global_table->entriesNamed(key)) {
+                if (entry->kind == SymbolTableNode::Kind::Function)
                     return entry;
             }
         }
@@ -157,10 +154,12 @@ namespace lang
     {
         if (!classNode)
             return nullptr;
-        const std::string key = lowercase(name);
+        const std::string *key = m_symbolKeys.find(name);
+        if (!key)
+            return nullptr;
 
-        for (auto *entry : classNode->table) {
-            if ((entry->kind == SymbolTableNode::Kind::Data || entry->kind == SymbolTableNode::Kind::Function) && lowercase(entry->name) == key)
+        for (auto *entry : classNode->entriesNamed(key)) {
+            if (entry->kind == SymbolTableNode::Kind::Data || entry->kind == SymbolTableNode::Kind::Function)
                 return entry;
         }
 
@@ -181,57 +180,87 @@ namespace lang
         const auto &funcDefList = m_ast->children[1];
         const auto &programBlock = m_ast->children[2];
 
+        std::vector<const ASTNode *> funcDefs;
         if (funcDefList && funcDefList->kind == ASTNode::Kind::FuncDefList) {
             for (const auto &funcDef : funcDefList->children) {
-                if (!funcDef || funcDef->kind != ASTNode::Kind::FuncDef || funcDef->children.size() < 4)
-                    continue;
-
-                const auto &nameNode = funcDef->children[1];
-                const auto &paramListNode = funcDef->children[2];
-                const auto &statBlockNode = funcDef->children[3];
-                const auto &retTypeNode = funcDef->children[0];
-
-                const std::string retType = normalizeType(retTypeNode->lexeme);
-                const std::vector<std::string> params = parameterTypes(paramListNode);
-
-                ScopeContext ctx;
-                ctx.global_table = globalTable;
-
-                if (nameNode->kind == ASTNode::Kind::MemberAccess && nameNode->children.size() == 2) {
-                    const std::string className = normalizeType(nameNode->children[0]->lexeme);
-                    const std::string funcName = nameNode->children[1]->lexeme;
-                    ctx.class_node = findClassByName(className);
-                    if (ctx.class_node)
-                        ctx.function_node = findMemberFunctionSymbol(ctx.class_node, funcName, params, retType);
-                } else if (nameNode->kind == ASTNode::Kind::Id) {
-                    ctx.function_node = findFreeFunctionByNameAndArgs(nameNode->lexeme, params);
-                }
-
-                checkStatBlock(statBlockNode, ctx);
+                if (funcDef && funcDef->kind == ASTNode::Kind::FuncDef && funcDef->children.size() >= 4)
+                    funcDefs.push_back(funcDef);
             }
         }
 
-        {
+        // One task per definition plus main, each reporting into its own buffer; merging the buffers by index keeps
+        // the diagnostics in source order whatever order the tasks ran in.
+        std::vector<Problems> problems(funcDefs.size() + 1);
+        ParallelFor(problems.size(), m_checkJobs, [&](std::size_t i) {
             ScopeContext ctx;
+            ctx.problems = &problems[i];
             ctx.global_table = globalTable;
-            for (auto *entry : globalTable->table) {
-                if (entry->kind == SymbolTableNode::Kind::Function && lowercase(entry->name) == "main") {
-                    ctx.function_node = entry;
-                    break;
+
+            if (i == funcDefs.size()) {
+                for (auto *entry : globalTable->table) {
+                    if (entry->kind == SymbolTableNode::Kind::Function && *entry->key == "main") {
+                        ctx.function_node = entry;
+                        break;
+                    }
                 }
+                checkStatBlock(programBlock, ctx);
+                return;
             }
-            checkStatBlock(programBlock, ctx);
-        }
+
+            const auto *funcDef = funcDefs[i];
+            const auto &nameNode = funcDef->children[1];
+            const auto &paramListNode = funcDef->children[2];
+            const auto &statBlockNode = funcDef->children[3];
+            const auto &retTypeNode = funcDef->children[0];
+
+            const std::string retType = normalizeType(retTypeNode->lexeme);
+            const std::vector<std::string> params = parameterTypes(paramListNode);
+
+            if (nameNode->kind == ASTNode::Kind::MemberAccess && nameNode->children.size() == 2) {
+                const std::string className = normalizeType(nameNode->children[0]->lexeme);
+                const std::string funcName = nameNode->children[1]->lexeme;
+                ctx.class_node = findClassByName(className);
+                if (ctx.class_node)
+                    ctx.function_node = findMemberFunctionSymbol(ctx.class_node, funcName, params, retType);
+            } else if (nameNode->kind == ASTNode::Kind::Id) {
+                std::vector<TypeId> paramTypes;
+                for (const auto &param : params) paramTypes.push_back(m_types.intern(param));
+                ctx.function_node = findFreeFunctionByNameAndArgs(nameNode->lexeme, paramTypes);
+            }
+
+            checkStatBlock(statBlockNode, ctx);
+        });
+
+        for (const auto &buffer : problems) m_problems.merge(buffer);
     }
 
-    void SemanticAnalyzer::checkStatBlock(std::shared_ptr<const ASTNode> statBlock, const ScopeContext &ctx)
+    void SemanticAnalyzer::checkStatBlock(const ASTNode *statBlock, const ScopeContext &ctx)
     {
-        if (!statBlock)
-            return;
-        for (const auto &stmt : statBlock->children) checkStatement(stmt, ctx);
+        // Blocks and statements alternate down the walk: the root is a block, its children are statements, and the
+        // children walked under an if or while are its blocks.
+        struct {
+            SemanticAnalyzer &self;
+            const ScopeContext &ctx;
+            std::size_t depth = 0;
+
+            bool enter(const ASTNode *node)
+            {
+                const bool isBlock = depth++ % 2 == 0;
+                if (!node)
+                    return false;
+                if (!isBlock)
+                    self.checkStatement(node, ctx);
+                return true;
+            }
+
+            ChildSpan children(const ASTNode *node) const { return (depth - 1) % 2 == 0 ? ChildSpan(node->children) : NestedStatBlocks(node); }
+
+            void leave(const ASTNode *) { depth--; }
+        } visitor{ *this, ctx };
+        WalkAST(statBlock, visitor);
     }
 
-    void SemanticAnalyzer::checkStatement(std::shared_ptr<const ASTNode> stmt, const ScopeContext &ctx)
+    void SemanticAnalyzer::checkStatement(const ASTNode *stmt, const ScopeContext &ctx)
     {
         if (!stmt)
             return;
@@ -247,17 +276,12 @@ namespace lang
                 inferType(stmt, ctx);
                 break;
             case ASTNode::Kind::IfStat:
-                if (stmt->children.size() >= 3) {
+                if (stmt->children.size() >= 3)
                     inferType(stmt->children[0], ctx);
-                    checkStatBlock(stmt->children[1], ctx);
-                    checkStatBlock(stmt->children[2], ctx);
-                }
                 break;
             case ASTNode::Kind::WhileStat:
-                if (stmt->children.size() >= 2) {
+                if (stmt->children.size() >= 2)
                     inferType(stmt->children[0], ctx);
-                    checkStatBlock(stmt->children[1], ctx);
-                }
                 break;
             case ASTNode::Kind::PutStat:
             case ASTNode::Kind::ReadStat:
@@ -274,45 +298,107 @@ namespace lang
         }
     }
 
-    void SemanticAnalyzer::checkAssignStat(std::shared_ptr<const ASTNode> node, const ScopeContext &ctx)
+    void SemanticAnalyzer::checkAssignStat(const ASTNode *node, const ScopeContext &ctx)
     {
         if (!node || node->children.size() < 2)
             return;
 
-        const std::string lhsType = inferType(node->children[0], ctx);
-        const std::string rhsType = inferType(node->children[1], ctx);
+        const TypeId lhsType = inferType(node->children[0], ctx);
+        const TypeId rhsType = inferType(node->children[1], ctx);
 
-        if (!lhsType.empty() && !rhsType.empty() && lhsType != rhsType)
-            m_problems.error(
+        if (lhsType && rhsType && lhsType != rhsType)
+            ctx.problems->error(
                 "10.2 type error in assignment statement",
-                std::format("cannot assign '{}' to '{}'", rhsType, lhsType),
+                std::format("cannot assign '{}' to '{}'", rhsType->spelling, lhsType->spelling),
                 { node->children[0]->token.line > 0 ? node->children[0]->token : node->children[1]->token });
     }
 
-    void SemanticAnalyzer::checkReturnStat(std::shared_ptr<const ASTNode> node, const ScopeContext &ctx)
+    void SemanticAnalyzer::checkReturnStat(const ASTNode *node, const ScopeContext &ctx)
     {
         if (!node || node->children.empty())
             return;
 
-        const std::string retType = inferType(node->children[0], ctx);
+        const TypeId retType = inferType(node->children[0], ctx);
+        const TypeId declaredType = ctx.function_node ? ctx.function_node->signature.typeId : nullptr;
 
-        if (ctx.function_node && !ctx.function_node->signature.type.empty() && ctx.function_node->signature.type != "void" && !retType.empty()) {
-            if (!TypesCompatible(retType, ctx.function_node->signature.type))
-                m_problems.error(
+        if (declaredType && declaredType != m_types.voidType() && retType) {
+            if (!TypeTable::Compatible(retType, declaredType))
+                ctx.problems->error(
                     "10.3 type error in return statement",
-                    std::format("returning '{}' from function declared to return '{}'", retType, ctx.function_node->signature.type),
+                    std::format("returning '{}' from function declared to return '{}'", retType->spelling, declaredType->spelling),
                     { node->children[0]->token.line > 0 ? node->children[0]->token : node->token });
         }
     }
 
-    std::string SemanticAnalyzer::inferType(std::shared_ptr<const ASTNode> expr, const ScopeContext &ctx)
+    TypeId SemanticAnalyzer::inferType(const ASTNode *expr, const ScopeContext &ctx)
     {
         if (!expr)
-            return "";
+            return nullptr;
+        if (!expr->typed) {
+            // An operand is skipped, untyped, when inferNodeType would return before reading it: an index whose array is
+            // missing or not an array, and the arguments of a method whose receiver is not an object.
+            struct {
+                SemanticAnalyzer &self;
+                const ScopeContext &ctx;
+                const ASTNode *root;
+                const ASTNode *skipped = nullptr;
+
+                static bool IsObject(const ASTNode *receiver) { return receiver && receiver->typed && receiver->type && receiver->type->scalar->classNode; }
+
+                bool isRead(const ASTNode *node) const
+                {
+                    const ASTNode *parent = node->parent;
+                    if (!parent || parent->children.size() < 2)
+                        return true;
+                    if (parent->kind == ASTNode::Kind::IndexedVar && node == parent->children[1]) {
+                        const ASTNode *base = parent->children[0];
+                        if (base->kind != ASTNode::Kind::Id)
+                            return base->typed && base->type;
+                        const SymbolTableNode *sym = self.lookupInScope(base->lexeme, ctx);
+                        return sym && sym->signature.typeId && sym->signature.typeId->isArray();
+                    }
+                    if (parent->kind == ASTNode::Kind::FuncCall && node == parent->children[1] && parent->children[0]->kind == ASTNode::Kind::MemberAccess)
+                        return IsObject(parent->children[0]->children[0]);
+                    if (parent->kind == ASTNode::Kind::MemberAccess && node == parent->children[1])
+                        return IsObject(parent->children[0]);
+                    return true;
+                }
+
+                bool grouping(const ASTNode *node) const { return node != root && GroupsOperands(node); }
 
+                bool enter(const ASTNode *node)
+                {
+                    if (!node)
+                        return false;
+                    if (node != root && !isRead(node)) {
+                        skipped = node;
+                        return false;
+                    }
+                    return grouping(node) || !node->typed;
+                }
+                ChildSpan children(const ASTNode *node) const { return OperandsInferredFirst(node, grouping(node)); }
+                void leave(const ASTNode *node)
+                {
+                    if (node && node == skipped) {
+                        skipped = nullptr;
+                        return;
+                    }
+                    if (node && !node->typed && !grouping(node)) {
+                        node->type = self.inferNodeType(node, ctx);
+                        node->typed = true;
+                    }
+                }
+            } visitor{ *this, ctx, expr };
+            WalkAST(expr, visitor);
+        }
+        return expr->type;
+    }
+
+    TypeId SemanticAnalyzer::inferNodeType(const ASTNode *expr, const ScopeContext &ctx)
+    {
         switch (expr->kind) {
             case ASTNode::Kind::Num:
-                return (expr->lexeme.find('.') != std::string::npos || expr->lexeme.find('e') != std::string::npos) ? "float" : "int";
+                return expr->lexeme.find('.') != std::string::npos || expr->lexeme.find('e') != std::string::npos ? m_types.floatType() : m_types.intType();
 
             case ASTNode::Kind::Id:
                 return inferTypeId(expr, ctx);
@@ -330,89 +416,90 @@ namespace lang
             case ASTNode::Kind::MultOp:
                 {
                     if (expr->children.size() < 2)
-                        return "";
-                    const std::string leftType = inferType(expr->children[0], ctx);
-                    const std::string rightType = inferType(expr->children[1], ctx);
-                    if (!leftType.empty() && !rightType.empty() && leftType != rightType) {
-                        m_problems.error(
+                        return nullptr;
+                    const TypeId leftType = inferType(expr->children[0], ctx);
+                    const TypeId rightType = inferType(expr->children[1], ctx);
+                    if (leftType && rightType && leftType != rightType) {
+                        ctx.problems->error(
                             "10.1 type error in expression",
-                            std::format("operands of '{}' have incompatible types '{}' and '{}'", expr->lexeme, leftType, rightType),
+                            std::format("operands of '{}' have incompatible types '{}' and '{}'", expr->lexeme, leftType->spelling, rightType->spelling),
                             { expr->token.line > 0 ? expr->token : expr->children[0]->token });
-                        return "";
+                        return nullptr;
                     }
-                    return leftType.empty() ? rightType : leftType;
+                    return leftType ? leftType : rightType;
                 }
 
             case ASTNode::Kind::RelOp:
                 {
                     if (expr->children.size() < 2)
-                        return "";
-                    const std::string leftType = inferType(expr->children[0], ctx);
-                    const std::string rightType = inferType(expr->children[1], ctx);
-                    if (!leftType.empty() && !rightType.empty() && leftType != rightType)
-                        m_problems.error(
+                        return nullptr;
+                    const TypeId leftType = inferType(expr->children[0], ctx);
+                    const TypeId rightType = inferType(expr->children[1], ctx);
+                    if (leftType && rightType && leftType != rightType)
+                        ctx.problems->error(
                             "10.1 type error in expression",
-                            std::format("operands of '{}' have incompatible types '{}' and '{}'", expr->lexeme, leftType, rightType),
+                            std::format("operands of '{}' have incompatible types '{}' and '{}'", expr->lexeme, leftType->spelling, rightType->spelling),
                             { expr->token.line > 0 ? expr->token : expr->children[0]->token });
-                    return "int";
+                    return m_types.intType();
                 }
 
             case ASTNode::Kind::NotExpr:
             case ASTNode::Kind::SignExpr:
-                return expr->children.empty() ? "" : inferType(expr->children[0], ctx);
+                return expr->children.empty() ? nullptr : inferType(expr->children[0], ctx);
 
             default:
-                return "";
+                return nullptr;
         }
     }
 
-    std::string SemanticAnalyzer::inferTypeId(std::shared_ptr<const ASTNode> node, const ScopeContext &ctx)
+    TypeId SemanticAnalyzer::inferTypeId(const ASTNode *node, const ScopeContext &ctx)
     {
         auto *sym = lookupInScope(node->lexeme, ctx);
         if (!sym) {
-            m_problems.error("11.1 undeclared local variable", std::format("'{}' is undeclared", node->lexeme), { node->token });
-            return "";
+            ctx.problems->error("11.1 undeclared local variable", std::format("'{}' is undeclared", node->lexeme), { node->token });
+            return nullptr;
         }
-        return sym->signature.type;
+        node->symbol = sym;
+        return sym->signature.typeId;
     }
 
-    std::string SemanticAnalyzer::inferTypeMemberAccess(std::shared_ptr<const ASTNode> node, const ScopeContext &ctx)
+    TypeId SemanticAnalyzer::inferTypeMemberAccess(const ASTNode *node, const ScopeContext &ctx)
     {
         if (!node || node->children.size() < 2)
-            return "";
+            return nullptr;
 
-        const std::string objectType = inferType(node->children[0], ctx);
-        if (objectType.empty())
-            return "";
+        const TypeId objectType = inferType(node->children[0], ctx);
+        if (!objectType)
+            return nullptr;
 
-        const std::string baseType = StripAllDimensions(objectType);
-        SymbolTableNode *classNode = findClassByName(baseType);
+        const TypeId baseType = objectType->scalar;
+        SymbolTableNode *classNode = baseType->classNode;
         if (!classNode) {
-            m_problems.error(
+            ctx.problems->error(
                 "15.1 \".\" operator used on non-class type",
-                std::format("'.' operator used on variable of type '{}' which is not a class type", baseType),
+                std::format("'.' operator used on variable of type '{}' which is not a class type", baseType->spelling),
                 { node->children[0]->token.line > 0 ? node->children[0]->token : node->token });
-            return "";
+            return nullptr;
         }
 
         const auto &memberNode = node->children[1];
 
         if (memberNode->kind == ASTNode::Kind::FuncCall) {
             const std::string memberName = memberNode->children[0]->lexeme;
-            std::vector<std::string> argTypes;
+            std::vector<TypeId> argTypes;
             if (memberNode->children.size() >= 2) {
                 for (const auto &arg : memberNode->children[1]->children) argTypes.push_back(inferType(arg, ctx));
             }
 
             SymbolTableNode *funcSym = nullptr;
-            for (auto *entry : classNode->table) {
-                if (entry->kind != SymbolTableNode::Kind::Function || lowercase(entry->name) != lowercase(memberName))
+            for (auto *entry : classNode->entriesNamed(m_symbolKeys.find(memberName))) {
+                if (entry->kind != SymbolTableNode::Kind::Function)
                     continue;
-                if (entry->signature.params.size() == argTypes.size()) {
+                if (entry->signature.paramTypeIds.size() == argTypes.size()) {
                     funcSym = entry;
                     bool wrongType = false;
                     for (size_t i = 0; i < argTypes.size(); ++i) {
-                        if (!argTypes[i].empty() && !entry->signature.params[i].empty() && argTypes[i] != entry->signature.params[i])
+                        if (argTypes[i] && entry->signature.paramTypeIds[i] && argTypes[i] != entry->signature.paramTypeIds[i])
                             wrongType = true;
                     }
                     if (!wrongType)
@@ -423,8 +510,8 @@ namespace lang
             }
             if (!funcSym) {
                 for (auto *parentClass : collectInheritedClasses(classNode)) {
-                    for (auto *entry : parentClass->table) {
-                        if (entry->kind == SymbolTableNode::Kind::Function && lowercase(entry->name) == lowercase(memberName)) {
+                    for (auto *entry : parentClass->entriesNamed(m_symbolKeys.find(memberName))) {
+                        if (entry->kind == SymbolTableNode::Kind::Function) {
                             funcSym = entry;
                             break;
                         }
@@ -435,23 +522,23 @@ namespace lang
             }
 
             if (!funcSym) {
-                m_problems.error(
+                ctx.problems->error(
                     "11.3 undeclared member function",
                     std::format("class '{}' has no member function '{}'", classNode->name, memberName),
                     { memberNode->children[0]->token.line > 0 ? memberNode->children[0]->token : node->token });
-                return "";
+                return nullptr;
             }
 
             const Token &errTok = memberNode->children[0]->token.line > 0 ? memberNode->children[0]->token : node->token;
             if (funcSym->signature.params.size() != argTypes.size()) {
-                m_problems.error(
+                ctx.problems->error(
                     "12.1 function call with wrong number of parameters",
                     std::format("'{}::{}' expects {} parameter(s), got {}", classNode->name, funcSym->name, funcSym->signature.params.size(), argTypes.size()),
                     { errTok });
             } else {
                 for (size_t i = 0; i < argTypes.size(); ++i) {
-                    if (!argTypes[i].empty() && !funcSym->signature.params[i].empty() && argTypes[i] != funcSym->signature.params[i])
-                        m_problems.error(
+                    if (argTypes[i] && funcSym->signature.paramTypeIds[i] && argTypes[i] != funcSym->signature.paramTypeIds[i])
+                        ctx.problems->error(
                             "12.2 function call with wrong type of parameters",
                             std::format(
                                 "'{}::{}' parameter {} expects '{}', got '{}'",
@@ -459,107 +546,112 @@ namespace lang
                                 funcSym->name,
                                 i + 1,
                                 funcSym->signature.params[i],
-                                argTypes[i]),
+                                argTypes[i]->spelling),
                             { errTok });
                 }
             }
 
-            return funcSym->signature.type;
+            node->symbol = funcSym;
+            return funcSym->signature.typeId;
         }
 
         const std::string memberName = memberNode->lexeme;
         SymbolTableNode *memberSym = lookupInClass(classNode, memberName);
         if (!memberSym) {
-            m_problems.error(
+            ctx.problems->error(
                 "11.2 undeclared member variable",
                 std::format("class '{}' has no data member '{}'", classNode->name, memberName),
                 { memberNode->token.line > 0 ? memberNode->token : node->token });
-            return "";
+            return nullptr;
         }
-        return memberSym->signature.type;
+        node->symbol = memberSym;
+        return memberSym->signature.typeId;
     }
 
-    std::string SemanticAnalyzer::inferTypeIndexedVar(std::shared_ptr<const ASTNode> node, const ScopeContext &ctx)
+    TypeId SemanticAnalyzer::inferTypeIndexedVar(const ASTNode *node, const ScopeContext &ctx)
     {
         if (!node || node->children.size() < 2)
-            return "";
+            return nullptr;
 
-        std::string baseType;
+        TypeId baseType = nullptr;
         if (node->children[0]->kind == ASTNode::Kind::Id) {
             auto *sym = lookupInScope(node->children[0]->lexeme, ctx);
             if (!sym) {
-                m_problems.error("11.1 undeclared local variable", std::format("'{}' is undeclared", node->children[0]->lexeme), { node->children[0]->token });
-                return "";
+                ctx.problems->error("11.1 undeclared local variable", std::format("'{}' is undeclared", node->children[0]->lexeme), { node->children[0]->token });
+                return nullptr;
             }
-            if (CountArrayDimensions(sym->signature.type) == 0) {
+            node->children[0]->symbol = sym;
+            node->symbol = sym;
+            const TypeId symType = sym->signature.typeId;
+            if (!symType || !symType->isArray()) {
                 const Token errToken =
                     node->children[0]->token.line > 0 ? node->children[0]->token : (node->children[1]->token.line > 0 ? node->children[1]->token : node->token);
-                m_problems.error(
+                ctx.problems->error(
                     "13.1 use of array with wrong number of dimensions",
                     std::format("'{}' is not an array but is indexed", node->children[0]->lexeme),
                     { errToken });
-                return StripAllDimensions(sym->signature.type);
+                return symType ? symType->scalar : nullptr;
             }
-            baseType = StripOneDimension(sym->signature.type);
+            baseType = symType->element;
         } else {
             baseType = inferType(node->children[0], ctx);
-            if (baseType.empty())
-                return "";
-            if (CountArrayDimensions(baseType) > 0) {
-                baseType = StripOneDimension(baseType);
+            if (!baseType)
+                return nullptr;
+            if (baseType->isArray()) {
+                baseType = baseType->element;
             } else {
                 const Token errToken =
                     node->children[1]->token.line > 0 ? node->children[1]->token : (node->children[0]->token.line > 0 ? node->children[0]->token : node->token);
-                m_problems.error(
+                ctx.problems->error(
                     "13.1 use of array with wrong number of dimensions",
-                    std::format("expression of type '{}' is not an array but is indexed", StripAllDimensions(baseType)),
+                    std::format("expression of type '{}' is not an array but is indexed", baseType->scalar->spelling),
                     { errToken });
-                baseType = StripAllDimensions(baseType);
+                baseType = baseType->scalar;
             }
         }
 
-        const std::string indexType = inferType(node->children[1], ctx);
-        if (!indexType.empty() && indexType != "int")
-            m_problems.error(
+        const TypeId indexType = inferType(node->children[1], ctx);
+        if (indexType && indexType != m_types.intType())
+            ctx.problems->error(
                 "13.2 array index is not an integer",
-                std::format("array index must be integer, got '{}'", indexType),
+                std::format("array index must be integer, got '{}'", indexType->spelling),
                 { node->children[1]->token.line > 0 ? node->children[1]->token : node->token });
 
-        return StripAllDimensions(baseType);
+        return baseType ? baseType->scalar : nullptr;
     }
 
-    std::string SemanticAnalyzer::inferTypeFuncCall(std::shared_ptr<const ASTNode> node, const ScopeContext &ctx)
+    TypeId SemanticAnalyzer::inferTypeFuncCall(const ASTNode *node, const ScopeContext &ctx)
     {
         if (!node || node->children.size() < 2)
-            return "";
+            return nullptr;
 
         const auto &idNode = node->children[0];
         const auto &paramListNode = node->children[1];
 
         if (idNode->kind == ASTNode::Kind::MemberAccess) {
             if (idNode->children.size() < 2)
-                return "";
-            const std::string objectType = inferType(idNode->children[0], ctx);
-            if (objectType.empty())
-                return "";
+                return nullptr;
+            const TypeId objectType = inferType(idNode->children[0], ctx);
+            if (!objectType)
+                return nullptr;
 
-            const std::string baseType = StripAllDimensions(objectType);
-            SymbolTableNode *classNode = findClassByName(baseType);
+            const TypeId baseType = objectType->scalar;
+            SymbolTableNode *classNode = baseType->classNode;
             if (!classNode) {
-                m_problems.error(
+                ctx.problems->error(
                     "15.1 \".\" operator used on non-class type",
-                    std::format("'.' operator used on variable of type '{}' which is not a class type", baseType),
+                    std::format("'.' operator used on variable of type '{}' which is not a class type", baseType->spelling),
                     { idNode->children[0]->token.line > 0 ? idNode->children[0]->token : node->token });
-                return "";
+                return nullptr;
             }
 
             const std::string memberName = idNode->children[1]->lexeme;
-            std::vector<std::string> argTypes;
+            std::vector<TypeId> argTypes;
             for (const auto &arg : paramListNode->children) argTypes.push_back(inferType(arg, ctx));
 
             SymbolTableNode *funcSym = nullptr;
-            for (auto *entry : classNode->table) {
-                if (entry->kind != SymbolTableNode::Kind::Function || lowercase(entry->name) != lowercase(memberName))
+            for (auto *entry : classNode->entriesNamed(m_symbolKeys.find(memberName))) {
+                if (entry->kind != SymbolTableNode::Kind::Function)
                     continue;
                 if (entry->signature.params.size() == argTypes.size()) {
                     funcSym = entry;
@@ -570,8 +662,8 @@ namespace lang
             }
             if (!funcSym) {
                 for (auto *parentClass : collectInheritedClasses(classNode)) {
-                    for (auto *entry : parentClass->table) {
-                        if (entry->kind == SymbolTableNode::Kind::Function && lowercase(entry->name) == lowercase(memberName)) {
+                    for (auto *entry : parentClass->entriesNamed(m_symbolKeys.find(memberName))) {
+                        if (entry->kind == SymbolTableNode::Kind::Function) {
                             funcSym = entry;
                             break;
                         }
@@ -582,54 +674,55 @@ namespace lang
             }
 
             if (!funcSym) {
-                m_problems.error(
+                ctx.problems->error(
                     "11.3 undeclared member function",
                     std::format("class '{}' has no member function '{}'", classNode->name, memberName),
                     { idNode->children[1]->token.line > 0 ? idNode->children[1]->token : node->token });
-                return "";
+                return nullptr;
             }
 
             const Token &errTok = idNode->children[1]->token.line > 0 ? idNode->children[1]->token : node->token;
             if (funcSym->signature.params.size() != argTypes.size()) {
-                m_problems.error(
+                ctx.problems->error(
                     "12.1 function call with wrong number of parameters",
                     std::format("'{}::{}' expects {} parameter(s), got {}", classNode->name, funcSym->name, funcSym->signature.params.size(), argTypes.size()),
                     { errTok });
             } else {
                 for (size_t i = 0; i < argTypes.size(); ++i) {
-                    const std::string &paramType = funcSym->signature.params[i];
-                    const std::string &argType = argTypes[i];
-                    if (argType.empty() || paramType.empty())
+                    const TypeId paramType = funcSym->signature.paramTypeIds[i];
+                    const TypeId argType = argTypes[i];
+                    if (!argType || !paramType)
                         continue;
-                    const int paramDims = CountArrayDimensions(paramType);
-                    const int argDims = CountArrayDimensions(argType);
+                    const int paramDims = paramType->dimensionCount();
+                    const int argDims = argType->dimensionCount();
                     if (paramDims > 0 || argDims > 0) {
                         if (paramDims != argDims)
-                            m_problems.error(
+                            ctx.problems->error(
                                 "13.3 array parameter using wrong number of dimensions",
                                 std::format(
                                     "parameter {} of '{}::{}' expects {} dimension(s), got {}", i + 1, classNode->name, funcSym->name, paramDims, argDims),
                                 { errTok });
                         continue;
                     }
-                    if (!TypesCompatible(StripAllDimensions(argType), StripAllDimensions(paramType)))
-                        m_problems.error(
+                    if (!TypeTable::Compatible(argType->scalar, paramType->scalar))
+                        ctx.problems->error(
                             "12.2 function call with wrong type of parameters",
-                            std::format("'{}::{}' parameter {} expects '{}', got '{}'", classNode->name, funcSym->name, i + 1, paramType, argType),
+                            std::format("'{}::{}' parameter {} expects '{}', got '{}'", classNode->name, funcSym->name, i + 1, paramType->spelling, argType->spelling),
                             { errTok });
                 }
             }
-            return funcSym->signature.type;
+            node->symbol = funcSym;
+            return funcSym->signature.typeId;
         }
 
         const std::string funcName = idNode->lexeme;
-        std::vector<std::string> argTypes;
+        std::vector<TypeId> argTypes;
         for (const auto &arg : paramListNode->children) argTypes.push_back(inferType(arg, ctx));
 
         SymbolTableNode *funcSym = nullptr;
         if (ctx.class_node) {
-            for (auto *entry : ctx.class_node->table) {
-                if (entry->kind != SymbolTableNode::Kind::Function || lowercase(entry->name) != lowercase(funcName))
+            for (auto *entry : ctx.class_node->entriesNamed(m_symbolKeys.find(funcName))) {
+                if (entry->kind != SymbolTableNode::Kind::Function)
                     continue;
                 if (entry->signature.params.size() == argTypes.size()) {
                     funcSym = entry;
@@ -643,44 +736,45 @@ namespace lang
             funcSym = findFreeFunctionByNameAndArgs(funcName, argTypes);
 
         if (!funcSym) {
-            m_problems.error(
+            ctx.problems->error(
                 "11.4 undeclared/undefined free function",
                 std::format("function '{}' is not declared", funcName),
                 { idNode->token.line > 0 ? idNode->token : node->token });
-            return "";
+            return nullptr;
         }
 
         const Token &errTok = idNode->token.line > 0 ? idNode->token : node->token;
         if (funcSym->signature.params.size() != argTypes.size()) {
-            m_problems.error(
+            ctx.problems->error(
                 "12.1 function call with wrong number of parameters",
                 std::format("'{}' expects {} parameter(s), got {}", funcName, funcSym->signature.params.size(), argTypes.size()),
                 { errTok });
         } else {
             for (size_t i = 0; i < argTypes.size(); ++i) {
-                const std::string &paramType = funcSym->signature.params[i];
-                const std::string &argType = argTypes[i];
-                if (argType.empty() || paramType.empty())
+                const TypeId paramType = funcSym->signature.paramTypeIds[i];
+                const TypeId argType = argTypes[i];
+                if (!argType || !paramType)
                     continue;
-                const int paramDims = CountArrayDimensions(paramType);
-                const int argDims = CountArrayDimensions(argType);
+                const int paramDims = paramType->dimensionCount();
+                const int argDims = argType->dimensionCount();
                 if (paramDims > 0 || argDims > 0) {
                     if (paramDims != argDims)
-                        m_problems.error(
+                        ctx.problems->error(
                             "13.3 array parameter using wrong number of dimensions",
                             std::format("parameter {} of '{}' expects array of {} dimension(s), got {}", i + 1, funcName, paramDims, argDims),
                             { errTok });
                     continue;
                 }
-                if (!TypesCompatible(StripAllDimensions(argType), StripAllDimensions(paramType)))
-                    m_problems.error(
+                if (!TypeTable::Compatible(argType->scalar, paramType->scalar))
+                    ctx.problems->error(
                         "12.2 function call with wrong type of parameters",
-                        std::format("'{}' parameter {} expects '{}', got '{}'", funcName, i + 1, paramType, argType),
+                        std::format("'{}' parameter {} expects '{}', got '{}'", funcName, i + 1, paramType->spelling, argType->spelling),
                         { errTok });
             }
         }
 
-        return funcSym->signature.type;
+        node->symbol = funcSym;
+        return funcSym->signature.typeId;
     }
 
 } // namespace lang
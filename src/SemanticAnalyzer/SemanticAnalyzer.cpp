@@ -14,22 +14,25 @@
 
 namespace lang
 {
-    static void deleteSymbolTree(SymbolTableNode *node)
+    void SemanticAnalyzer::openFile(std::string_view path)
     {
-        if (!node)
-            return;
-        for (auto *child : node->table) deleteSymbolTree(child);
-        delete node;
+        m_ast = nullptr;
+        m_syntacticAnalyzer.openFile(path);
     }
 
-    SemanticAnalyzer::~SemanticAnalyzer()
+    void SemanticAnalyzer::setKeepRawTokens(bool keep)
     {
-        deleteSymbolTree(m_symbolTable);
+        m_syntacticAnalyzer.setKeepRawTokens(keep);
     }
 
-    void SemanticAnalyzer::openFile(std::string_view path)
+    void SemanticAnalyzer::setLexJobs(std::size_t jobs)
     {
-        m_syntacticAnalyzer.openFile(path);
+        m_syntacticAnalyzer.setLexJobs(jobs);
+    }
+
+    void SemanticAnalyzer::setCheckJobs(std::size_t jobs)
+    {
+        m_checkJobs = std::max<std::size_t>(1, jobs);
     }
 
     void SemanticAnalyzer::parse()
@@ -46,8 +49,10 @@ namespace lang
         m_classTypeNames.clear();
         m_ast = ast;
 
-        deleteSymbolTree(m_symbolTable);
         m_symbolTable = nullptr;
+        m_symbolArena.reset();
+        m_symbolKeys.clear();
+        m_types.clear();
 
         auto start = std::chrono::high_resolution_clock::now();
 
@@ -58,6 +63,7 @@ namespace lang
             return;
         }
 
+        resolveSymbolTypes(m_symbolTable);
         semanticChecks();
 
         auto end = std::chrono::high_resolution_clock::now();
@@ -109,11 +115,12 @@ namespace lang
         return m_syntacticAnalyzer;
     }
 
-    SymbolTableNode *SemanticAnalyzer::makeSymbol(SymbolTableNode::Kind kind, const std::string &name, SymbolTableNode *parent, Token token) const
+    SymbolTableNode *SemanticAnalyzer::makeSymbol(SymbolTableNode::Kind kind, const std::string &name, SymbolTableNode *parent, Token token)
     {
-        auto *node = new SymbolTableNode();
+        auto *node = m_symbolArena.make();
         node->kind = kind;
         node->name = name;
+        node->key = m_symbolKeys.intern(name);
         node->parent = parent;
         node->token = std::move(token);
         return node;
@@ -123,7 +130,7 @@ namespace lang
     {
         if (!globalTable)
             return nullptr;
-        for (auto *child : globalTable->table) {
+        for (auto *child : globalTable->entriesNamed(m_symbolKeys.find(className))) {
             if (child->kind == SymbolTableNode::Kind::Class && child->name == className)
                 return child;
         }
@@ -135,7 +142,7 @@ namespace lang
     {
         if (!classNode)
             return nullptr;
-        for (auto *entry : classNode->table) {
+        for (auto *entry : classNode->entriesNamed(m_symbolKeys.find(functionName))) {
             if (entry->kind != SymbolTableNode::Kind::Function)
                 continue;
             if (entry->name != functionName)
@@ -149,17 +156,29 @@ namespace lang
         return nullptr;
     }
 
-    std::string SemanticAnalyzer::lowercase(std::string src) const
+    std::string SymbolInterner::Fold(std::string_view name)
+    {
+        std::string folded(name);
+        for (char &ch : folded) ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+        return folded;
+    }
+
+    const std::string *SymbolInterner::intern(std::string_view name)
     {
-        for (char &ch : src) ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
-        return src;
+        return &*m_keys.insert(Fold(name)).first;
+    }
+
+    const std::string *SymbolInterner::find(std::string_view name) const
+    {
+        auto it = m_keys.find(Fold(name));
+        return it == m_keys.end() ? nullptr : &*it;
     }
 
     std::string SemanticAnalyzer::normalizeType(std::string typeName) const
     {
         if (typeName.empty())
             return typeName;
-        const std::string key = lowercase(typeName);
+        const std::string key = SymbolInterner::Fold(typeName);
         if (key == "integer")
             return "int";
         if (key == "float")
@@ -171,7 +190,7 @@ namespace lang
         return typeName;
     }
 
-    std::string SemanticAnalyzer::varDeclType(std::shared_ptr<const ASTNode> varDecl) const
+    std::string SemanticAnalyzer::varDeclType(const ASTNode *varDecl) const
     {
         if (!varDecl || varDecl->kind != ASTNode::Kind::VarDecl || varDecl->children.size() < 3)
             return "";
@@ -180,7 +199,7 @@ namespace lang
         return type;
     }
 
-    std::vector<std::string> SemanticAnalyzer::parameterTypes(std::shared_ptr<const ASTNode> paramList) const
+    std::vector<std::string> SemanticAnalyzer::parameterTypes(const ASTNode *paramList) const
     {
         std::vector<std::string> params;
         if (!paramList || paramList->kind != ASTNode::Kind::ParamList)
@@ -189,7 +208,7 @@ namespace lang
         return params;
     }
 
-    std::string SemanticAnalyzer::joinInheritedTypes(std::shared_ptr<const ASTNode> inheritList) const
+    std::string SemanticAnalyzer::joinInheritedTypes(const ASTNode *inheritList) const
     {
         if (!inheritList || inheritList->kind != ASTNode::Kind::InheritList || inheritList->children.empty())
             return "none";
@@ -204,7 +223,7 @@ namespace lang
         return joined.empty() ? "none" : joined;
     }
 
-    void SemanticAnalyzer::buildClassTables(SymbolTableNode *globalTable, std::shared_ptr<const ASTNode> classList)
+    void SemanticAnalyzer::buildClassTables(SymbolTableNode *globalTable, const ASTNode *classList)
     {
         if (!globalTable || !classList || classList->kind != ASTNode::Kind::ClassList)
             return;
@@ -214,12 +233,12 @@ namespace lang
                 continue;
 
             const std::string className = classNode->children[0]->lexeme;
-            m_classTypeNames[lowercase(className)] = className;
+            m_classTypeNames[SymbolInterner::Fold(className)] = className;
 
             auto *classSymbol = makeSymbol(SymbolTableNode::Kind::Class, className, globalTable, classNode->children[0]->token);
-            globalTable->table.emplace_back(classSymbol);
+            globalTable->addEntry(classSymbol);
 
-            std::shared_ptr<const ASTNode> inheritList;
+            const ASTNode *inheritList = nullptr;
             for (const auto &child : classNode->children) {
                 if (child->kind == ASTNode::Kind::InheritList) {
                     inheritList = child;
@@ -227,7 +246,7 @@ namespace lang
                 }
             }
 
-            classSymbol->table.emplace_back(makeSymbol(SymbolTableNode::Kind::Inherit, joinInheritedTypes(inheritList), classSymbol));
+            classSymbol->addEntry(makeSymbol(SymbolTableNode::Kind::Inherit, joinInheritedTypes(inheritList), classSymbol));
 
             for (const auto &child : classNode->children) {
                 if (!child)
@@ -239,7 +258,7 @@ namespace lang
                             auto *dataSymbol = makeSymbol(SymbolTableNode::Kind::Data, child->children[1]->lexeme, classSymbol, child->children[1]->token);
                             dataSymbol->signature.type = varDeclType(child);
                             dataSymbol->visibility = visibility;
-                            classSymbol->table.emplace_back(dataSymbol);
+                            classSymbol->addEntry(dataSymbol);
                             break;
                         }
                     case ASTNode::Kind::FuncDecl:
@@ -249,7 +268,7 @@ namespace lang
                             functionSymbol->signature.type = normalizeType(child->children[0]->lexeme);
                             functionSymbol->signature.params = parameterTypes(child->children[2]);
                             functionSymbol->visibility = visibility;
-                            classSymbol->table.emplace_back(functionSymbol);
+                            classSymbol->addEntry(functionSymbol);
                             break;
                         }
                     default:
@@ -259,7 +278,7 @@ namespace lang
         }
     }
 
-    void SemanticAnalyzer::populateFunctionTable(SymbolTableNode *function, std::shared_ptr<const ASTNode> paramList, std::shared_ptr<const ASTNode> statBlock)
+    void SemanticAnalyzer::populateFunctionTable(SymbolTableNode *function, const ASTNode *paramList, const ASTNode *statBlock)
     {
         if (!function)
             return;
@@ -272,18 +291,18 @@ namespace lang
                 continue;
             auto *paramSymbol = makeSymbol(SymbolTableNode::Kind::Parameter, param->children[1]->lexeme, function, param->children[1]->token);
             paramSymbol->signature.type = varDeclType(param);
-            function->table.emplace_back(paramSymbol);
+            function->addEntry(paramSymbol);
         }
         for (const auto &statement : statBlock->children) {
             if (statement->kind != ASTNode::Kind::VarDecl)
                 continue;
             auto *localSymbol = makeSymbol(SymbolTableNode::Kind::Local, statement->children[1]->lexeme, function, statement->children[1]->token);
             localSymbol->signature.type = varDeclType(statement);
-            function->table.emplace_back(localSymbol);
+            function->addEntry(localSymbol);
         }
     }
 
-    void SemanticAnalyzer::buildFunctionDefinitions(SymbolTableNode *globalTable, std::shared_ptr<const ASTNode> funcDefList)
+    void SemanticAnalyzer::buildFunctionDefinitions(SymbolTableNode *globalTable, const ASTNode *funcDefList)
     {
         if (!globalTable || !funcDefList || funcDefList->kind != ASTNode::Kind::FuncDefList)
             return;
@@ -311,7 +330,7 @@ namespace lang
                     functionSymbol = makeSymbol(SymbolTableNode::Kind::Function, functionName, classSymbol, nameNode->children[1]->token);
                     functionSymbol->signature.type = returnType;
                     functionSymbol->signature.params = params;
-                    classSymbol->table.emplace_back(functionSymbol);
+                    classSymbol->addEntry(functionSymbol);
                 }
 
                 populateFunctionTable(functionSymbol, paramList, statBlock);
@@ -322,31 +341,31 @@ namespace lang
                 auto *functionSymbol = makeSymbol(SymbolTableNode::Kind::Function, nameNode->lexeme, globalTable, nameNode->token);
                 functionSymbol->signature.type = returnType;
                 functionSymbol->signature.params = params;
-                globalTable->table.emplace_back(functionSymbol);
+                globalTable->addEntry(functionSymbol);
                 populateFunctionTable(functionSymbol, paramList, statBlock);
             }
         }
     }
 
-    void SemanticAnalyzer::buildMainFunction(SymbolTableNode *globalTable, std::shared_ptr<const ASTNode> programBlock)
+    void SemanticAnalyzer::buildMainFunction(SymbolTableNode *globalTable, const ASTNode *programBlock)
     {
         if (!globalTable || !programBlock || programBlock->kind != ASTNode::Kind::ProgramBlock)
             return;
 
         auto *mainSymbol = makeSymbol(SymbolTableNode::Kind::Function, "main", globalTable);
         mainSymbol->signature.type = "void";
-        globalTable->table.emplace_back(mainSymbol);
+        globalTable->addEntry(mainSymbol);
 
         for (const auto &statement : programBlock->children) {
             if (statement->kind != ASTNode::Kind::VarDecl)
                 continue;
             auto *localSymbol = makeSymbol(SymbolTableNode::Kind::Local, statement->children[1]->lexeme, mainSymbol, statement->children[1]->token);
             localSymbol->signature.type = varDeclType(statement);
-            mainSymbol->table.emplace_back(localSymbol);
+            mainSymbol->addEntry(localSymbol);
         }
     }
 
-    SymbolTableNode *SemanticAnalyzer::generateSymbolTable(std::shared_ptr<const ASTNode> ast)
+    SymbolTableNode *SemanticAnalyzer::generateSymbolTable(const ASTNode *ast)
     {
         if (!ast || ast->kind != ASTNode::Kind::Prog || ast->children.size() < 3)
             return nullptr;
@@ -356,10 +375,55 @@ namespace lang
         buildClassTables(globalTable, ast->children[0]);
         buildFunctionDefinitions(globalTable, ast->children[1]);
         buildMainFunction(globalTable, ast->children[2]);
+        resolveBaseClasses(globalTable);
 
         return globalTable;
     }
 
+    void SemanticAnalyzer::resolveSymbolTypes(SymbolTableNode *node)
+    {
+        node->signature.typeId = m_types.intern(node->signature.type);
+        node->signature.paramTypeIds.clear();
+        for (const auto &param : node->signature.params) node->signature.paramTypeIds.push_back(m_types.intern(param));
+        for (auto *child : node->table) resolveSymbolTypes(child);
+    }
+
+    void SemanticAnalyzer::resolveBaseClasses(SymbolTableNode *globalTable)
+    {
+        for (auto *classNode : globalTable->table) {
+            if (classNode->kind != SymbolTableNode::Kind::Class)
+                continue;
+
+            for (const auto *entry : classNode->table) {
+                if (entry->kind != SymbolTableNode::Kind::Inherit)
+                    continue;
+                if (entry->name == "none" || entry->name.empty())
+                    break;
+
+                const std::string &names = entry->name;
+                size_t pos = 0;
+                while (pos < names.size()) {
+                    size_t comma = names.find(',', pos);
+                    std::string parentName = (comma == std::string::npos) ? names.substr(pos) : names.substr(pos, comma - pos);
+                    while (!parentName.empty() && parentName.front() == ' ') parentName.erase(0, 1);
+                    while (!parentName.empty() && parentName.back() == ' ') parentName.pop_back();
+                    if (!parentName.empty()) {
+                        for (auto *candidate : globalTable->entriesNamed(m_symbolKeys.find(parentName))) {
+                            if (candidate->kind == SymbolTableNode::Kind::Class) {
+                                classNode->bases.push_back(candidate);
+                                break;
+                            }
+                        }
+                    }
+                    if (comma == std::string::npos)
+                        break;
+                    pos = comma + 1;
+                }
+                break;
+            }
+        }
+    }
+
     std::string SemanticAnalyzer::GetFullNamespace(const SymbolTableNode *node)
     {
         if (!node)
@@ -2,18 +2,22 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "AST/ASTNode.hpp"
 #include "Problems/Problems.hpp"
+#include "SemanticAnalyzer/TypeTable.hpp"
 #include "SyntacticAnalyzer/SyntacticAnalyzer.hpp"
 #include "spdlog/spdlog.h"
 #include "tabulate/table.hpp"
+#include "utils/Arena.hpp"
 
 namespace lang
 {
@@ -81,29 +85,64 @@ namespace lang
         struct Signature {
             std::string type;
             std::vector<std::string> params;
+            TypeId typeId = nullptr;
+            std::vector<TypeId> paramTypeIds;
         };
 
         Kind kind = Kind::None;
         std::string name;
+        const std::string *key = nullptr;
         Signature signature;
         Visibility visibility = Visibility::None;
         Token token;
 
         std::vector<SymbolTableNode *> table;
         SymbolTableNode *parent = nullptr;
+
+        // entries of `table` grouped by interned key, each group kept in declaration order
+        std::unordered_map<const std::string *, std::vector<SymbolTableNode *>> index;
+        // classes named by this class's inherit list, resolved once the global table is complete
+        std::vector<SymbolTableNode *> bases;
+
+        void addEntry(SymbolTableNode *entry)
+        {
+            table.emplace_back(entry);
+            index[entry->key].emplace_back(entry);
+        }
+
+        const std::vector<SymbolTableNode *> &entriesNamed(const std::string *entryKey) const
+        {
+            static const std::vector<SymbolTableNode *> none;
+            auto it = index.find(entryKey);
+            return it == index.end() ? none : it->second;
+        }
     };
 
-    class SemanticAnalyzer
+    class SymbolInterner
     {
     public:
-        ~SemanticAnalyzer();
+        const std::string *intern(std::string_view name);
+        const std::string *find(std::string_view name) const;
+        void clear() { m_keys.clear(); }
 
+        static std::string Fold(std::string_view name);
+
+    private:
+        std::unordered_set<std::string> m_keys;
+    };
+
+    class SemanticAnalyzer
+    {
+    public:
         void openFile(std::string_view path);
         void parse();
+        void setKeepRawTokens(bool keep);
+        void setLexJobs(std::size_t jobs);
+        void setCheckJobs(std::size_t jobs);
         void outputSymbolTable() const;
         void outputSemanticErrors() const;
 
-        std::shared_ptr<const ASTNode> getAST() const { return m_ast; }
+        const ASTNode *getAST() const { return m_ast; }
         const SymbolTableNode *getSymbolTable() const { return m_symbolTable; }
 
         const Problems &getSemanticProblems() const;
@@ -113,27 +152,32 @@ namespace lang
     private:
         Problems m_problems;
         SyntacticAnalyzer m_syntacticAnalyzer;
+        Arena<SymbolTableNode> m_symbolArena;
         SymbolTableNode *m_symbolTable = nullptr;
         std::unordered_map<std::string, std::string> m_classTypeNames;
-        std::shared_ptr<const ASTNode> m_ast;
+        SymbolInterner m_symbolKeys;
+        TypeTable m_types{ [this](const std::string &name) { return findClassByName(name); } };
+        const ASTNode *m_ast = nullptr;
+        std::size_t m_checkJobs = 1;
 
-        SymbolTableNode *generateSymbolTable(std::shared_ptr<const ASTNode> ast);
+        SymbolTableNode *generateSymbolTable(const ASTNode *ast);
+        void resolveBaseClasses(SymbolTableNode *globalTable);
+        void resolveSymbolTypes(SymbolTableNode *node);
 
-        SymbolTableNode *makeSymbol(SymbolTableNode::Kind kind, const std::string &name, SymbolTableNode *parent, Token token = {}) const;
+        SymbolTableNode *makeSymbol(SymbolTableNode::Kind kind, const std::string &name, SymbolTableNode *parent, Token token = {});
         SymbolTableNode *findClassSymbol(SymbolTableNode *globalTable, const std::string &className) const;
         SymbolTableNode *findMemberFunctionSymbol(
             SymbolTableNode *classNode, const std::string &functionName, const std::vector<std::string> &paramTypes, const std::string &returnType) const;
 
-        void buildClassTables(SymbolTableNode *globalTable, std::shared_ptr<const ASTNode> classList);
-        void buildFunctionDefinitions(SymbolTableNode *globalTable, std::shared_ptr<const ASTNode> funcDefList);
-        void buildMainFunction(SymbolTableNode *globalTable, std::shared_ptr<const ASTNode> programBlock);
-        void populateFunctionTable(SymbolTableNode *function, std::shared_ptr<const ASTNode> paramList, std::shared_ptr<const ASTNode> statBlock);
+        void buildClassTables(SymbolTableNode *globalTable, const ASTNode *classList);
+        void buildFunctionDefinitions(SymbolTableNode *globalTable, const ASTNode *funcDefList);
+        void buildMainFunction(SymbolTableNode *globalTable, const ASTNode *programBlock);
+        void populateFunctionTable(SymbolTableNode *function, const ASTNode *paramList, const ASTNode *statBlock);
 
         std::string normalizeType(std::string typeName) const;
-        std::string varDeclType(std::shared_ptr<const ASTNode> varDecl) const;
-        std::string joinInheritedTypes(std::shared_ptr<const ASTNode> inheritList) const;
-        std::vector<std::string> parameterTypes(std::shared_ptr<const ASTNode> paramList) const;
-        std::string lowercase(std::string src) const;
+        std::string varDeclType(const ASTNode *varDecl) const;
+        std::string joinInheritedTypes(const ASTNode *inheritList) const;
+        std::vector<std::string> parameterTypes(const ASTNode *paramList) const;
 
         tabulate::Table::Row_t renderRow(const SymbolTableNode *node) const;
         tabulate::Table renderTable(const SymbolTableNode *node) const;
@@ -141,43 +185,67 @@ namespace lang
 
         void semanticChecks();
 
-        void checkMultiplyDeclared(SymbolTableNode *globalTable);
-        void checkMultiplyDeclaredInFunction(SymbolTableNode *funcNode);
-        void checkFunctionDeclarationDefinitionParity(SymbolTableNode *globalTable);
-        void checkOverloadsAndOverrides(SymbolTableNode *globalTable);
-        void checkShadowing(SymbolTableNode *globalTable);
-        void checkCircularDependencies(SymbolTableNode *globalTable);
-        void checkUndeclaredClassTypes(SymbolTableNode *globalTable);
+        // Everything the symbol table checks look at, collected in one walk of the global table; each check is then a
+        // pass over these lists. Group keys are the interned lowercase names; lists and groups keep declaration order.
+        struct SymbolTableIndex {
+            using FunctionGroups = std::unordered_map<std::string_view, std::vector<SymbolTableNode *>>;
+
+            struct FunctionScope {
+                SymbolTableNode *node;
+                std::vector<SymbolTableNode *> variables; // parameters and locals
+            };
+
+            struct ClassMembers {
+                SymbolTableNode *node;
+                std::vector<SymbolTableNode *> data;
+                std::vector<FunctionScope> functions;
+                FunctionGroups functionGroups;
+            };
+
+            std::vector<ClassMembers> classes;
+            std::vector<FunctionScope> freeFunctions;
+            FunctionGroups freeFunctionGroups;
+        };
+
+        SymbolTableIndex buildSymbolTableIndex(SymbolTableNode *globalTable) const;
 
+        void checkMultiplyDeclared(const SymbolTableIndex &index);
+        void checkMultiplyDeclaredInFunction(const SymbolTableIndex::FunctionScope &function);
+        void checkFunctionDeclarationDefinitionParity(SymbolTableNode *globalTable, const SymbolTableIndex &index);
+        void checkOverloadsAndOverrides(const SymbolTableIndex &index);
+        void checkOverloads(const std::vector<SymbolTableNode *> &funcs, const SymbolTableNode *classEntry);
+        void checkShadowing(const SymbolTableIndex &index);
+        void checkCircularDependencies(const SymbolTableIndex &index);
+        void checkUndeclaredClassTypes(const SymbolTableIndex &index);
+
+        // Function bodies may be checked concurrently: everything reached from a ScopeContext only reads the symbol table,
+        // and diagnostics go to the body's own `problems` buffer.
         struct ScopeContext {
+            Problems *problems = nullptr;
             SymbolTableNode *global_table = nullptr;
             SymbolTableNode *class_node = nullptr;
             SymbolTableNode *function_node = nullptr;
         };
 
         void checkAllFunctionBodies(SymbolTableNode *globalTable);
-        void checkStatBlock(std::shared_ptr<const ASTNode> statBlock, const ScopeContext &ctx);
-        void checkStatement(std::shared_ptr<const ASTNode> stmt, const ScopeContext &ctx);
-        void checkAssignStat(std::shared_ptr<const ASTNode> node, const ScopeContext &ctx);
-        void checkReturnStat(std::shared_ptr<const ASTNode> node, const ScopeContext &ctx);
-        void checkFuncCallStat(std::shared_ptr<const ASTNode> node, const ScopeContext &ctx);
-
-        std::string inferType(std::shared_ptr<const ASTNode> expr, const ScopeContext &ctx);
-        std::string inferTypeId(std::shared_ptr<const ASTNode> node, const ScopeContext &ctx);
-        std::string inferTypeMemberAccess(std::shared_ptr<const ASTNode> node, const ScopeContext &ctx);
-        std::string inferTypeIndexedVar(std::shared_ptr<const ASTNode> node, const ScopeContext &ctx);
-        std::string inferTypeFuncCall(std::shared_ptr<const ASTNode> node, const ScopeContext &ctx);
+        void checkStatBlock(const ASTNode *statBlock, const ScopeContext &ctx);
+        void checkStatement(const ASTNode *stmt, const ScopeContext &ctx);
+        void checkAssignStat(const ASTNode *node, const ScopeContext &ctx);
+        void checkReturnStat(const ASTNode *node, const ScopeContext &ctx);
+        void checkFuncCallStat(const ASTNode *node, const ScopeContext &ctx);
+
+        TypeId inferType(const ASTNode *expr, const ScopeContext &ctx);
+        TypeId inferNodeType(const ASTNode *expr, const ScopeContext &ctx);
+        TypeId inferTypeId(const ASTNode *node, const ScopeContext &ctx);
+        TypeId inferTypeMemberAccess(const ASTNode *node, const ScopeContext &ctx);
+        TypeId inferTypeIndexedVar(const ASTNode *node, const ScopeContext &ctx);
+        TypeId inferTypeFuncCall(const ASTNode *node, const ScopeContext &ctx);
 
         SymbolTableNode *lookupInScope(const std::string &name, const ScopeContext &ctx) const;
         SymbolTableNode *lookupInClass(SymbolTableNode *classNode, const std::string &name) const;
         SymbolTableNode *findClassByName(const std::string &name) const;
         SymbolTableNode *findFreeFunctionByName(const std::string &name) const;
-        SymbolTableNode *findFreeFunctionByNameAndArgs(const std::string &name, const std::vector<std::string> &argTypes) const;
-
-        static int CountArrayDimensions(const std::string &type);
-        static std::string StripAllDimensions(const std::string &type);
-        static std::string StripOneDimension(const std::string &type);
-        static bool TypesCompatible(const std::string &a, const std::string &b);
-        std::vector<SymbolTableNode *> collectInheritedClasses(SymbolTableNode *classNode) const;
+        SymbolTableNode *findFreeFunctionByNameAndArgs(const std::string &name, const std::vector<TypeId> &argTypes) const;
+        const std::vector<SymbolTableNode *> &collectInheritedClasses(SymbolTableNode *classNode) const;
     };
 } // namespace lang
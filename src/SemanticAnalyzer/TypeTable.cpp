@@ -0,0 +1,98 @@
+#include "TypeTable.hpp"
+
+#include <charconv>
+
+namespace lang
+{
+    TypeTable::TypeTable(ClassResolver resolveClass) :
+        m_resolveClass(std::move(resolveClass))
+    {
+        internBuiltins();
+    }
+
+    void TypeTable::clear()
+    {
+        std::unique_lock lock(m_mutex);
+        m_types.clear();
+        internBuiltins();
+    }
+
+    void TypeTable::internBuiltins()
+    {
+        m_int = internLocked("int");
+        m_float = internLocked("float");
+        m_void = internLocked("void");
+    }
+
+    TypeId TypeTable::intern(std::string_view spelling)
+    {
+        if (spelling.empty())
+            return nullptr;
+
+        {
+            std::shared_lock lock(m_mutex);
+            if (auto it = m_types.find(spelling); it != m_types.end())
+                return it->second.get();
+        }
+
+        std::unique_lock lock(m_mutex);
+        return internLocked(spelling);
+    }
+
+    TypeId TypeTable::internLocked(std::string_view spelling)
+    {
+        if (spelling.empty())
+            return nullptr;
+
+        if (auto it = m_types.find(spelling); it != m_types.end())
+            return it->second.get();
+
+        std::string key(spelling);
+
+        auto info = std::make_unique<TypeInfo>();
+        info->spelling = key;
+
+        const size_t bracket = key.find('[');
+        if (bracket != std::string::npos) {
+            size_t pos = bracket;
+            while (pos != std::string::npos) {
+                const size_t close = key.find(']', pos);
+                const std::string_view dim = std::string_view(key).substr(pos + 1, close == std::string::npos ? std::string_view::npos : close - pos - 1);
+                int size = TypeInfo::UNSIZED;
+                if (!dim.empty())
+                    std::from_chars(dim.data(), dim.data() + dim.size(), size);
+                info->dims.push_back(size);
+                if (close == std::string::npos)
+                    break;
+                pos = key.find('[', close);
+            }
+
+            const size_t close = key.find(']', bracket);
+            info->element = close == std::string::npos ? info.get() : internLocked(key.substr(0, bracket) + key.substr(close + 1));
+            if (TypeId scalar = internLocked(std::string_view(key).substr(0, bracket))) {
+                info->scalar = scalar;
+                info->base = scalar->base;
+                info->classNode = scalar->classNode;
+            }
+        } else if (key == "int") {
+            info->base = TypeInfo::Base::Int;
+        } else if (key == "float") {
+            info->base = TypeInfo::Base::Float;
+        } else if (key == "void") {
+            info->base = TypeInfo::Base::Void;
+        } else {
+            info->classNode = m_resolveClass ? m_resolveClass(key) : nullptr;
+        }
+
+        return m_types.emplace(std::move(key), std::move(info)).first->second.get();
+    }
+
+    bool TypeTable::Compatible(TypeId a, TypeId b)
+    {
+        if (!a || !b)
+            return true;
+        if (a == b)
+            return true;
+        return a->base == TypeInfo::Base::Int && !a->isArray() && b->base == TypeInfo::Base::Float && !b->isArray();
+    }
+} // namespace lang
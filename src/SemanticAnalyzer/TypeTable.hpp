@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace lang
+{
+    struct SymbolTableNode;
+
+    struct TypeInfo {
+        enum class Base {
+            Int,
+            Float,
+            Void,
+            Class
+        };
+
+        static constexpr int UNSIZED = -1;
+
+        std::string spelling;
+        Base base = Base::Class;
+        SymbolTableNode *classNode = nullptr;
+        std::vector<int> dims;
+
+        const TypeInfo *element = this;
+        const TypeInfo *scalar = this;
+
+        bool isArray() const { return !dims.empty(); }
+        bool isPointer() const { return !dims.empty() && dims.front() == UNSIZED; }
+        int dimensionCount() const { return static_cast<int>(dims.size()); }
+    };
+
+    using TypeId = const TypeInfo *;
+
+    // Hash-consed table of types keyed by their canonical spelling ("float[3][]"). Two equal spellings always yield the same TypeId,
+    // so comparing types is a pointer compare. The empty spelling is the unknown type and maps to nullptr.
+    // intern() may be called from several function-body checks at once; lookups share the lock, insertions take it exclusively.
+    // The builtin int, float and void types are interned up front and handed out without a lookup.
+    class TypeTable
+    {
+    public:
+        using ClassResolver = std::function<SymbolTableNode *(const std::string &)>;
+
+        explicit TypeTable(ClassResolver resolveClass);
+
+        TypeId intern(std::string_view spelling);
+        void clear();
+
+        TypeId intType() const { return m_int; }
+        TypeId floatType() const { return m_float; }
+        TypeId voidType() const { return m_void; }
+
+        static std::string_view Spelling(TypeId type) { return type ? std::string_view(type->spelling) : std::string_view(); }
+        static bool Compatible(TypeId a, TypeId b);
+
+    private:
+        // Lets lookups take a string_view without building a key
+        struct SpellingHash {
+            using is_transparent = void;
+            std::size_t operator()(std::string_view spelling) const { return std::hash<std::string_view>{}(spelling); }
+        };
+
+        TypeId internLocked(std::string_view spelling);
+        void internBuiltins();
+
+        ClassResolver m_resolveClass;
+        mutable std::shared_mutex m_mutex;
+        std::unordered_map<std::string, std::unique_ptr<TypeInfo>, SpellingHash, std::equal_to<>> m_types;
+        TypeId m_int = nullptr;
+        TypeId m_float = nullptr;
+        TypeId m_void = nullptr;
+    };
+} // namespace lang
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <set>
 
+#include "AST/ASTWalker.hpp"
 #include "LexicalAnalyzer/LexicalAnalyzer.hpp"
 #include "SyntacticAnalyzer.hpp"
 #include "spdlog/spdlog.h"
@@ -11,14 +12,18 @@
 
 namespace lang
 {
-    SyntacticAnalyzer::SyntacticAnalyzer() : m_firstSet(generateFirstSet()), m_followSet(generateFollowSet()), m_parseTable(generateParseTable()) {}
+    SyntacticAnalyzer::SyntacticAnalyzer() :
+        m_firstSet(getGrammarAnalysis().firstSet), m_followSet(getGrammarAnalysis().followSet), m_parseTable(getGrammarAnalysis().parseTable)
+    {
+    }
 
     void SyntacticAnalyzer::openFile(std::string_view path)
     {
         closeFile();
         while (!m_nodeStack.empty()) m_nodeStack.pop();
         m_astRoot = nullptr;
-        m_lastToken = Token{ TokenType::END_OF_FILE, "", 0, 0, "" };
+        m_astArena.reset();
+        m_lastToken = CompactToken{ .type = TokenType::END_OF_FILE };
         m_savedOperators.clear();
         m_savedLeadId.clear();
         m_currentVisibility = "";
@@ -27,20 +32,25 @@ namespace lang
 
         m_currentFilePath = path;
 
-        m_tokens.resize(0);
-        std::uint64_t read_bytes = m_lexicalAnalyzer.readFile(path);
-        m_tokens.reserve(read_bytes / 10);
+        m_lookaheadHead = 0;
+        m_lookaheadCount = 0;
+        m_lexedEOF = false;
+        m_consumedEOF = false;
+        m_rawTokens.clear();
 
-        lex();
+        std::uint64_t read_bytes = m_lexicalAnalyzer.readFile(path);
+        if (m_keepRawTokens)
+            m_rawTokens.reserve(read_bytes / 10);
+    }
 
-        m_rawTokens = m_tokens;  // save all tokens (including comments) before erasure
+    void SyntacticAnalyzer::setKeepRawTokens(bool keep)
+    {
+        m_keepRawTokens = keep;
+    }
 
-        m_tokens.erase(
-            std::remove_if(
-                m_tokens.begin(),
-                m_tokens.end(),
-                [](const Token &token) { return token.type == TokenType::INLINE_COMMENT || token.type == TokenType::BLOCK_COMMENT; }),
-            m_tokens.end());
+    void SyntacticAnalyzer::setLexJobs(std::size_t jobs)
+    {
+        m_lexicalAnalyzer.setJobs(jobs);
     }
 
     void SyntacticAnalyzer::closeFile()
@@ -48,31 +58,49 @@ namespace lang
         m_lexicalAnalyzer.closeFile();
     }
 
-    void SyntacticAnalyzer::lex()
+    // Next non-comment token from the lexer; comments only go to the raw stream.
+    CompactToken SyntacticAnalyzer::pullToken()
     {
-        auto start = std::chrono::high_resolution_clock::now();
+        if (m_lexedEOF)
+            return m_eofToken;
 
         while (true) {
-            Token token = m_lexicalAnalyzer.next();
-            m_tokens.push_back(token);
+            CompactToken token = m_lexicalAnalyzer.next();
+            if (m_keepRawTokens)
+                m_rawTokens.push_back(token);
 
             if (token.type == TokenType::UNKNOWN) {
                 m_problems.error(
                     "Lexical Error",
-                    std::format("unknown token '{}'", token.lexeme),
-                    { token });
+                    std::format("unknown token '{}'", m_lexicalAnalyzer.getLexeme(token)),
+                    { m_lexicalAnalyzer.toToken(token) });
             }
 
             if (token.type == TokenType::END_OF_FILE) {
-                break;
+                m_lexedEOF = true;
+                m_eofToken = token;
             }
-        }
 
-        auto end = std::chrono::high_resolution_clock::now();
+            if (token.type != TokenType::INLINE_COMMENT && token.type != TokenType::BLOCK_COMMENT)
+                return token;
+        }
+    }
 
-        std::chrono::duration<double, std::milli> elapsed = end - start;
+    const CompactToken &SyntacticAnalyzer::peekToken(std::size_t ahead)
+    {
+        while (m_lookaheadCount <= ahead) {
+            m_lookahead[(m_lookaheadHead + m_lookaheadCount) % LOOKAHEAD_CAPACITY] = pullToken();
+            m_lookaheadCount++;
+        }
+        return m_lookahead[(m_lookaheadHead + ahead) % LOOKAHEAD_CAPACITY];
+    }
 
-        spdlog::info("{}: Lexed {} tokens in \t {:.2f}ms", m_currentFilePath, m_tokens.size(), elapsed.count());
+    void SyntacticAnalyzer::advanceToken()
+    {
+        if (peekToken().type == TokenType::END_OF_FILE)
+            m_consumedEOF = true;
+        m_lookaheadHead = (m_lookaheadHead + 1) % LOOKAHEAD_CAPACITY;
+        m_lookaheadCount--;
     }
 
     // clang-format off
@@ -400,6 +428,17 @@ namespace lang
         return std::holds_alternative<tags::EpsilonTag>(s);
     }
 
+    const GrammarAnalysis &SyntacticAnalyzer::getGrammarAnalysis()
+    {
+        static const GrammarAnalysis analysis = [] {
+            FirstSet firstSet = generateFirstSet();
+            FollowSet followSet = generateFollowSet(firstSet);
+            ParseTable parseTable = generateParseTable(firstSet, followSet);
+            return GrammarAnalysis{ std::move(firstSet), std::move(followSet), std::move(parseTable) };
+        }();
+        return analysis;
+    }
+
     FirstSet SyntacticAnalyzer::generateFirstSet()
     {
         FirstSet first;
@@ -446,7 +485,7 @@ namespace lang
         return first;
     }
 
-    FollowSet SyntacticAnalyzer::generateFollowSet()
+    FollowSet SyntacticAnalyzer::generateFollowSet(const FirstSet &firstSet)
     {
         FollowSet follow;
 
@@ -481,11 +520,11 @@ namespace lang
                                 }
 
                                 auto next_nonterm = std::get_if<NonTerminal>(&next.value);
-                                for (auto &f : m_firstSet.at(*next_nonterm))
+                                for (auto &f : firstSet.at(*next_nonterm))
                                     if (!isEpsilon(f))
                                         changed |= follow[*B].insert(std::get<TokenType>(f)).second;
 
-                                if (!m_firstSet.at(*next_nonterm).contains(tags::EPS)) {
+                                if (!firstSet.at(*next_nonterm).contains(tags::EPS)) {
                                     nullableSuffix = false;
                                     break;
                                 }
@@ -502,16 +541,23 @@ namespace lang
         return follow;
     }
 
-    ParseTable SyntacticAnalyzer::generateParseTable()
+    ParseTable SyntacticAnalyzer::generateParseTable(const FirstSet &firstSet, const FollowSet &followSet)
     {
         ParseTable table;
+        for (auto &row : table.entries) row.fill(ParseTable::NO_PRODUCTION);
+
+        auto set = [&](NonTerminal A, TokenType t, ProductionIndex index) {
+            table.entries[static_cast<std::size_t>(A)][static_cast<std::size_t>(t)] = index;
+        };
 
         for (auto &[A, prods] : grammar) {
-            table[A];
             for (auto &p : prods) {
+                auto index = static_cast<ProductionIndex>(table.productions.size());
+                table.productions.push_back({ static_cast<std::uint32_t>(table.symbols.size()), static_cast<std::uint32_t>(p.size()) });
+                table.symbols.insert(table.symbols.end(), p.begin(), p.end());
 
                 if (p.empty()) {
-                    for (auto t : m_followSet.at(A)) table[A][t] = ParseTableEntry{ p };
+                    for (auto t : followSet.at(A)) set(A, t, index);
                     continue;
                 }
 
@@ -522,31 +568,31 @@ namespace lang
                         continue;
 
                     if (auto sym_term = std::get_if<TokenType>(&sym.value)) {
-                        table[A][*sym_term] = ParseTableEntry{ p };
+                        set(A, *sym_term, index);
                         nullable = false;
                         break;
                     }
 
                     auto sym_nonterm = std::get_if<NonTerminal>(&sym.value);
-                    for (auto &f : m_firstSet.at(*sym_nonterm))
+                    for (auto &f : firstSet.at(*sym_nonterm))
                         if (!isEpsilon(f))
-                            table[A][std::get<TokenType>(f)] = ParseTableEntry{ p };
+                            set(A, std::get<TokenType>(f), index);
 
-                    if (!m_firstSet.at(*sym_nonterm).contains(tags::EPS)) {
+                    if (!firstSet.at(*sym_nonterm).contains(tags::EPS)) {
                         nullable = false;
                         break;
                     }
                 }
 
                 if (nullable)
-                    for (auto t : m_followSet.at(A)) table[A][t] = ParseTableEntry{ p };
+                    for (auto t : followSet.at(A)) set(A, t, index);
             }
         }
 
         for (const auto &[A, _] : grammar)
-            for (auto t : m_followSet.at(A))
-                if (!table[A].contains(t))
-                    table[A][t] = ParseTableEntry{ tags::SYNC };
+            for (auto t : followSet.at(A))
+                if (table.at(A, t) == ParseTable::NO_PRODUCTION)
+                    set(A, t, ParseTable::SYNC_PRODUCTION);
 
         return table;
     }
@@ -576,23 +622,20 @@ namespace lang
         out << m_problems.getProblems(m_lexicalAnalyzer);
     }
 
-    void SyntacticAnalyzer::writeDerivationSteps(const NonTerminal &A, const ParseTableEntry &entry)
+    void SyntacticAnalyzer::writeDerivationSteps(const NonTerminal &A, std::span<const Symbol> production)
     {
         std::string res;
 
         res.append(to_string(A)).append(" -> ");
 
-        if (std::holds_alternative<Production>(entry)) {
-            auto &prod = std::get<Production>(entry);
-            if (prod.empty())
-                res.append("EPSILON");
+        if (production.empty())
+            res.append("EPSILON");
 
-            for (auto &sym : prod) {
-                if (auto term = std::get_if<TokenType>(&sym.value))
-                    res.append("'").append(lang::tokenTypeToCompString(*term)).append("' ");
-                else if (auto nonterm = std::get_if<NonTerminal>(&sym.value))
-                    res.append("<").append(to_string(*nonterm)).append("> ");
-            }
+        for (auto &sym : production) {
+            if (auto term = std::get_if<TokenType>(&sym.value))
+                res.append("'").append(lang::tokenTypeToCompString(*term)).append("' ");
+            else if (auto nonterm = std::get_if<NonTerminal>(&sym.value))
+                res.append("<").append(to_string(*nonterm)).append("> ");
         }
 
         while (!res.empty() && res.back() == ' ') res.pop_back();
@@ -625,49 +668,49 @@ namespace lang
         out += "node [shape=record];\n";
         out += " node [fontname=Sans];charset=\"UTF-8\" splines=true splines=spline rankdir =LR\n";
 
-        std::uint64_t counter = 0;
-        std::function<void(const lang::ASTNodePtr &)> assign;
-        std::unordered_map<lang::ASTNode *, std::uint64_t> ids;
-
-        assign = [&](const lang::ASTNodePtr &n) {
-            if (!n)
-                return;
-            ids[n.get()] = counter++;
-            for (auto &c : n->children) assign(c);
-        };
-        assign(m_astRoot);
-
-        std::function<void(const lang::ASTNodePtr &)> emit;
-        emit = [&](const lang::ASTNodePtr &n) {
-            if (!n)
-                return;
-            auto id = ids[n.get()];
-            std::string label = lang::to_string(n->kind);
-            if (!n->lexeme.empty()) {
-                label += " | ";
-                std::string new_lexeme;
-                for (char c : n->lexeme) {
-                    if (needs_escape.contains(c))
-                        new_lexeme += '\\';
-                    new_lexeme += c;
+        // Ids are handed out in pre-order, so each node is numbered as it is entered and linked from the id of the node
+        // that was being expanded
+        struct {
+            std::string &out;
+            std::uint64_t counter = 0;
+            std::vector<std::uint64_t> open;
+
+            bool enter(const ASTNode *n)
+            {
+                if (!open.empty())
+                    out += std::to_string(open.back()) + "->" + std::to_string(n ? counter : 0) + ";\n";
+                if (!n)
+                    return false;
+
+                auto id = counter++;
+                std::string label = lang::to_string(n->kind);
+                if (!n->lexeme.empty()) {
+                    label += " | ";
+                    std::string new_lexeme;
+                    for (char c : n->lexeme) {
+                        if (needs_escape.contains(c))
+                            new_lexeme += '\\';
+                        new_lexeme += c;
+                    }
+                    label += new_lexeme;
                 }
-                label += new_lexeme;
-            }
-            out += std::to_string(id) + "[label=\"" + label + "\"];\n";
+                out += std::to_string(id) + "[label=\"" + label + "\"];\n";
 
-            if (n->children.empty()) {
-                if (n->kind == lang::ASTNode::Kind::DimList) {
+                if (n->children.empty() && n->kind == lang::ASTNode::Kind::DimList) {
                     out += "none" + std::to_string(id) + "[shape=point];\n";
                     out += std::to_string(id) + "->none" + std::to_string(id) + ";\n";
                 }
-            } else {
-                for (auto &c : n->children) {
-                    out += std::to_string(id) + "->" + std::to_string(ids[c.get()]) + ";\n";
-                    emit(c);
-                }
+                open.push_back(id);
+                return true;
             }
-        };
-        emit(m_astRoot);
+
+            void leave(const ASTNode *n)
+            {
+                if (n)
+                    open.pop_back();
+            }
+        } emit{ out };
+        WalkAST<const ASTNode>(m_astRoot, emit);
 
         out += "}\n";
         return out;
@@ -689,7 +732,7 @@ namespace lang
         return m_lexicalAnalyzer;
     }
 
-    const std::vector<Token> &SyntacticAnalyzer::getRawTokens() const
+    const std::vector<CompactToken> &SyntacticAnalyzer::getRawTokens() const
     {
         return m_rawTokens;
     }
@@ -709,9 +752,16 @@ namespace lang
         return makeDotASTString();
     }
 
+    Token SyntacticAnalyzer::expandToken(const CompactToken &token) const
+    {
+        if (token.line == 0)
+            return Token{ TokenType::END_OF_FILE, "", 0, 0, "" };
+        return m_lexicalAnalyzer.toToken(token);
+    }
+
 #define SYNTAX_ERROR()                                                                   \
     if (m_problems.getWarningCount() + m_problems.getErrorCount() >= maxErrors) {        \
-        m_problems.error("Fatal Error:", "too many syntax errors; aborting", { token }); \
+        m_problems.error("Fatal Error:", "too many syntax errors; aborting", { expandToken(token) }); \
         goto parse_done;                                                                 \
     }
 
@@ -722,18 +772,16 @@ namespace lang
         st.push(Symbol::T(TokenType::END_OF_FILE));
         st.push(Symbol::N(NonTerminal::START));
 
-        std::uint32_t idx = 0;
         constexpr std::uint32_t maxErrors = 200;
 
         while (!st.empty()) {
-            if (idx >= m_tokens.size()) {
-                m_problems.error(
-                    "Syntax Error", "unexpected end of token stream", { m_tokens.empty() ? Token{ TokenType::END_OF_FILE, "", 0, 0, "" } : m_tokens.back() });
+            if (m_consumedEOF) {
+                m_problems.error("Syntax Error", "unexpected end of token stream", { expandToken(m_eofToken) });
                 break;
             }
 
             auto top = st.top();
-            auto token = m_tokens[idx];
+            auto token = peekToken();
 
             if (auto top_action = std::get_if<SemanticAction>(&top.value)) {
                 executeAction(*top_action);
@@ -743,14 +791,14 @@ namespace lang
                 if (*top_term == token.type) [[likely]] {
                     m_lastToken = token;
                     st.pop();
-                    idx++;
+                    advanceToken();
                 } else {
                     if (*top_term == TokenType::END_OF_FILE) {
                         m_problems.warn(
                             "Syntax Error (recovered)",
                             std::format(R"(discarding unexpected token "{}" before end of file)", lang::tokenTypeToCompString(token.type)),
-                            { token });
-                        idx++;
+                            { expandToken(token) });
+                        advanceToken();
                     } else if (token.type == TokenType::END_OF_FILE || isLikelyMissingDelimiter(*top_term)) {
                         m_problems.warn(
                             "Syntax Error (recovered)",
@@ -758,7 +806,7 @@ namespace lang
                                 R"(expected "{}", but got "{}"; inserting missing token)",
                                 lang::tokenTypeToCompString(*top_term),
                                 lang::tokenTypeToCompString(token.type)),
-                            { token });
+                            { expandToken(token) });
                         st.pop();
                     } else {
                         m_problems.warn(
@@ -767,8 +815,8 @@ namespace lang
                                 R"(expected "{}", but got "{}"; discarding unexpected token)",
                                 lang::tokenTypeToCompString(*top_term),
                                 lang::tokenTypeToCompString(token.type)),
-                            { token });
-                        idx++;
+                            { expandToken(token) });
+                        advanceToken();
                     }
 
                     SYNTAX_ERROR();
@@ -776,30 +824,30 @@ namespace lang
             } else {
                 const auto A = std::get<NonTerminal>(top.value);
 
-                if (m_parseTable.contains(A) && m_parseTable.at(A).contains(token.type)) [[likely]] {
-                    auto &entry = m_parseTable.at(A).at(token.type);
+                ProductionIndex entry = m_parseTable.at(A, token.type);
 
-                    if (std::holds_alternative<tags::SyncTag>(entry)) {
+                if (entry != ParseTable::NO_PRODUCTION) [[likely]] {
+                    if (entry == ParseTable::SYNC_PRODUCTION) {
                         m_problems.warn(
                             "Syntax Error (recovered)",
                             std::format(R"(synchronizing: popping non-terminal <{}> on lookahead "{}")", to_string(A), lang::tokenTypeToCompString(token.type)),
-                            { token });
+                            { expandToken(token) });
                         st.pop();
                         SYNTAX_ERROR();
                         continue;
                     }
 
-                    writeDerivationSteps(A, entry);
+                    auto prod = m_parseTable.production(entry);
+                    writeDerivationSteps(A, prod);
 
                     st.pop();
-                    auto &prod = std::get<Production>(entry);
                     for (auto it = prod.rbegin(); it != prod.rend(); ++it) st.push(*it);
                 } else {
                     if (token.type == TokenType::END_OF_FILE) {
                         m_problems.error(
                             "Syntax Error",
                             std::format(R"(no production for non-terminal <{}> with lookahead "{}")", to_string(A), lang::tokenTypeToCompString(token.type)),
-                            { token });
+                            { expandToken(token) });
                         break;
                     }
 
@@ -809,17 +857,20 @@ namespace lang
                             R"(no production for non-terminal <{}> with lookahead "{}"; discarding token)",
                             to_string(A),
                             lang::tokenTypeToCompString(token.type)),
-                        { token });
-                    idx++;
+                        { expandToken(token) });
+                    advanceToken();
                     SYNTAX_ERROR();
                 }
             }
         }
 
     parse_done:
-        if (idx < m_tokens.size() && m_tokens[idx].type != TokenType::END_OF_FILE) {
-            m_problems.warn(
-                "Syntax Error (recovered)", std::format("skipping {} extra tokens after parse completion", m_tokens.size() - idx), { m_tokens[idx] });
+        // Drain the rest of the file so its lexical errors and raw tokens are still collected
+        if (!m_consumedEOF && peekToken().type != TokenType::END_OF_FILE) {
+            CompactToken first = peekToken();
+            std::uint64_t skipped = 0;
+            for (; !m_consumedEOF; skipped++) advanceToken();
+            m_problems.warn("Syntax Error (recovered)", std::format("skipping {} extra tokens after parse completion", skipped), { expandToken(first) });
         }
 
         auto end = std::chrono::high_resolution_clock::now();
@@ -856,7 +907,24 @@ namespace lang
         }
 
         if (m_astRoot)
-            WireASTParents(nullptr, m_astRoot.get());
+            WireASTParents(m_astRoot);
+    }
+
+    void SyntacticAnalyzer::WireASTParents(ASTNode *root)
+    {
+        struct {
+            bool enter(ASTNode *node)
+            {
+                if (!node)
+                    return false;
+                for (auto *child : node->children)
+                    if (child)
+                        child->parent = node;
+                return true;
+            }
+            void leave(ASTNode *) {}
+        } wire;
+        WalkAST(root, wire);
     }
 
     ASTNodePtr SyntacticAnalyzer::getAST() const
@@ -864,9 +932,9 @@ namespace lang
         return m_astRoot;
     }
 
-    static ASTNodePtr makeNode(ASTNode::Kind kind, std::string lexeme = "")
+    ASTNodePtr SyntacticAnalyzer::makeNode(ASTNode::Kind kind, std::string lexeme)
     {
-        auto n = std::make_shared<ASTNode>();
+        auto n = m_astArena.make();
         n->kind = kind;
         n->lexeme = std::move(lexeme);
         return n;
@@ -898,8 +966,8 @@ namespace lang
         switch (action) {
             case SemanticAction::MakeId:
                 {
-                    auto n = makeNode(ASTNode::Kind::Id, m_lastToken.lexeme);
-                    n->token = m_lastToken;
+                    auto n = makeNode(ASTNode::Kind::Id, std::string(m_lexicalAnalyzer.getLexeme(m_lastToken)));
+                    n->token = expandToken(m_lastToken);
                     m_nodeStack.push(n);
                     break;
                 }
@@ -907,15 +975,15 @@ namespace lang
                 {
                     if (!m_savedLeadId.empty()) {
                         auto n = makeNode(ASTNode::Kind::Id, m_savedLeadId);
-                        n->token = m_savedLeadToken;
+                        n->token = expandToken(m_savedLeadToken);
                         m_nodeStack.push(n);
                     }
                     break;
                 }
             case SemanticAction::MakeType:
                 {
-                    auto n = makeNode(ASTNode::Kind::Type, m_lastToken.lexeme);
-                    n->token = m_lastToken;
+                    auto n = makeNode(ASTNode::Kind::Type, std::string(m_lexicalAnalyzer.getLexeme(m_lastToken)));
+                    n->token = expandToken(m_lastToken);
                     m_nodeStack.push(n);
                     break;
                 }
@@ -923,15 +991,15 @@ namespace lang
                 {
                     if (!m_savedLeadId.empty()) {
                         auto n = makeNode(ASTNode::Kind::Type, m_savedLeadId);
-                        n->token = m_savedLeadToken;
+                        n->token = expandToken(m_savedLeadToken);
                         m_nodeStack.push(n);
                     }
                     break;
                 }
             case SemanticAction::MakeNum:
                 {
-                    auto n = makeNode(ASTNode::Kind::Num, m_lastToken.lexeme);
-                    n->token = m_lastToken;
+                    auto n = makeNode(ASTNode::Kind::Num, std::string(m_lexicalAnalyzer.getLexeme(m_lastToken)));
+                    n->token = expandToken(m_lastToken);
                     m_nodeStack.push(n);
                     break;
                 }
@@ -994,12 +1062,12 @@ namespace lang
             case SemanticAction::MakeClass:
                 {
                     auto members = popToMarker(m_nodeStack);
-                    ASTNodePtr inherits;
+                    ASTNodePtr inherits = nullptr;
                     if (!m_nodeStack.empty() && !isMarker(m_nodeStack.top()) && m_nodeStack.top()->kind == ASTNode::Kind::InheritList) {
                         inherits = m_nodeStack.top();
                         m_nodeStack.pop();
                     }
-                    ASTNodePtr id;
+                    ASTNodePtr id = nullptr;
                     if (!m_nodeStack.empty() && !isMarker(m_nodeStack.top()) && m_nodeStack.top()->kind == ASTNode::Kind::Id) {
                         id = m_nodeStack.top();
                         m_nodeStack.pop();
@@ -1205,7 +1273,7 @@ namespace lang
                     auto left = m_nodeStack.top();
                     m_nodeStack.pop();
                     auto node = makeNode(ASTNode::Kind::AddOp, op);
-                    node->token = m_lastToken;
+                    node->token = expandToken(m_lastToken);
                     node->children = { left, right };
                     m_nodeStack.push(node);
                     break;
@@ -1224,7 +1292,7 @@ namespace lang
                     auto left = m_nodeStack.top();
                     m_nodeStack.pop();
                     auto node = makeNode(ASTNode::Kind::MultOp, op);
-                    node->token = m_lastToken;
+                    node->token = expandToken(m_lastToken);
                     node->children = { left, right };
                     m_nodeStack.push(node);
                     break;
@@ -1243,7 +1311,7 @@ namespace lang
                     auto left = m_nodeStack.top();
                     m_nodeStack.pop();
                     auto node = makeNode(ASTNode::Kind::RelOp, op);
-                    node->token = m_lastToken;
+                    node->token = expandToken(m_lastToken);
                     node->children = { left, right };
                     m_nodeStack.push(node);
                     break;
@@ -1321,18 +1389,18 @@ namespace lang
                 }
             case SemanticAction::SaveOp:
                 {
-                    m_savedOperators.push_back(m_lastToken.lexeme);
+                    m_savedOperators.push_back(std::string(m_lexicalAnalyzer.getLexeme(m_lastToken)));
                     break;
                 }
             case SemanticAction::SaveLeadId:
                 {
-                    m_savedLeadId = m_lastToken.lexeme;
+                    m_savedLeadId = std::string(m_lexicalAnalyzer.getLexeme(m_lastToken));
                     m_savedLeadToken = m_lastToken;
                     break;
                 }
             case SemanticAction::SaveVisibility:
                 {
-                    m_currentVisibility = m_lastToken.lexeme;
+                    m_currentVisibility = std::string(m_lexicalAnalyzer.getLexeme(m_lastToken));
                     break;
                 }
         }
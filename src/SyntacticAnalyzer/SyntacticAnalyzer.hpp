@@ -1,7 +1,9 @@
 #pragma once
 
+#include <array>
 #include <cstddef>
 #include <fstream>
+#include <span>
 #include <stack>
 #include <string_view>
 #include <unordered_map>
@@ -9,6 +11,7 @@
 #include <variant>
 #include <vector>
 
+#include "AST/ASTArena.hpp"
 #include "AST/ASTNode.hpp"
 #include "LexicalAnalyzer/LexicalAnalyzer.hpp"
 #include "Problems/Problems.hpp"
@@ -74,6 +77,8 @@ namespace lang
         type_no_id
     };
 
+    inline constexpr std::size_t NON_TERMINAL_COUNT = static_cast<std::size_t>(NonTerminal::type_no_id) + 1;
+
     enum class SemanticAction {
         MakeId,
         MakeSavedId,
@@ -322,19 +327,47 @@ namespace lang
             friend constexpr bool operator==(EpsilonTag, EpsilonTag) = default;
         };
         constexpr EpsilonTag EPS{};
-
-        struct SyncTag {
-            friend constexpr bool operator==(SyncTag, SyncTag) = default;
-        };
-        constexpr SyncTag SYNC{};
     } // namespace tags
 
     using FirstSymbol = std::variant<TokenType, tags::EpsilonTag>;
     using FirstSet = std::unordered_map<NonTerminal, std::unordered_set<FirstSymbol>>;
     using FollowSet = std::unordered_map<NonTerminal, std::unordered_set<TokenType>>;
 
-    using ParseTableEntry = std::variant<Production, tags::SyncTag>;
-    using ParseTable = std::unordered_map<NonTerminal, std::unordered_map<TokenType, ParseTableEntry>>;
+    using ProductionIndex = std::uint16_t;
+
+    // LL(1) table indexed by [NonTerminal][TokenType]. Every production of the grammar is stored
+    // back to back in `symbols`; an entry is either an index into `productions` or one of the
+    // NO_PRODUCTION / SYNC_PRODUCTION markers.
+    struct ParseTable {
+        static constexpr ProductionIndex NO_PRODUCTION = 0xFFFF;
+        static constexpr ProductionIndex SYNC_PRODUCTION = 0xFFFE;
+
+        struct Span {
+            std::uint32_t offset;
+            std::uint32_t length;
+        };
+
+        std::vector<Symbol> symbols;
+        std::vector<Span> productions;
+        std::array<std::array<ProductionIndex, TOKEN_TYPE_COUNT>, NON_TERMINAL_COUNT> entries;
+
+        ProductionIndex at(NonTerminal A, TokenType t) const
+        {
+            return entries[static_cast<std::size_t>(A)][static_cast<std::size_t>(t)];
+        }
+
+        std::span<const Symbol> production(ProductionIndex index) const
+        {
+            return { symbols.data() + productions[index].offset, productions[index].length };
+        }
+    };
+
+    // Derived from the static grammar only, so it is built once and shared by every parser
+    struct GrammarAnalysis {
+        FirstSet firstSet;
+        FollowSet followSet;
+        ParseTable parseTable;
+    };
 
     class SyntacticAnalyzer
     {
@@ -344,6 +377,9 @@ namespace lang
         void openFile(std::string_view path);
         void parse();
 
+        void setKeepRawTokens(bool keep);
+        void setLexJobs(std::size_t jobs);
+
         ASTNodePtr getAST() const;
 
         std::string getFirstSet();
@@ -356,54 +392,64 @@ namespace lang
         void outputDotAST();
 
         const LexicalAnalyzer &getLexer() const;
-        const std::vector<Token> &getRawTokens() const;
+        const std::vector<CompactToken> &getRawTokens() const;
         const Problems &getProblems() const;
         std::string_view getDerivationSteps() const;
         std::string getDotASTString() const;
 
     private:
+        static constexpr std::size_t LOOKAHEAD_CAPACITY = 4;
+
         LexicalAnalyzer m_lexicalAnalyzer;
-        std::vector<Token> m_tokens;
-        std::vector<Token> m_rawTokens;
+        std::array<CompactToken, LOOKAHEAD_CAPACITY> m_lookahead{};
+        std::size_t m_lookaheadHead{ 0 };
+        std::size_t m_lookaheadCount{ 0 };
+        CompactToken m_eofToken{ .type = TokenType::END_OF_FILE };
+        bool m_lexedEOF{ false };
+        bool m_consumedEOF{ false };
+        bool m_keepRawTokens{ false };
+        std::vector<CompactToken> m_rawTokens;
         std::string m_currentFilePath;
 
         Problems m_problems;
         std::string m_outDerivationSteps;
 
+        ASTArena m_astArena;
         std::stack<ASTNodePtr> m_nodeStack;
-        ASTNodePtr m_astRoot;
-        Token m_lastToken{ TokenType::END_OF_FILE, "", 0, 0, "" };
+        ASTNodePtr m_astRoot = nullptr;
+        CompactToken m_lastToken{ .type = TokenType::END_OF_FILE };
         std::vector<std::string> m_savedOperators;
         std::string m_savedLeadId;
-        Token m_savedLeadToken{ TokenType::END_OF_FILE, "", 0, 0, "" };
+        CompactToken m_savedLeadToken{ .type = TokenType::END_OF_FILE };
         std::string m_currentVisibility;
 
+        Token expandToken(const CompactToken &token) const;
+
+        ASTNodePtr makeNode(ASTNode::Kind kind, std::string lexeme = "");
         void executeAction(SemanticAction action);
-        void writeDerivationSteps(const NonTerminal &A, const ParseTableEntry &entry);
+        void writeDerivationSteps(const NonTerminal &A, std::span<const Symbol> production);
 
         std::string makeDotASTString() const;
 
         void closeFile();
-        void lex();
 
-        bool isEpsilon(const FirstSymbol &s);
+        CompactToken pullToken();
+        const CompactToken &peekToken(std::size_t ahead = 0);
+        void advanceToken();
 
-        FirstSet generateFirstSet();
-        FollowSet generateFollowSet();
-        ParseTable generateParseTable();
+        static bool isEpsilon(const FirstSymbol &s);
 
-        static void WireASTParents(ASTNode *parent, ASTNode *child)
-        {
-            if (parent)
-                child->parent = parent;
+        static const GrammarAnalysis &getGrammarAnalysis();
+        static FirstSet generateFirstSet();
+        static FollowSet generateFollowSet(const FirstSet &firstSet);
+        static ParseTable generateParseTable(const FirstSet &firstSet, const FollowSet &followSet);
 
-            for (const auto &grandChild : child->children) WireASTParents(child, grandChild.get());
-        }
+        static void WireASTParents(ASTNode *root);
 
         static const Grammar grammar;
-        const FirstSet m_firstSet;
-        const FollowSet m_followSet;
-        const ParseTable m_parseTable;
+        const FirstSet &m_firstSet;
+        const FollowSet &m_followSet;
+        const ParseTable &m_parseTable;
     };
 } // namespace lang
 
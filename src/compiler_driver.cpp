@@ -1,3 +1,4 @@
+#include "Compiler/CodeGenerator.hpp"
 #include "Compiler/Compiler.hpp"
 
 #include <filesystem>
@@ -24,6 +25,15 @@ int main(int argc, char *const *const argv)
 
     parser.add_argument("--symbol-tables").help("Write symbol table to .outsymboltables").flag().store_into(compiler_settings.emit_symbol_tables);
 
+    parser.add_argument("--dump-ir").help("Write the intermediate code of every function, after its passes, to .outir").flag().store_into(compiler_settings.emit_ir);
+
+    parser.add_argument("--disable-pass")
+        .help("Skip the named IR pass, or a peephole rule; \"peephole\" skips them all (repeatable)")
+        .append()
+        .store_into(compiler_settings.disabled_passes);
+
+    parser.add_argument("-j", "--jobs").help("Number of worker threads for files and function bodies (0 = all hardware threads)").store_into(compiler_settings.jobs);
+
     try {
         parser.parse_args(argc, argv);
     } catch (const std::exception &err) {
@@ -31,10 +41,25 @@ int main(int argc, char *const *const argv)
         return 1;
     }
 
+    if (compiler_settings.jobs < 0) {
+        spdlog::error("--jobs: expected 0 or a positive thread count, got {}", compiler_settings.jobs);
+        return 1;
+    }
+
+    // A misspelled pass would otherwise leave the whole pipeline running while it looks disabled
+    for (const auto &name : compiler_settings.disabled_passes) {
+        if (!lang::CodeGenerator::IsPassName(name)) {
+            spdlog::error("--disable-pass: unknown pass or peephole rule '{}'", name);
+            return 1;
+        }
+    }
+
     Compiler compiler(compiler_settings);
     auto results = compiler.compileAll();
 
-    for (auto &[file, out] : results) {
+    // Results come back in input order, so every file is written in a deterministic order
+    for (auto &out : results) {
+        const std::string &file = out.source_file;
         if (!out.errors_text.empty()) {
             auto errPath = std::filesystem::path(file);
             errPath.replace_extension(".outerrors");
@@ -62,6 +87,7 @@ int main(int argc, char *const *const argv)
         writeOptional(out.derivation_text, ".outderivation");
         writeOptional(out.ast_dot_text, ".outast");
         writeOptional(out.symbol_table_text, ".outsymboltables");
+        writeOptional(out.ir_text, ".outir");
 
         if (out.assembly.empty()) {
             spdlog::warn("No assembly generated for {}", file);
@@ -69,12 +95,10 @@ int main(int argc, char *const *const argv)
         }
         auto moonPath = std::filesystem::path(file);
         moonPath.replace_extension(".moon");
-        std::ofstream f(moonPath);
-        if (!f) {
+        if (!out.assembly.writeTo(moonPath.string())) {
             spdlog::error("Cannot write {}", moonPath.string());
             continue;
         }
-        f << out.assembly;
         spdlog::info("Wrote {}", moonPath.string());
     }
 
@@ -28,18 +28,23 @@ static std::ofstream openOutputFile(const std::string &path, const std::string &
     return file;
 }
 
-static void outputTokens(std::ofstream &out, std::vector<lang::Token> &tokens)
+static std::string escapeLexeme(std::string_view lexeme)
+{
+    return std::regex_replace(std::string(lexeme), std::regex("\n"), "\\n");
+}
+
+static void outputTokens(std::ofstream &out, const lang::LexicalAnalyzer &lexer, const std::vector<lang::CompactToken> &tokens)
 {
     std::uint64_t current_line = 1;
     bool first_token_of_line = true;
 
-    for (auto &token : tokens) {
+    for (const auto &token : tokens) {
         while (token.line > current_line) {
             out.write("\n", 1);
             current_line++;
             first_token_of_line = true;
         }
-        std::string format = std::format("[{}, {}, {}:{}]", lang::tokenTypeToString(token.type), token.lexeme, token.line, token.pos);
+        std::string format = std::format("[{}, {}, {}:{}]", lang::tokenTypeToString(token.type), escapeLexeme(lexer.getLexeme(token)), token.line, lexer.getColumn(token));
         if (!first_token_of_line)
             out.write(" ", 1);
         out.write(format.c_str(), format.size());
@@ -47,29 +52,28 @@ static void outputTokens(std::ofstream &out, std::vector<lang::Token> &tokens)
     }
 }
 
-static void outputTokensFlaci(std::ofstream &out, std::vector<lang::Token> &tokens)
+static void outputTokensFlaci(std::ofstream &out, const std::vector<lang::CompactToken> &tokens)
 {
-    for (auto &token : tokens) {
+    for (const auto &token : tokens) {
         if (token.type == lang::TokenType::INLINE_COMMENT || token.type == lang::TokenType::BLOCK_COMMENT || token.type == lang::TokenType::UNKNOWN)
             continue;
         out << lang::tokenTypeToCompString(token.type) << "\n";
     }
 }
 
-static void outputErrors(std::ofstream &out, std::vector<lang::Token> &tokens)
+static void outputErrors(std::ofstream &out, const lang::LexicalAnalyzer &lexer, const std::vector<lang::CompactToken> &tokens)
 {
-    for (auto &token : tokens) {
+    for (const auto &token : tokens) {
         if (token.type == lang::TokenType::UNKNOWN) {
-            std::string format = std::format("Error: Unknown token '{}' at line {}, position {}\n", token.lexeme, token.line, token.pos);
+            std::string format =
+                std::format("Error: Unknown token '{}' at line {}, position {}\n", escapeLexeme(lexer.getLexeme(token)), token.line, lexer.getColumn(token));
             out.write(format.c_str(), format.size());
         }
     }
 }
 
-static bool lexFile(const std::string &path, std::vector<lang::Token> &tokens)
+static bool lexFile(lang::LexicalAnalyzer &lexer, const std::string &path, std::vector<lang::CompactToken> &tokens)
 {
-    lang::LexicalAnalyzer lexer{};
-
     try {
         std::uint64_t size = lexer.readFile(path);
         tokens.reserve(size / 10);
@@ -80,14 +84,12 @@ static bool lexFile(const std::string &path, std::vector<lang::Token> &tokens)
 
     auto start = std::chrono::high_resolution_clock::now();
 
-    for (lang::Token token = lexer.next(); token.type != lang::TokenType::END_OF_FILE; token = lexer.next()) {
+    for (lang::CompactToken token = lexer.next(); token.type != lang::TokenType::END_OF_FILE; token = lexer.next()) {
         tokens.push_back(token);
     }
 
     auto end = std::chrono::high_resolution_clock::now();
 
-    lexer.closeFile();
-
     std::chrono::duration<double, std::milli> elapsed_ms = end - start;
 
     spdlog::info(R"(Lexed file "{}" ({} ms))", path, elapsed_ms.count());
@@ -102,15 +104,12 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    std::vector<lang::Token> tokens;
+    lang::LexicalAnalyzer lexer{};
+    std::vector<lang::CompactToken> tokens;
 
     for (std::uint64_t idx = 1; idx != argc; idx++) {
         tokens.clear();
-        bool res = lexFile(argv[idx], tokens);
-
-        for (auto &token : tokens) {
-            token.lexeme = std::regex_replace(token.lexeme, std::regex("\n"), "\\n");
-        }
+        bool res = lexFile(lexer, argv[idx], tokens);
 
         std::ofstream outlextokens;
         std::ofstream outlextokensflaci;
@@ -125,9 +124,11 @@ int main(int argc, char **argv)
             return -1;
         }
 
-        outputTokens(outlextokens, tokens);
+        outputTokens(outlextokens, lexer, tokens);
         outputTokensFlaci(outlextokensflaci, tokens);
-        outputErrors(outlexerrors, tokens);
+        outputErrors(outlexerrors, lexer, tokens);
+
+        lexer.closeFile();
 
         if (!res)
             spdlog::error(R"(Error lexing file "{}")", argv[idx]);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace lang
+{
+    // Bump allocator owning every object of one pass (AST nodes, symbol table entries). Objects are never freed one by one:
+    // reset() destroys them all at once and keeps the blocks around for the next file.
+    template <typename T, std::size_t BlockSize = 256>
+    class Arena
+    {
+    public:
+        Arena() = default;
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        ~Arena()
+        {
+            reset();
+        }
+
+        template <typename... Args>
+        T *make(Args &&...args)
+        {
+            if (m_blocks.empty() || m_used == BlockSize) {
+                if (!m_blocks.empty())
+                    m_current++;
+                if (m_current == m_blocks.size())
+                    m_blocks.emplace_back(new Block);
+                m_used = 0;
+            }
+
+            void *slot = m_blocks[m_current]->storage + m_used * sizeof(T);
+            T *object = new (slot) T(std::forward<Args>(args)...);
+            m_used++;
+            return object;
+        }
+
+        void reset()
+        {
+            for (std::size_t b = 0; b < m_blocks.size() && b <= m_current; b++) {
+                std::size_t count = b < m_current ? BlockSize : m_used;
+                for (std::size_t i = 0; i < count; i++) std::launder(reinterpret_cast<T *>(m_blocks[b]->storage + i * sizeof(T)))->~T();
+            }
+            m_current = 0;
+            m_used = 0;
+        }
+
+        std::size_t size() const
+        {
+            return m_blocks.empty() ? 0 : m_current * BlockSize + m_used;
+        }
+
+    private:
+        struct Block {
+            alignas(T) std::byte storage[BlockSize * sizeof(T)];
+        };
+
+        std::vector<std::unique_ptr<Block>> m_blocks;
+        std::size_t m_current{ 0 };
+        std::size_t m_used{ 0 };
+    };
+} // namespace lang
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace lang
+{
+    // Resolves a -j style job count: 0 means every hardware thread.
+    inline std::size_t ResolveJobs(int jobs)
+    {
+        return jobs > 0 ? static_cast<std::size_t>(jobs) : std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Runs task(i) for every i in [0, count) on up to `workers` threads. Each worker owns a deque seeded
+    // round-robin, pops from its front, and steals from the back of the other deques once its own is empty.
+    // The first exception, by index, is rethrown after every worker has finished.
+    inline void ParallelFor(std::size_t count, std::size_t workers, const std::function<void(std::size_t)> &task)
+    {
+        workers = std::min(workers, count);
+        if (workers <= 1) {
+            for (std::size_t i = 0; i < count; i++) task(i);
+            return;
+        }
+
+        struct WorkQueue {
+            std::mutex mutex;
+            std::deque<std::size_t> indices;
+        };
+
+        std::vector<WorkQueue> queues(workers);
+        for (std::size_t i = 0; i < count; i++) queues[i % workers].indices.push_back(i);
+
+        auto take = [&](std::size_t self) -> std::optional<std::size_t> {
+            {
+                std::lock_guard lock(queues[self].mutex);
+                if (!queues[self].indices.empty()) {
+                    std::size_t i = queues[self].indices.front();
+                    queues[self].indices.pop_front();
+                    return i;
+                }
+            }
+            for (std::size_t k = 1; k < workers; k++) {
+                auto &victim = queues[(self + k) % workers];
+                std::lock_guard lock(victim.mutex);
+                if (!victim.indices.empty()) {
+                    std::size_t i = victim.indices.back();
+                    victim.indices.pop_back();
+                    return i;
+                }
+            }
+            return std::nullopt;
+        };
+
+        std::vector<std::exception_ptr> errors(count);
+        std::vector<std::thread> threads;
+        threads.reserve(workers);
+        for (std::size_t w = 0; w < workers; w++) {
+            threads.emplace_back([&, w]() {
+                while (auto i = take(w)) {
+                    try {
+                        task(*i);
+                    } catch (...) {
+                        errors[*i] = std::current_exception();
+                    }
+                }
+            });
+        }
+        for (auto &thread : threads) thread.join();
+
+        for (auto &error : errors)
+            if (error)
+                std::rethrow_exception(error);
+    }
+} // namespace lang
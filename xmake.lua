@@ -2,6 +2,10 @@ add_rules("mode.debug", "mode.release")
 
 set_languages("c++23")
 
+if is_plat("linux") then
+    add_syslinks("pthread")
+end
+
 if is_mode("debug") then
     set_policy("build.sanitizer.address", true)
     set_policy("build.sanitizer.undefined", true)
@@ -16,7 +20,6 @@ add_rules("plugin.compile_commands.autoupdate")
 
 add_requires(
     "spdlog",
-    "ctre",
     "tabulate",
     "argparse"
 )
@@ -26,7 +29,7 @@ set_targetdir("bin")
 target("lexical-analyzer")
     set_default(true)
     set_kind("binary")
-    add_packages("spdlog", "ctre")
+    add_packages("spdlog")
     add_includedirs("src")
     add_files("src/LexicalAnalyzer/**.cpp")
     add_files("src/Problems/**.cpp")
@@ -35,7 +38,7 @@ target("lexical-analyzer")
 target("syntactic-analyzer")
     set_default(true)
     set_kind("binary")
-    add_packages("spdlog", "ctre")
+    add_packages("spdlog")
     add_includedirs("src")
     add_files("src/LexicalAnalyzer/**.cpp")
     add_files("src/SyntacticAnalyzer/**.cpp")
@@ -45,7 +48,7 @@ target("syntactic-analyzer")
 target("ast-generator")
     set_default(true)
     set_kind("binary")
-    add_packages("spdlog", "ctre")
+    add_packages("spdlog")
     add_includedirs("src")
     add_files("src/LexicalAnalyzer/**.cpp")
     add_files("src/Problems/**.cpp")
@@ -55,7 +58,7 @@ target("ast-generator")
 target("semantic-analyzer")
     set_default(true)
     set_kind("binary")
-    add_packages("spdlog", "ctre", "tabulate")
+    add_packages("spdlog", "tabulate")
     add_includedirs("src")
     add_files("src/LexicalAnalyzer/**.cpp")
     add_files("src/Problems/**.cpp")
@@ -66,7 +69,7 @@ target("semantic-analyzer")
 target("compiler")
     set_default(true)
     set_kind("binary")
-    add_packages("spdlog", "ctre", "tabulate", "argparse")
+    add_packages("spdlog", "tabulate", "argparse")
     add_includedirs("src")
     add_files("src/LexicalAnalyzer/**.cpp")
     add_files("src/Problems/**.cpp")